@@ -0,0 +1,178 @@
+﻿#include "aggregates.h"
+#include "report.h"
+#include <algorithm>
+
+using namespace std;
+
+static const double LENGTH_BOUNDS[LENGTH_BUCKETS - 1] = { 1, 5, 10, 50, 100 };
+
+void StationTotals::add(const StationTotals& other) {
+    count += other.count;
+    workshopsTotal += other.workshopsTotal;
+    workshopsWorking += other.workshopsWorking;
+    efficiencySum += other.efficiencySum;
+}
+
+NetworkStats::NetworkStats() {
+    lengthHistogram.fill(0);
+    efficiencyHistogram.fill(0);
+}
+
+size_t NetworkStats::lengthBucket(double length) {
+    size_t b = 0;
+    while (b < LENGTH_BUCKETS - 1 && length >= LENGTH_BOUNDS[b]) ++b;
+    return b;
+}
+
+size_t NetworkStats::efficiencyBucket(double efficiency) {
+    if (efficiency <= 0) return 0;
+    return min(EFFICIENCY_BUCKETS - 1, (size_t)(efficiency / 10.0));
+}
+
+string NetworkStats::lengthBucketLabel(size_t bucket) {
+    auto fmt = [](double v) { return to_string((int)v); };
+    if (bucket == 0) return "< " + fmt(LENGTH_BOUNDS[0]) + " км";
+    if (bucket >= LENGTH_BUCKETS - 1) return ">= " + fmt(LENGTH_BOUNDS[LENGTH_BUCKETS - 2]) + " км";
+    return fmt(LENGTH_BOUNDS[bucket - 1]) + "-" + fmt(LENGTH_BOUNDS[bucket]) + " км";
+}
+
+void NetworkStats::addPipe(const Pipe& p) {
+    PipeTotals& t = pipesByDiameter[p.getDiameter()][p.isInRepair() ? 1 : 0];
+    ++t.count;
+    t.length += p.getLength();
+    ++lengthHistogram[lengthBucket(p.getLength())];
+}
+
+void NetworkStats::removePipe(const Pipe& p) {
+    auto it = pipesByDiameter.find(p.getDiameter());
+    if (it == pipesByDiameter.end()) return;
+    PipeTotals& t = it->second[p.isInRepair() ? 1 : 0];
+    if (t.count == 0) return;
+    // Пустая группа обнуляется целиком, чтобы не копить погрешность сумм
+    if (--t.count == 0) t.length = 0.0;
+    else t.length -= p.getLength();
+    --lengthHistogram[lengthBucket(p.getLength())];
+    if (it->second[0].count == 0 && it->second[1].count == 0) pipesByDiameter.erase(it);
+}
+
+void NetworkStats::addCS(const CS& s) {
+    StationTotals& t = stationsByClass[s.getStationClass()];
+    ++t.count;
+    t.workshopsTotal += s.getWorkshopsTotal();
+    t.workshopsWorking += s.getWorkshopsWorking();
+    t.efficiencySum += s.getEfficiency();
+    ++efficiencyHistogram[efficiencyBucket(s.getEfficiency())];
+}
+
+void NetworkStats::removeCS(const CS& s) {
+    auto it = stationsByClass.find(s.getStationClass());
+    if (it == stationsByClass.end() || it->second.count == 0) return;
+    StationTotals& t = it->second;
+    t.workshopsTotal -= s.getWorkshopsTotal();
+    t.workshopsWorking -= s.getWorkshopsWorking();
+    t.efficiencySum -= s.getEfficiency();
+    --efficiencyHistogram[efficiencyBucket(s.getEfficiency())];
+    if (--t.count == 0) stationsByClass.erase(it);
+}
+
+void NetworkStats::clearPipes() {
+    pipesByDiameter.clear();
+    lengthHistogram.fill(0);
+}
+
+void NetworkStats::clearCS() {
+    stationsByClass.clear();
+    efficiencyHistogram.fill(0);
+}
+
+PipeTotals NetworkStats::pipeTotals(int diameter, int repairFlag) const {
+    PipeTotals result;
+    for (const auto& pair : pipesByDiameter) {
+        if (diameter > 0 && pair.first != diameter) continue;
+        if (repairFlag != 1) result.add(pair.second[0]);
+        if (repairFlag != 0) result.add(pair.second[1]);
+    }
+    return result;
+}
+
+StationTotals NetworkStats::stationTotals() const {
+    StationTotals result;
+    for (const auto& pair : stationsByClass) result.add(pair.second);
+    return result;
+}
+
+StationTotals NetworkStats::stationTotals(const string& stationClass) const {
+    auto it = stationsByClass.find(stationClass);
+    return it == stationsByClass.end() ? StationTotals() : it->second;
+}
+
+vector<int> NetworkStats::diameters() const {
+    vector<int> result;
+    for (const auto& pair : pipesByDiameter) result.push_back(pair.first);
+    sort(result.begin(), result.end());
+    return result;
+}
+
+vector<string> NetworkStats::stationClasses() const {
+    vector<string> result;
+    for (const auto& pair : stationsByClass) result.push_back(pair.first);
+    sort(result.begin(), result.end());
+    return result;
+}
+
+void NetworkStats::writeDashboard(ReportWriter& out) const {
+    PipeTotals all = pipeTotals();
+    PipeTotals repair = pipeTotals(0, 1);
+    out << "\n=== СВОДКА ПО СЕТИ ===";
+    out.endLine();
+    out << "Трубы: " << all.count << ", общая длина ";
+    out.fixed(all.length, 3) << " км; в ремонте " << repair.count << " (";
+    out.fixed(repair.length, 3) << " км)";
+    out.endLine();
+
+    if (all.count > 0) {
+        out.cell("Диаметр, мм", 14).cell("Работает, шт", 14).cell("Работает, км", 16)
+            .cell("В ремонте, шт", 15) << "В ремонте, км";
+        out.endLine();
+        for (int d : diameters()) {
+            const array<PipeTotals, 2>& t = pipesByDiameter.at(d);
+            out.cell(d, 14).cell(to_string(t[0].count), 14).cell(t[0].length, 16, 3)
+                .cell(to_string(t[1].count), 15);
+            out.fixed(t[1].length, 3);
+            out.endLine();
+        }
+        out << "Распределение по длине:";
+        out.endLine();
+        for (size_t b = 0; b < LENGTH_BUCKETS; ++b) {
+            out << "  ";
+            out.cell(lengthBucketLabel(b), 14) << lengthHistogram[b];
+            out.endLine();
+        }
+    }
+
+    StationTotals cs = stationTotals();
+    out << "КС: " << cs.count << ", цехов работает " << (long long)cs.workshopsWorking
+        << " из " << (long long)cs.workshopsTotal << ", средняя эффективность ";
+    out.fixed(cs.averageEfficiency()) << "%";
+    out.endLine();
+
+    if (cs.count > 0) {
+        out.cell("Класс", 12).cell("КС, шт", 10).cell("Цехи (раб./всего)", 20) << "Ср. эффективность, %";
+        out.endLine();
+        for (const string& cls : stationClasses()) {
+            const StationTotals& t = stationsByClass.at(cls);
+            out.cell(cls, 12).cell(to_string(t.count), 10)
+                .cell(to_string(t.workshopsWorking) + "/" + to_string(t.workshopsTotal), 20);
+            out.fixed(t.averageEfficiency());
+            out.endLine();
+        }
+        out << "Распределение по эффективности:";
+        out.endLine();
+        for (size_t b = 0; b < EFFICIENCY_BUCKETS; ++b) {
+            string label = to_string(b * 10) + "-" + to_string(b * 10 + 10) + "%";
+            out << "  ";
+            out.cell(label, 14) << efficiencyHistogram[b];
+            out.endLine();
+        }
+    }
+}
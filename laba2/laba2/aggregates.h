@@ -0,0 +1,75 @@
+#pragma once
+#ifndef AGGREGATES_H
+#define AGGREGATES_H
+
+#include "entities.h"
+#include <unordered_map>
+#include <array>
+#include <vector>
+#include <string>
+
+class ReportWriter;
+
+struct PipeTotals {
+    size_t count = 0;
+    double length = 0.0;    // км
+
+    void add(const PipeTotals& other) { count += other.count; length += other.length; }
+};
+
+struct StationTotals {
+    size_t count = 0;
+    long long workshopsTotal = 0;
+    long long workshopsWorking = 0;
+    double efficiencySum = 0.0;
+
+    void add(const StationTotals& other);
+    double averageEfficiency() const { return count ? efficiencySum / count : 0.0; }
+};
+
+// Границы гистограммы длин труб, км: [0,1), [1,5), [5,10), [10,50), [50,100), [100,...)
+const size_t LENGTH_BUCKETS = 6;
+// Эффективность КС по 10%: [0,10), ..., [90,100]
+const size_t EFFICIENCY_BUCKETS = 10;
+
+// Суммы, количества и гистограммы по диаметру, состоянию ремонта и классу КС.
+// Обновляются за O(1) на каждое изменение (Storage вызывает remove для
+// прежнего состояния и add для нового), поэтому запросы не требуют просмотра данных.
+class NetworkStats {
+    std::unordered_map<int, std::array<PipeTotals, 2>> pipesByDiameter;    // [0] работает, [1] в ремонте
+    std::array<size_t, LENGTH_BUCKETS> lengthHistogram;
+    std::unordered_map<std::string, StationTotals> stationsByClass;
+    std::array<size_t, EFFICIENCY_BUCKETS> efficiencyHistogram;
+
+public:
+    NetworkStats();
+
+    void addPipe(const Pipe& p);
+    void removePipe(const Pipe& p);
+    void addCS(const CS& s);
+    void removeCS(const CS& s);
+    void clearPipes();
+    void clearCS();
+
+    // diameter <= 0 - все диаметры; repairFlag: -1 все, 0 работают, 1 в ремонте
+    PipeTotals pipeTotals(int diameter = 0, int repairFlag = -1) const;
+    StationTotals stationTotals() const;
+    StationTotals stationTotals(const std::string& stationClass) const;
+
+    // По возрастанию
+    std::vector<int> diameters() const;
+    std::vector<std::string> stationClasses() const;
+
+    const std::array<size_t, LENGTH_BUCKETS>& getLengthHistogram() const { return lengthHistogram; }
+    const std::array<size_t, EFFICIENCY_BUCKETS>& getEfficiencyHistogram() const { return efficiencyHistogram; }
+    static std::string lengthBucketLabel(size_t bucket);
+
+    // Сводка для меню и пакетного режима
+    void writeDashboard(ReportWriter& out) const;
+
+private:
+    static size_t lengthBucket(double length);
+    static size_t efficiencyBucket(double efficiency);
+};
+
+#endif // AGGREGATES_H
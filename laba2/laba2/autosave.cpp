@@ -0,0 +1,102 @@
+﻿#include "autosave.h"
+#include "utils.h"
+#include <chrono>
+
+using namespace std;
+
+AutosaveService::AutosaveService(Storage& st)
+    : storage(st), intervalSeconds(0), running(false), stopRequested(false),
+    savedVersion(0), saveCount(0) {
+}
+
+AutosaveService::~AutosaveService() {
+    stop();
+}
+
+bool AutosaveService::start(const string& file, int seconds) {
+    if (file.empty() || seconds <= 0) return false;
+    stop();
+
+    lock_guard<mutex> lock(mtx);
+    // Уже сохранённое в этот файл состояние повторно не пишется (savedVersion остаётся
+    // от прошлого запуска); в новый файл текущее состояние пишется при первом срабатывании
+    if (file != filename) savedVersion = 0;
+    filename = file;
+    intervalSeconds = seconds;
+    stopRequested = false;
+    running = true;
+    lastError.clear();
+    worker = thread(&AutosaveService::run, this);
+    LOG.log("Autosave started: \"" + file + "\" every " + to_string(seconds) + " s");
+    return true;
+}
+
+void AutosaveService::stop() {
+    {
+        lock_guard<mutex> lock(mtx);
+        if (!running) return;
+        stopRequested = true;
+    }
+    cv.notify_all();
+    worker.join();
+
+    lock_guard<mutex> lock(mtx);
+    running = false;
+    LOG.log("Autosave stopped.");
+}
+
+bool AutosaveService::isRunning() {
+    lock_guard<mutex> lock(mtx);
+    return running;
+}
+
+string AutosaveService::status() {
+    lock_guard<mutex> lock(mtx);
+    if (!running) return "выключено";
+    string s = "файл " + filename + ", каждые " + to_string(intervalSeconds) + " с, сохранений: " + to_string(saveCount);
+    if (!lastSaveTime.empty()) s += ", последнее: " + lastSaveTime;
+    if (!lastError.empty()) s += ", ошибка: " + lastError;
+    return s;
+}
+
+void AutosaveService::run() {
+    unique_lock<mutex> lock(mtx);
+    while (!stopRequested) {
+        cv.wait_for(lock, chrono::seconds(intervalSeconds), [this] { return stopRequested; });
+        if (stopRequested) break;
+
+        lock.unlock();
+        saveIfChanged();
+        lock.lock();
+    }
+}
+
+bool AutosaveService::saveIfChanged() {
+    // Снимок берётся мгновенно; сериализация идёт здесь, не мешая изменениям
+    StorageSnapshot snap = storage.snapshot();
+    string file;
+    {
+        lock_guard<mutex> lock(mtx);
+        if (snap.version == savedVersion) return true;
+        file = filename;
+    }
+
+    bool ok = writeFileAtomically(file, [&](ostream& os) {
+        snap.saveToStream(os);
+        return (bool)os;
+    });
+
+    lock_guard<mutex> lock(mtx);
+    if (ok) {
+        savedVersion = snap.version;
+        ++saveCount;
+        lastSaveTime = currentTimestamp();
+        lastError.clear();
+    }
+    else {
+        lastError = "не удалось записать " + file;
+    }
+    LOG.log(ok ? "Autosaved version " + to_string(snap.version) + " to \"" + file + "\""
+        : "Autosave failed: \"" + file + "\"");
+    return ok;
+}
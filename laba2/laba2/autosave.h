@@ -0,0 +1,47 @@
+#pragma once
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include "storage.h"
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Фоновое автосохранение: раз в interval секунд берёт снимок Storage и пишет
+// его в отдельном потоке. Если с прошлого сохранения ничего не менялось,
+// запись пропускается.
+class AutosaveService {
+    Storage& storage;
+    std::string filename;
+    int intervalSeconds;
+
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool running;
+    bool stopRequested;
+
+    unsigned long long savedVersion;
+    size_t saveCount;
+    std::string lastSaveTime;
+    std::string lastError;
+
+public:
+    explicit AutosaveService(Storage& st);
+    ~AutosaveService();
+    AutosaveService(const AutosaveService&) = delete;
+    AutosaveService& operator=(const AutosaveService&) = delete;
+
+    bool start(const std::string& file, int seconds);
+    void stop();
+    bool isRunning();
+    // Текущее состояние одной строкой для меню
+    std::string status();
+
+private:
+    void run();
+    bool saveIfChanged();
+};
+
+#endif // AUTOSAVE_H
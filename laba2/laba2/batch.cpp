@@ -0,0 +1,794 @@
+﻿#include "batch.h"
+#include "utils.h"
+#include "csv.h"
+#include "report.h"
+#include <fstream>
+
+using namespace std;
+
+static const size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+CommandProcessor::CommandProcessor(Storage& st, ostream& output)
+    : storage(st), os(output), lineNo(0), executed(0), errors(0) {
+    out.reserve(OUTPUT_BUFFER_SIZE * 2);
+}
+
+CommandProcessor::~CommandProcessor() {
+    flush();
+}
+
+void CommandProcessor::printHelp(ostream& os) {
+    os << "Команды пакетного режима:\n"
+        << "  add-pipe <имя> <длина_км> <диаметр_мм> <в_ремонте 0|1>\n"
+        << "  add-cs <имя> <цехов_всего> <цехов_работает> <класс>\n"
+        << "  remove-pipe <id> | remove-cs <id>\n"
+        << "  connect <id_КС_входа> <id_КС_выхода> <диаметр_мм>\n"
+        << "  disconnect <id_соединения>\n"
+        << "  plan-connections <файл> [create] [dry-run]   строки файла: <id_КС_входа> <id_КС_выхода> <диаметр_мм> [длина_км]\n"
+        << "  search-pipes [name=<подстрока>] [repair=0|1] [length=<min>..<max>] [diameter=<мм>]\n"
+        << "  search-cs [name=<подстрока>] [idle=<мин_процент>] [class=<класс>]\n"
+        << "  filter-pipes <выражение>   например: diameter in (700,1000) and length > 12.5 and not inRepair\n"
+        << "  filter-cs <выражение>      например: idle >= 30 and class = \"A\"\n"
+        << "  update-pipes [name=<подстрока>] [repair=0|1] set <repair=|diameter=|length=>...\n"
+        << "  update-pipes where <выражение> set <repair=|diameter=|length=>...\n"
+        << "  update-cs [name=<подстрока>] [idle=<мин_процент>] set <total=|working=|class=>...\n"
+        << "  update-cs where <выражение> set <total=|working=|class=>...\n"
+        << "  list [pipes|cs|connections]\n"
+        << "  topo | components\n"
+        << "  reach <id_КС_откуда> <id_КС_куда> [...] | reach info | reach rebuild\n"
+        << "  flow [cs <id>... | connection <id>... | overloaded] [pressure=<МПа>] [workshop=<млн_м3/сут>]\n"
+        << "  top-cs idle|efficiency [k] [asc]\n"
+        << "  stats | stats pipes [diameter=<мм>] [repair=0|1] | stats cs [class=<класс>]\n"
+        << "  save <файл> [sharded [число_частей] | indexed | segmented] | load <файл>\n"
+        << "  register build | register load <файл> | register info | register pipe|cs <id>\n"
+        << "  lazy open <файл> | lazy info | lazy pipe|cs|connection <id>\n"
+        << "  ids [reuse|stable]   выдача ID: повторно после удаления или только новые\n"
+        << "  import-csv pipes|cs|connections <файл>\n"
+        << "  export-csv pipes|cs|connections <файл>\n"
+        << "Имена с пробелами заключаются в двойные кавычки.\n";
+}
+
+void CommandProcessor::write(const string& text) {
+    out += text;
+    if (out.size() >= OUTPUT_BUFFER_SIZE) flush();
+}
+
+void CommandProcessor::flush() {
+    if (out.empty()) return;
+    os.write(out.data(), (streamsize)out.size());
+    os.flush();
+    out.clear();
+}
+
+bool CommandProcessor::fail(const string& message) {
+    ++errors;
+    write("строка " + to_string(lineNo) + ": ошибка: " + message + "\n");
+    return false;
+}
+
+// Текст команды после её имени, без разбиения на слова (для выражений фильтра)
+string CommandProcessor::rawArguments() const {
+    size_t start = current.find_first_not_of(" \t");
+    size_t end = current.find_first_of(" \t", start);
+    return end == string::npos ? string() : trim(current.substr(end));
+}
+
+// Делит "where <выражение> set <присваивания>" на части
+static bool splitWhereSet(const string& raw, string& expression, vector<string>& assignments) {
+    if (raw.compare(0, 5, "where") != 0) return false;
+    size_t setPos = raw.rfind(" set ");
+    if (setPos == string::npos) return false;
+    expression = trim(raw.substr(5, setPos - 5));
+    istringstream iss(raw.substr(setPos + 5));
+    string token;
+    while (iss >> token) assignments.push_back(token);
+    return true;
+}
+
+vector<string> CommandProcessor::tokenize(const string& line) {
+    vector<string> tokens;
+    string cur;
+    bool inQuotes = false, hasToken = false;
+    for (char c : line) {
+        if (c == '"') {
+            inQuotes = !inQuotes;
+            hasToken = true;
+        }
+        else if (!inQuotes && (c == ' ' || c == '\t' || c == '\r')) {
+            if (hasToken) tokens.push_back(cur);
+            cur.clear();
+            hasToken = false;
+        }
+        else {
+            cur += c;
+            hasToken = true;
+        }
+    }
+    if (hasToken) tokens.push_back(cur);
+    return tokens;
+}
+
+bool CommandProcessor::runStream(istream& is) {
+    string line;
+    size_t errorsBefore = errors;
+    while (getline(is, line)) {
+        execute(line);
+    }
+    flush();
+    LOG.log("Batch mode: executed " + to_string(executed) + " commands, errors: " +
+        to_string(errors - errorsBefore));
+    return errors == errorsBefore;
+}
+
+bool CommandProcessor::runFile(const string& filename) {
+    ifstream f(filename);
+    if (!f) {
+        ++errors;
+        write("Не удалось открыть файл команд " + filename + "\n");
+        flush();
+        return false;
+    }
+    return runStream(f);
+}
+
+bool CommandProcessor::execute(const string& line) {
+    ++lineNo;
+    size_t start = line.find_first_not_of(" \t\r");
+    if (start == string::npos || line[start] == '#') return true;
+
+    current = line;
+    vector<string> args = tokenize(line);
+    if (args.empty()) return true;
+    const string& cmd = args[0];
+    ++executed;
+
+    try {
+        if (cmd == "add-pipe") return cmdAddPipe(args);
+        if (cmd == "add-cs") return cmdAddCS(args);
+        if (cmd == "remove-pipe") return cmdRemovePipe(args);
+        if (cmd == "remove-cs") return cmdRemoveCS(args);
+        if (cmd == "connect") return cmdConnect(args);
+        if (cmd == "disconnect") return cmdDisconnect(args);
+        if (cmd == "plan-connections") return cmdPlanConnections(args);
+        if (cmd == "search-pipes") return cmdSearchPipes(args);
+        if (cmd == "search-cs") return cmdSearchCS(args);
+        if (cmd == "filter-pipes") return cmdFilterPipes(args);
+        if (cmd == "filter-cs") return cmdFilterCS(args);
+        if (cmd == "update-pipes") return cmdUpdatePipes(args);
+        if (cmd == "update-cs") return cmdUpdateCS(args);
+        if (cmd == "list") return cmdList(args);
+        if (cmd == "topo") return cmdTopo(args);
+        if (cmd == "components") return cmdComponents(args);
+        if (cmd == "reach") return cmdReach(args);
+        if (cmd == "flow") return cmdFlow(args);
+        if (cmd == "stats") return cmdStats(args);
+        if (cmd == "top-cs") return cmdTopCS(args);
+        if (cmd == "save") return cmdSave(args);
+        if (cmd == "load") return cmdLoad(args);
+        if (cmd == "register") return cmdRegister(args);
+        if (cmd == "lazy") return cmdLazy(args);
+        if (cmd == "ids") return cmdIds(args);
+        if (cmd == "import-csv") return cmdImportCsv(args);
+        if (cmd == "export-csv") return cmdExportCsv(args);
+        if (cmd == "help") {
+            ostringstream oss;
+            printHelp(oss);
+            write(oss.str());
+            return true;
+        }
+    }
+    catch (const exception& e) {
+        return fail(e.what());
+    }
+    return fail("неизвестная команда '" + cmd + "'");
+}
+
+bool CommandProcessor::cmdAddPipe(const vector<string>& args) {
+    if (args.size() != 5) return fail("формат: add-pipe <имя> <длина_км> <диаметр_мм> <в_ремонте 0|1>");
+    double length; int diameter, repair;
+    if (!parseDouble(args[2], length) || length <= 0) return fail("неверная длина '" + args[2] + "'");
+    if (!parseInt(args[3], diameter) || diameter <= 0) return fail("неверный диаметр '" + args[3] + "'");
+    if (!parseInt(args[4], repair) || (repair != 0 && repair != 1)) return fail("признак ремонта должен быть 0 или 1");
+
+    int id = storage.emplacePipe(args[1], length, diameter, repair == 1);
+    if (id == 0) return fail("свободные ID труб закончились");
+    write("pipe " + to_string(id) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdAddCS(const vector<string>& args) {
+    if (args.size() != 5) return fail("формат: add-cs <имя> <цехов_всего> <цехов_работает> <класс>");
+    int total, working;
+    if (!parseInt(args[2], total) || total <= 0) return fail("неверное число цехов '" + args[2] + "'");
+    if (!parseInt(args[3], working) || working < 0 || working > total)
+        return fail("число работающих цехов должно быть от 0 до " + to_string(total));
+
+    int id = storage.emplaceCS(args[1], total, working, args[4]);
+    if (id == 0) return fail("свободные ID КС закончились");
+    write("cs " + to_string(id) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdRemovePipe(const vector<string>& args) {
+    int id;
+    if (args.size() != 2 || !parseInt(args[1], id)) return fail("формат: remove-pipe <id>");
+    if (!storage.removePipeById(id)) return fail("труба с ID=" + to_string(id) + " не найдена");
+    write("removed pipe " + to_string(id) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdRemoveCS(const vector<string>& args) {
+    int id;
+    if (args.size() != 2 || !parseInt(args[1], id)) return fail("формат: remove-cs <id>");
+    if (!storage.removeCSById(id)) return fail("КС с ID=" + to_string(id) + " не найдена");
+    write("removed cs " + to_string(id) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdConnect(const vector<string>& args) {
+    int csIn, csOut, diameter;
+    if (args.size() != 4 || !parseInt(args[1], csIn) || !parseInt(args[2], csOut) || !parseInt(args[3], diameter))
+        return fail("формат: connect <id_КС_входа> <id_КС_выхода> <диаметр_мм>");
+
+    string error;
+    int connId = storage.connectStations(csIn, csOut, diameter, error);
+    if (connId == 0) return fail(error);
+    write("connection " + to_string(connId) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdDisconnect(const vector<string>& args) {
+    int id;
+    if (args.size() != 2 || !parseInt(args[1], id)) return fail("формат: disconnect <id_соединения>");
+    if (!storage.deleteConnection(id)) return fail("соединение с ID=" + to_string(id) + " не найдено");
+    write("removed connection " + to_string(id) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdPlanConnections(const vector<string>& args) {
+    const char* usage = "формат: plan-connections <файл> [create] [dry-run]";
+    if (args.size() < 2 || args.size() > 4) return fail(usage);
+    bool create = false, dryRun = false;
+    for (size_t i = 2; i < args.size(); ++i) {
+        if (args[i] == "create") create = true;
+        else if (args[i] == "dry-run") dryRun = true;
+        else return fail(usage);
+    }
+    ifstream f(args[1]);
+    if (!f) return fail("не удалось открыть файл " + args[1]);
+    vector<ConnectionRequest> requests;
+    vector<string> errors;
+    if (!parseConnectionRequests(f, requests, errors)) return fail(args[1] + ", " + errors.front());
+
+    ConnectionPlan plan = storage.planConnections(requests, create);
+    if (!plan.ok()) {
+        string more = plan.errors.size() > 1 ? " (и ещё ошибок: " + to_string(plan.errors.size() - 1) + ")" : "";
+        return fail(plan.errors.front() + more);
+    }
+    string error;
+    if (!dryRun && !storage.commitConnectionPlan(requests, plan, error)) return fail(error);
+
+    ostringstream oss;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const PlannedConnection& item = plan.items[i];
+        oss << "PLAN " << requests[i].csInId << "->" << requests[i].csOutId << " d" << requests[i].diameter
+            << " pipe " << (item.pipeId != 0 ? to_string(item.pipeId) : "-") << " length " << item.pipeLength;
+        if (item.newPipe) oss << " new";
+        if (item.connectionId != 0) oss << " connection " << item.connectionId;
+        oss << "\n";
+    }
+    oss << (dryRun ? "planned " : "committed ") << requests.size() << " new-pipes " << plan.newPipes << "\n";
+    write(oss.str());
+    return true;
+}
+
+bool CommandProcessor::cmdSearchPipes(const vector<string>& args) {
+    string name;
+    int repair = -1;
+    int diameter = 0;
+    double minLength = 0.0, maxLength = 0.0;
+    bool byLength = false;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const string& a = args[i];
+        if (a.compare(0, 5, "name=") == 0) name = a.substr(5);
+        else if (a.compare(0, 7, "repair=") == 0) {
+            if (!parseInt(a.substr(7), repair) || (repair != 0 && repair != 1))
+                return fail("repair должен быть 0 или 1");
+        }
+        else if (a.compare(0, 7, "length=") == 0) {
+            if (!parseRange(a.substr(7), minLength, maxLength)) return fail("формат: length=<min>..<max>");
+            byLength = true;
+        }
+        else if (a.compare(0, 9, "diameter=") == 0) {
+            if (!parseInt(a.substr(9), diameter) || diameter <= 0) return fail("неверный диаметр '" + a.substr(9) + "'");
+        }
+        else return fail("неизвестный параметр '" + a + "'");
+    }
+
+    map<int, Pipe*> found = byLength ? storage.searchPipesByLength(minLength, maxLength, diameter, repair, name)
+        : storage.searchPipes(name, repair, diameter);
+    for (const auto& pair : found) {
+        write("PIPE " + pair.second->toSingleLine() + "\n");
+    }
+    write("found " + to_string(found.size()) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdSearchCS(const vector<string>& args) {
+    string name;
+    string stationClass;
+    double idle = -1.0;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const string& a = args[i];
+        if (a.compare(0, 5, "name=") == 0) name = a.substr(5);
+        else if (a.compare(0, 5, "idle=") == 0) {
+            if (!parseDouble(a.substr(5), idle) || idle < 0) return fail("неверный процент '" + a.substr(5) + "'");
+        }
+        else if (a.compare(0, 6, "class=") == 0) stationClass = a.substr(6);
+        else return fail("неизвестный параметр '" + a + "'");
+    }
+
+    map<int, CS*> found = storage.searchCS(name, idle, stationClass);
+    for (const auto& pair : found) {
+        write("CS " + pair.second->toSingleLine() + "\n");
+    }
+    write("found " + to_string(found.size()) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdTopCS(const vector<string>& args) {
+    const char* usage = "формат: top-cs idle|efficiency [k] [asc]";
+    if (args.size() < 2 || args.size() > 4 || (args[1] != "idle" && args[1] != "efficiency")) return fail(usage);
+    int k = 10;
+    bool highest = true;
+    for (size_t i = 2; i < args.size(); ++i) {
+        if (args[i] == "asc") highest = false;
+        else if (!parseInt(args[i], k) || k <= 0) return fail(usage);
+    }
+
+    vector<CS*> found = args[1] == "idle" ? storage.topCSByIdle(k, highest) : storage.topCSByEfficiency(k, highest);
+    for (CS* cs : found) {
+        write("CS " + cs->toSingleLine() + "\n");
+    }
+    write("found " + to_string(found.size()) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdFilterPipes(const vector<string>&) {
+    CompiledFilter<Pipe> filter;
+    string error;
+    if (!filter.compile(rawArguments(), error)) return fail(error);
+
+    map<int, Pipe*> found = storage.filterPipes(filter);
+    for (const auto& pair : found) write("PIPE " + pair.second->toSingleLine() + "\n");
+    write("found " + to_string(found.size()) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdFilterCS(const vector<string>&) {
+    CompiledFilter<CS> filter;
+    string error;
+    if (!filter.compile(rawArguments(), error)) return fail(error);
+
+    map<int, CS*> found = storage.filterCS(filter);
+    for (const auto& pair : found) write("CS " + pair.second->toSingleLine() + "\n");
+    write("found " + to_string(found.size()) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdUpdatePipes(const vector<string>& args) {
+    if (args.size() > 1 && args[1] == "where") {
+        string expression, error;
+        vector<string> tokens;
+        CompiledFilter<Pipe> filter;
+        PipeAssignment assignment;
+        if (!splitWhereSet(rawArguments(), expression, tokens)) return fail("формат: update-pipes where <выражение> set <поле=значение>...");
+        if (!filter.compile(expression, error)) return fail(error);
+        for (const string& t : tokens) {
+            if (!assignment.parse(t, error)) return fail(error);
+        }
+        if (assignment.empty()) return fail("не задано ни одного поля");
+        BulkUpdateResult result = storage.updatePipes(filter, assignment);
+        write("updated " + to_string(result.updated) + " of " + to_string(result.matched) + "\n");
+        return true;
+    }
+
+    string name;
+    int repair = -1;
+    size_t i = 1;
+    for (; i < args.size() && args[i] != "set"; ++i) {
+        const string& a = args[i];
+        if (a.compare(0, 5, "name=") == 0) name = a.substr(5);
+        else if (a.compare(0, 7, "repair=") == 0) {
+            if (!parseInt(a.substr(7), repair) || (repair != 0 && repair != 1))
+                return fail("repair должен быть 0 или 1");
+        }
+        else return fail("неизвестный параметр фильтра '" + a + "'");
+    }
+
+    PipeAssignment assignment;
+    string error;
+    for (++i; i < args.size(); ++i) {
+        if (!assignment.parse(args[i], error)) return fail(error);
+    }
+    if (assignment.empty()) return fail("формат: update-pipes [фильтр] set <поле=значение>...");
+
+    BulkUpdateResult result = storage.updatePipes(Storage::pipeFilter(name, repair), assignment);
+    write("updated " + to_string(result.updated) + " of " + to_string(result.matched) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdUpdateCS(const vector<string>& args) {
+    if (args.size() > 1 && args[1] == "where") {
+        string expression, error;
+        vector<string> tokens;
+        CompiledFilter<CS> filter;
+        CSAssignment assignment;
+        if (!splitWhereSet(rawArguments(), expression, tokens)) return fail("формат: update-cs where <выражение> set <поле=значение>...");
+        if (!filter.compile(expression, error)) return fail(error);
+        for (const string& t : tokens) {
+            if (!assignment.parse(t, error)) return fail(error);
+        }
+        if (assignment.empty()) return fail("не задано ни одного поля");
+        BulkUpdateResult result = storage.updateCS(filter, assignment);
+        write("updated " + to_string(result.updated) + " of " + to_string(result.matched) + "\n");
+        return true;
+    }
+
+    string name;
+    double idle = -1.0;
+    size_t i = 1;
+    for (; i < args.size() && args[i] != "set"; ++i) {
+        const string& a = args[i];
+        if (a.compare(0, 5, "name=") == 0) name = a.substr(5);
+        else if (a.compare(0, 5, "idle=") == 0) {
+            if (!parseDouble(a.substr(5), idle) || idle < 0) return fail("неверный процент '" + a.substr(5) + "'");
+        }
+        else return fail("неизвестный параметр фильтра '" + a + "'");
+    }
+
+    CSAssignment assignment;
+    string error;
+    for (++i; i < args.size(); ++i) {
+        if (!assignment.parse(args[i], error)) return fail(error);
+    }
+    if (assignment.empty()) return fail("формат: update-cs [фильтр] set <поле=значение>...");
+
+    BulkUpdateResult result = storage.updateCS(Storage::csFilter(name, idle), assignment);
+    write("updated " + to_string(result.updated) + " of " + to_string(result.matched) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdList(const vector<string>& args) {
+    string what = args.size() > 1 ? args[1] : "all";
+    if (what != "all" && what != "pipes" && what != "cs" && what != "connections")
+        return fail("формат: list [pipes|cs|connections]");
+
+    if (what == "all" || what == "pipes") {
+        for (const auto& pair : storage.getAllPipesMap()) write("PIPE " + pair.second->toSingleLine() + "\n");
+    }
+    if (what == "all" || what == "cs") {
+        for (const auto& pair : storage.getAllCSMap()) write("CS " + pair.second->toSingleLine() + "\n");
+    }
+    if (what == "all" || what == "connections") {
+        for (const auto& pair : storage.getNetwork().getAllConnections()) write("CONN " + pair.second.toSingleLine() + "\n");
+    }
+    return true;
+}
+
+bool CommandProcessor::cmdTopo(const vector<string>& args) {
+    if (args.size() != 1) return fail("формат: topo");
+    bool cycles = false;
+    vector<int> order = storage.getNetwork().topologicalSort(storage, cycles);
+    string line = "order";
+    for (int id : order) line += " " + to_string(id);
+    write(line + "\n");
+    if (cycles) write("cycles detected\n");
+    return true;
+}
+
+bool CommandProcessor::cmdComponents(const vector<string>& args) {
+    if (args.size() != 1) return fail("формат: components");
+    vector<vector<const Connection*>> parts = storage.getNetwork().connectionsByComponent();
+    size_t largest = 0;
+    for (const auto& part : parts) largest = max(largest, part.size());
+    write("components " + to_string(parts.size()) + " largest " + to_string(largest) + " connections\n");
+    return true;
+}
+
+bool CommandProcessor::cmdReach(const vector<string>& args) {
+    const char* usage = "формат: reach <id_КС_откуда> <id_КС_куда> [...] | reach info | reach rebuild";
+    if (args.size() == 2 && args[1] == "rebuild") {
+        // Перестройка идёт в фоне; следующие запросы дождутся её окончания
+        storage.refreshReachability();
+        write("reach rebuilding\n");
+        return true;
+    }
+    if (args.size() == 2 && args[1] == "info") {
+        shared_ptr<const ReachabilityIndex> index = storage.reachability(true);
+        write("reach components " + to_string(index->componentCount()) + " scc " +
+            to_string(index->stronglyConnectedCount()) + " bytes " + to_string(index->memoryBytes()) + "\n");
+        return true;
+    }
+    if (args.size() < 3 || args.size() % 2 == 0) return fail(usage);
+    vector<pair<int, int>> queries;
+    for (size_t i = 1; i < args.size(); i += 2) {
+        int from, to;
+        if (!parseInt(args[i], from) || !parseInt(args[i + 1], to)) return fail(usage);
+        if (!storage.findCSById(from)) return fail("КС с ID=" + to_string(from) + " не найдена");
+        if (!storage.findCSById(to)) return fail("КС с ID=" + to_string(to) + " не найдена");
+        queries.emplace_back(from, to);
+    }
+    string out;
+    for (const auto& q : queries) {
+        out += "reach " + to_string(q.first) + " " + to_string(q.second) +
+            (storage.canReach(q.first, q.second) ? " yes\n" : " no\n");
+    }
+    write(out);
+    return true;
+}
+
+static string describeStationFlow(const StationFlow& s) {
+    ostringstream oss;
+    oss << "flow cs " << s.csId << " " << flowRoleName(s.role) << " pressure " << s.pressure
+        << " throughput " << s.throughput << " capacity " << s.capacity << (s.overloaded() ? " overloaded" : "") << "\n";
+    return oss.str();
+}
+
+bool CommandProcessor::cmdFlow(const vector<string>& args) {
+    const char* usage = "формат: flow [cs <id>... | connection <id>... | overloaded] [pressure=<МПа>] [workshop=<млн_м3/сут>]";
+    FlowOptions options;
+    vector<string> words;
+    for (size_t i = 1; i < args.size(); ++i) {
+        size_t eq = args[i].find('=');
+        if (eq == string::npos) {
+            words.push_back(args[i]);
+            continue;
+        }
+        string key = args[i].substr(0, eq);
+        double value;
+        if (!parseDouble(args[i].substr(eq + 1), value) || value <= 0) return fail(usage);
+        if (key == "pressure") options.deliveryPressure = value;
+        else if (key == "workshop") options.workshopCapacity = value;
+        else return fail(usage);
+    }
+    string mode = words.empty() ? "" : words[0];
+    vector<int> ids;
+    for (size_t i = 1; i < words.size(); ++i) {
+        int id;
+        if ((mode != "cs" && mode != "connection") || !parseInt(words[i], id)) return fail(usage);
+        ids.push_back(id);
+    }
+    bool valid = mode.empty() || (mode == "overloaded" && words.size() == 1) ||
+        ((mode == "cs" || mode == "connection") && !ids.empty());
+    if (!valid) return fail(usage);
+
+    shared_ptr<const FlowResult> result = storage.flowState(options);
+    ostringstream oss;
+    if (mode.empty()) {
+        oss << "flow " << (result->converged ? "converged" : "diverged") << " iterations " << result->iterations
+            << " residual " << result->residual << " components " << result->components
+            << " stations " << result->stations.size() << " connections " << result->connections.size()
+            << " supplied " << result->supplied << " delivered " << result->delivered
+            << " overloaded " << result->overloadedCount() << "\n";
+    }
+    else if (mode == "overloaded") {
+        for (const StationFlow& s : result->stations) {
+            if (s.overloaded()) oss << describeStationFlow(s);
+        }
+    }
+    else if (mode == "cs") {
+        for (int id : ids) {
+            const StationFlow* s = result->findStation(id);
+            if (s) oss << describeStationFlow(*s);
+            else oss << "flow cs " << id << " none\n";
+        }
+    }
+    else {
+        for (int id : ids) {
+            const ConnectionFlow* f = result->findConnection(id);
+            if (f) oss << "flow connection " << id << " " << f->flow << "\n";
+            else oss << "flow connection " << id << " none\n";
+        }
+    }
+    write(oss.str());
+    return true;
+}
+
+bool CommandProcessor::cmdStats(const vector<string>& args) {
+    NetworkStats stats = storage.statistics();
+    if (args.size() == 1) {
+        ostringstream oss;
+        {
+            ReportWriter out(oss);
+            stats.writeDashboard(out);
+        }
+        write(oss.str());
+        return true;
+    }
+
+    ostringstream oss;
+    if (args[1] == "pipes") {
+        int diameter = 0, repair = -1;
+        for (size_t i = 2; i < args.size(); ++i) {
+            size_t eq = args[i].find('=');
+            string key = args[i].substr(0, eq);
+            string value = eq == string::npos ? "" : args[i].substr(eq + 1);
+            if (key == "diameter" && parseInt(value, diameter) && diameter > 0) continue;
+            if (key == "repair" && parseInt(value, repair) && (repair == 0 || repair == 1)) continue;
+            return fail("формат: stats pipes [diameter=<мм>] [repair=0|1]");
+        }
+        PipeTotals t = stats.pipeTotals(diameter, repair);
+        oss << "pipes " << t.count << " length " << t.length << "\n";
+    }
+    else if (args[1] == "cs") {
+        StationTotals t;
+        if (args.size() == 2) t = stats.stationTotals();
+        else if (args.size() == 3 && args[2].compare(0, 6, "class=") == 0) t = stats.stationTotals(args[2].substr(6));
+        else return fail("формат: stats cs [class=<класс>]");
+        oss << "cs " << t.count << " workshops " << t.workshopsWorking << "/" << t.workshopsTotal
+            << " efficiency " << t.averageEfficiency() << "\n";
+    }
+    else {
+        return fail("формат: stats | stats pipes [...] | stats cs [...]");
+    }
+    write(oss.str());
+    return true;
+}
+
+bool CommandProcessor::cmdSave(const vector<string>& args) {
+    const char* usage = "формат: save <файл> [sharded [число_частей] | indexed | segmented]";
+    if (args.size() < 2 || args.size() > 4) return fail(usage);
+    bool saved;
+    if (args.size() == 2) {
+        saved = storage.saveToFile(args[1]);
+    }
+    else if (args[2] == "indexed" && args.size() == 3) {
+        saved = storage.saveIndexed(args[1]);
+    }
+    else if (args[2] == "segmented" && args.size() == 3) {
+        SegmentSaveResult result = storage.saveSegmented(args[1]);
+        if (!result.ok) return fail("ошибка записи в файл " + args[1]);
+        ostringstream oss;
+        oss << "saved " << args[1] << " segments " << result.segments << " bytes " << result.bytes
+            << (result.full ? " full" : " incremental") << "\n";
+        write(oss.str());
+        return true;
+    }
+    else if (args[2] == "sharded") {
+        int parts = 0;
+        if (args.size() == 4 && (!parseInt(args[3], parts) || parts <= 0)) return fail(usage);
+        saved = storage.saveSharded(args[1], (size_t)parts);
+    }
+    else {
+        return fail(usage);
+    }
+    if (!saved) return fail("ошибка записи в файл " + args[1]);
+    write("saved " + args[1] + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdIds(const vector<string>& args) {
+    if (args.size() > 2) return fail("формат: ids [reuse|stable]");
+    if (args.size() == 2) {
+        if (args[1] == "reuse") storage.setIdPolicy(IdPolicy::Reuse);
+        else if (args[1] == "stable") storage.setIdPolicy(IdPolicy::Stable);
+        else return fail("формат: ids [reuse|stable]");
+    }
+    ostringstream oss;
+    oss << "ids " << idPolicyName(storage.getIdPolicy()) << "\n";
+    auto line = [&oss](const char* table, const IdAllocator& ids) {
+        oss << "  " << table << " next " << ids.peekNext() << " free " << ids.freeIds() << "\n";
+    };
+    line("pipes", storage.pipeIds());
+    line("cs", storage.csIds());
+    line("connections", storage.connectionIds());
+    write(oss.str());
+    return true;
+}
+
+bool CommandProcessor::cmdLoad(const vector<string>& args) {
+    if (args.size() != 2) return fail("формат: load <файл>");
+    if (!storage.loadFromFile(args[1])) return fail("ошибка чтения файла " + args[1]);
+    write("loaded " + args[1] + "\n");
+    return true;
+}
+
+// Индексированный снимок (lazysnapshot.h), открытый без загрузки
+bool CommandProcessor::cmdLazy(const vector<string>& args) {
+    const char* usage = "формат: lazy open <файл> | lazy info | lazy pipe|cs|connection <id>";
+    if (args.size() < 2) return fail(usage);
+    const string& sub = args[1];
+    if (sub == "open" && args.size() == 3) {
+        string error;
+        if (!lazySnapshot.open(args[2], error)) return fail(error);
+    }
+    else if (sub == "info" && args.size() == 2) {
+        if (!lazySnapshot.isOpen()) return fail("снимок не открыт");
+    }
+    else if ((sub == "pipe" || sub == "cs" || sub == "connection") && args.size() == 3) {
+        int id;
+        if (!parseInt(args[2], id)) return fail(usage);
+        if (!lazySnapshot.isOpen()) return fail("снимок не открыт");
+        string line;
+        if (sub == "pipe") {
+            if (auto p = lazySnapshot.findPipeById(id)) line = "PIPE " + p->toSingleLine();
+        }
+        else if (sub == "cs") {
+            if (auto cs = lazySnapshot.findCSById(id)) line = "CS " + cs->toSingleLine();
+        }
+        else if (auto c = lazySnapshot.findConnectionById(id)) {
+            line = "CONN " + c->toSingleLine();
+        }
+        if (line.empty()) return fail("запись с ID=" + to_string(id) + " не найдена в снимке");
+        write(line + "\n");
+        return true;
+    }
+    else {
+        return fail(usage);
+    }
+    write("lazy pipes " + to_string(lazySnapshot.pipeCount()) + " cs " + to_string(lazySnapshot.csCount()) +
+        " connections " + to_string(lazySnapshot.connectionCount()) + " version " + to_string(lazySnapshot.version()) +
+        " decoded " + to_string(lazySnapshot.decodedCount()) + " cached " + to_string(lazySnapshot.cachedCount()) + "\n");
+    return true;
+}
+
+// Компактный реестр (compact.h): отдельная копия только для чтения
+bool CommandProcessor::cmdRegister(const vector<string>& args) {
+    const char* usage = "формат: register build | register load <файл> | register info | register pipe|cs <id>";
+    if (args.size() < 2) return fail(usage);
+    const string& sub = args[1];
+    if (sub == "build" && args.size() == 2) {
+        compactRegister.build(storage.snapshot());
+    }
+    else if (sub == "load" && args.size() == 3) {
+        string error;
+        if (!compactRegister.loadFromFile(args[2], error)) return fail(error);
+    }
+    else if (sub == "info" && args.size() == 2) {
+    }
+    else if ((sub == "pipe" || sub == "cs") && args.size() == 3) {
+        int id;
+        if (!parseInt(args[2], id)) return fail(usage);
+        if (sub == "pipe") {
+            Pipe p;
+            if (!compactRegister.findPipe(id, p)) return fail("труба с ID=" + to_string(id) + " не найдена в реестре");
+            write("PIPE " + p.toSingleLine() + "\n");
+        }
+        else {
+            CS cs;
+            if (!compactRegister.findCS(id, cs)) return fail("КС с ID=" + to_string(id) + " не найдена в реестре");
+            write("CS " + cs.toSingleLine() + "\n");
+        }
+        return true;
+    }
+    else {
+        return fail(usage);
+    }
+    write("register pipes " + to_string(compactRegister.pipeCount()) + " cs " + to_string(compactRegister.csCount()) +
+        " classes " + to_string(compactRegister.classCount()) + " bytes " + to_string(compactRegister.memoryBytes()) +
+        " expanded " + to_string(compactRegister.expandedMemoryBytes()) + "\n");
+    return true;
+}
+
+bool CommandProcessor::cmdImportCsv(const vector<string>& args) {
+    CsvKind kind;
+    if (args.size() != 3 || !CsvIO::parseKind(args[1], kind)) return fail("формат: import-csv pipes|cs|connections <файл>");
+
+    CsvImportResult result;
+    if (!CsvIO::importFile(storage, kind, args[2], result)) return fail("ошибка чтения файла " + args[2]);
+    for (const string& e : result.errors) write(args[2] + ": " + e + "\n");
+    write("imported " + to_string(result.imported) + " of " + to_string(result.rows) + "\n");
+    if (!result.errors.empty()) return fail("отклонено записей: " + to_string(result.errors.size()));
+    return true;
+}
+
+bool CommandProcessor::cmdExportCsv(const vector<string>& args) {
+    CsvKind kind;
+    if (args.size() != 3 || !CsvIO::parseKind(args[1], kind)) return fail("формат: export-csv pipes|cs|connections <файл>");
+
+    size_t written = 0;
+    if (!CsvIO::exportFile(storage, kind, args[2], written)) return fail("ошибка записи в файл " + args[2]);
+    write("exported " + to_string(written) + "\n");
+    return true;
+}
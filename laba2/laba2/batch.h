@@ -0,0 +1,75 @@
+#pragma once
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "storage.h"
+#include "compact.h"
+#include "lazysnapshot.h"
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Пакетный режим: выполнение команд из файла или потока без диалогов.
+// Одна команда на строку, пустые строки и строки с '#' пропускаются.
+class CommandProcessor {
+    Storage& storage;
+    std::ostream& os;
+    std::string out;        // буфер вывода, сбрасывается крупными блоками
+    std::string current;    // текст выполняемой команды
+    size_t lineNo;
+    size_t executed;
+    size_t errors;
+    CompactRegister compactRegister;    // команды register
+    LazySnapshot lazySnapshot;          // команды lazy
+
+public:
+    CommandProcessor(Storage& st, std::ostream& output);
+    ~CommandProcessor();
+
+    // Возвращают true, если все команды выполнены без ошибок
+    bool runStream(std::istream& is);
+    bool runFile(const std::string& filename);
+    bool execute(const std::string& line);
+
+    size_t getExecutedCount() const { return executed; }
+    size_t getErrorCount() const { return errors; }
+    void flush();
+
+    static void printHelp(std::ostream& os);
+
+private:
+    static std::vector<std::string> tokenize(const std::string& line);
+    void write(const std::string& text);
+    bool fail(const std::string& message);
+    std::string rawArguments() const;
+
+    bool cmdAddPipe(const std::vector<std::string>& args);
+    bool cmdAddCS(const std::vector<std::string>& args);
+    bool cmdRemovePipe(const std::vector<std::string>& args);
+    bool cmdRemoveCS(const std::vector<std::string>& args);
+    bool cmdConnect(const std::vector<std::string>& args);
+    bool cmdDisconnect(const std::vector<std::string>& args);
+    bool cmdPlanConnections(const std::vector<std::string>& args);
+    bool cmdSearchPipes(const std::vector<std::string>& args);
+    bool cmdSearchCS(const std::vector<std::string>& args);
+    bool cmdList(const std::vector<std::string>& args);
+    bool cmdTopo(const std::vector<std::string>& args);
+    bool cmdComponents(const std::vector<std::string>& args);
+    bool cmdReach(const std::vector<std::string>& args);
+    bool cmdFlow(const std::vector<std::string>& args);
+    bool cmdStats(const std::vector<std::string>& args);
+    bool cmdTopCS(const std::vector<std::string>& args);
+    bool cmdSave(const std::vector<std::string>& args);
+    bool cmdLoad(const std::vector<std::string>& args);
+    bool cmdRegister(const std::vector<std::string>& args);
+    bool cmdLazy(const std::vector<std::string>& args);
+    bool cmdIds(const std::vector<std::string>& args);
+    bool cmdFilterPipes(const std::vector<std::string>& args);
+    bool cmdFilterCS(const std::vector<std::string>& args);
+    bool cmdUpdatePipes(const std::vector<std::string>& args);
+    bool cmdUpdateCS(const std::vector<std::string>& args);
+    bool cmdImportCsv(const std::vector<std::string>& args);
+    bool cmdExportCsv(const std::vector<std::string>& args);
+};
+
+#endif // BATCH_H
@@ -0,0 +1,278 @@
+﻿#include "bitmap.h"
+#include <algorithm>
+#include <bitset>
+#include <iterator>
+
+using namespace std;
+
+static const size_t WORDS = 65536 / 64;
+
+static inline unsigned popcount64(uint64_t w) { return (unsigned)bitset<64>(w).count(); }
+
+unsigned RoaringBitmap::bitIndex(uint64_t singleBit) { return popcount64(singleBit - 1); }
+
+bool RoaringBitmap::Container::contains(uint16_t low) const {
+    if (isBitmap()) return (words[low >> 6] >> (low & 63)) & 1;
+    return binary_search(array.begin(), array.end(), low);
+}
+
+bool RoaringBitmap::Container::add(uint16_t low) {
+    if (isBitmap()) {
+        uint64_t bit = uint64_t(1) << (low & 63);
+        if (words[low >> 6] & bit) return false;
+        words[low >> 6] |= bit;
+        ++count;
+        return true;
+    }
+    auto it = lower_bound(array.begin(), array.end(), low);
+    if (it != array.end() && *it == low) return false;
+    array.insert(it, low);
+    ++count;
+    if (count > ROARING_ARRAY_MAX) toBitmap();
+    return true;
+}
+
+bool RoaringBitmap::Container::remove(uint16_t low) {
+    if (isBitmap()) {
+        uint64_t bit = uint64_t(1) << (low & 63);
+        if (!(words[low >> 6] & bit)) return false;
+        words[low >> 6] &= ~bit;
+        --count;
+        shrink();
+        return true;
+    }
+    auto it = lower_bound(array.begin(), array.end(), low);
+    if (it == array.end() || *it != low) return false;
+    array.erase(it);
+    --count;
+    return true;
+}
+
+void RoaringBitmap::Container::toBitmap() {
+    words.assign(WORDS, 0);
+    for (uint16_t low : array) words[low >> 6] |= uint64_t(1) << (low & 63);
+    vector<uint16_t>().swap(array);
+}
+
+void RoaringBitmap::Container::recount() {
+    if (!isBitmap()) {
+        count = (uint32_t)array.size();
+        return;
+    }
+    count = 0;
+    for (uint64_t w : words) count += popcount64(w);
+}
+
+void RoaringBitmap::Container::shrink() {
+    // Запас в половину порога, чтобы add/remove на границе не конвертировали блок каждый раз
+    if (!isBitmap() || count > ROARING_ARRAY_MAX / 2) return;
+    array.clear();
+    array.reserve(count);
+    for (size_t w = 0; w < words.size(); ++w) {
+        uint64_t bits = words[w];
+        while (bits) {
+            uint64_t lowest = bits & (~bits + 1);
+            array.push_back((uint16_t)(w * 64 + bitIndex(lowest)));
+            bits ^= lowest;
+        }
+    }
+    vector<uint64_t>().swap(words);
+}
+
+size_t RoaringBitmap::lowerBound(uint16_t key) const {
+    return (size_t)(lower_bound(containers.begin(), containers.end(), key,
+        [](const Container& c, uint16_t k) { return c.key < k; }) - containers.begin());
+}
+
+bool RoaringBitmap::add(int id) {
+    uint16_t key = (uint16_t)((uint32_t)id >> 16);
+    size_t i = lowerBound(key);
+    if (i == containers.size() || containers[i].key != key) {
+        Container c;
+        c.key = key;
+        containers.insert(containers.begin() + i, std::move(c));
+    }
+    if (!containers[i].add((uint16_t)id)) return false;
+    ++total;
+    return true;
+}
+
+bool RoaringBitmap::remove(int id) {
+    uint16_t key = (uint16_t)((uint32_t)id >> 16);
+    size_t i = lowerBound(key);
+    if (i == containers.size() || containers[i].key != key) return false;
+    if (!containers[i].remove((uint16_t)id)) return false;
+    --total;
+    if (containers[i].count == 0) containers.erase(containers.begin() + i);
+    return true;
+}
+
+bool RoaringBitmap::contains(int id) const {
+    uint16_t key = (uint16_t)((uint32_t)id >> 16);
+    size_t i = lowerBound(key);
+    return i < containers.size() && containers[i].key == key && containers[i].contains((uint16_t)id);
+}
+
+RoaringBitmap RoaringBitmap::fromSorted(const vector<int>& ids) {
+    RoaringBitmap result;
+    for (size_t i = 0; i < ids.size();) {
+        Container c;
+        c.key = (uint16_t)((uint32_t)ids[i] >> 16);
+        size_t j = i;
+        while (j < ids.size() && (uint16_t)((uint32_t)ids[j] >> 16) == c.key) ++j;
+        c.array.reserve(j - i);
+        for (size_t k = i; k < j; ++k) {
+            if (c.array.empty() || c.array.back() != (uint16_t)ids[k]) c.array.push_back((uint16_t)ids[k]);
+        }
+        c.count = (uint32_t)c.array.size();
+        if (c.count > ROARING_ARRAY_MAX) c.toBitmap();
+        result.total += c.count;
+        result.containers.push_back(std::move(c));
+        i = j;
+    }
+    return result;
+}
+
+void RoaringBitmap::andContainers(const Container& a, const Container& b, Container& out) {
+    out.key = a.key;
+    if (a.isBitmap() && b.isBitmap()) {
+        out.words.resize(WORDS);
+        for (size_t w = 0; w < WORDS; ++w) out.words[w] = a.words[w] & b.words[w];
+        out.recount();
+        out.shrink();
+        return;
+    }
+    if (!a.isBitmap() && !b.isBitmap()) {
+        set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), back_inserter(out.array));
+    }
+    else {
+        const Container& small = a.isBitmap() ? b : a;
+        const Container& large = a.isBitmap() ? a : b;
+        for (uint16_t low : small.array) {
+            if (large.contains(low)) out.array.push_back(low);
+        }
+    }
+    out.count = (uint32_t)out.array.size();
+}
+
+void RoaringBitmap::orContainers(const Container& a, const Container& b, Container& out) {
+    out.key = a.key;
+    if (!a.isBitmap() && !b.isBitmap()) {
+        set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), back_inserter(out.array));
+        out.count = (uint32_t)out.array.size();
+        if (out.count > ROARING_ARRAY_MAX) out.toBitmap();
+        return;
+    }
+    const Container& other = a.isBitmap() ? b : a;
+    out.words = a.isBitmap() ? a.words : b.words;
+    if (other.isBitmap()) {
+        for (size_t w = 0; w < WORDS; ++w) out.words[w] |= other.words[w];
+    }
+    else {
+        for (uint16_t low : other.array) out.words[low >> 6] |= uint64_t(1) << (low & 63);
+    }
+    out.recount();
+}
+
+void RoaringBitmap::andNotContainers(const Container& a, const Container& b, Container& out) {
+    out.key = a.key;
+    if (!a.isBitmap()) {
+        if (b.isBitmap()) {
+            for (uint16_t low : a.array) {
+                if (!b.contains(low)) out.array.push_back(low);
+            }
+        }
+        else {
+            set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), back_inserter(out.array));
+        }
+        out.count = (uint32_t)out.array.size();
+        return;
+    }
+    out.words = a.words;
+    if (b.isBitmap()) {
+        for (size_t w = 0; w < WORDS; ++w) out.words[w] &= ~b.words[w];
+    }
+    else {
+        for (uint16_t low : b.array) out.words[low >> 6] &= ~(uint64_t(1) << (low & 63));
+    }
+    out.recount();
+    out.shrink();
+}
+
+RoaringBitmap& RoaringBitmap::operator&=(const RoaringBitmap& other) {
+    vector<Container> result;
+    size_t i = 0, j = 0;
+    total = 0;
+    while (i < containers.size() && j < other.containers.size()) {
+        if (containers[i].key < other.containers[j].key) ++i;
+        else if (other.containers[j].key < containers[i].key) ++j;
+        else {
+            Container c;
+            andContainers(containers[i++], other.containers[j++], c);
+            if (c.count == 0) continue;
+            total += c.count;
+            result.push_back(std::move(c));
+        }
+    }
+    containers.swap(result);
+    return *this;
+}
+
+RoaringBitmap& RoaringBitmap::operator|=(const RoaringBitmap& other) {
+    vector<Container> result;
+    result.reserve(containers.size() + other.containers.size());
+    size_t i = 0, j = 0;
+    while (i < containers.size() || j < other.containers.size()) {
+        if (j == other.containers.size() || (i < containers.size() && containers[i].key < other.containers[j].key)) {
+            result.push_back(std::move(containers[i++]));
+        }
+        else if (i == containers.size() || other.containers[j].key < containers[i].key) {
+            result.push_back(other.containers[j++]);
+        }
+        else {
+            Container c;
+            orContainers(containers[i++], other.containers[j++], c);
+            result.push_back(std::move(c));
+        }
+    }
+    total = 0;
+    for (const Container& c : result) total += c.count;
+    containers.swap(result);
+    return *this;
+}
+
+RoaringBitmap& RoaringBitmap::operator-=(const RoaringBitmap& other) {
+    vector<Container> result;
+    result.reserve(containers.size());
+    size_t j = 0;
+    total = 0;
+    for (size_t i = 0; i < containers.size(); ++i) {
+        while (j < other.containers.size() && other.containers[j].key < containers[i].key) ++j;
+        if (j == other.containers.size() || other.containers[j].key != containers[i].key) {
+            total += containers[i].count;
+            result.push_back(std::move(containers[i]));
+            continue;
+        }
+        Container c;
+        andNotContainers(containers[i], other.containers[j], c);
+        if (c.count == 0) continue;
+        total += c.count;
+        result.push_back(std::move(c));
+    }
+    containers.swap(result);
+    return *this;
+}
+
+void RoaringBitmap::toVector(vector<int>& out) const {
+    out.clear();
+    out.reserve(total);
+    forEach([&out](int id) { out.push_back(id); });
+}
+
+size_t RoaringBitmap::memoryBytes() const {
+    size_t bytes = containers.capacity() * sizeof(Container);
+    for (const Container& c : containers) {
+        bytes += c.array.capacity() * sizeof(uint16_t) + c.words.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Сжатое множество ID в духе Roaring: пространство ID делится на блоки по 65536,
+// блок хранится массивом младших 16 бит (до ROARING_ARRAY_MAX элементов) или
+// битовой картой из 1024 слов. Пересечение, объединение и разность идут по
+// словам/отсортированным массивам, без обращения к самим объектам.
+const uint32_t ROARING_ARRAY_MAX = 4096;
+
+class RoaringBitmap {
+    struct Container {
+        uint16_t key = 0;               // старшие 16 бит ID
+        uint32_t count = 0;
+        std::vector<uint16_t> array;    // отсортированные младшие 16 бит
+        std::vector<uint64_t> words;    // непусто - блок хранится битовой картой
+
+        bool isBitmap() const { return !words.empty(); }
+        bool contains(uint16_t low) const;
+        bool add(uint16_t low);
+        bool remove(uint16_t low);
+        void toBitmap();
+        void recount();
+        // Мелкая битовая карта снова становится массивом
+        void shrink();
+    };
+
+    std::vector<Container> containers;  // по возрастанию key
+    size_t total = 0;
+
+    size_t lowerBound(uint16_t key) const;
+    static void andContainers(const Container& a, const Container& b, Container& out);
+    static void orContainers(const Container& a, const Container& b, Container& out);
+    static void andNotContainers(const Container& a, const Container& b, Container& out);
+
+public:
+    // ID должны быть неотрицательными
+    bool add(int id);
+    bool remove(int id);
+    bool contains(int id) const;
+    void clear() { containers.clear(); total = 0; }
+    size_t cardinality() const { return total; }
+    bool empty() const { return total == 0; }
+
+    // Из отсортированного по возрастанию списка ID
+    static RoaringBitmap fromSorted(const std::vector<int>& ids);
+
+    RoaringBitmap& operator&=(const RoaringBitmap& other);
+    RoaringBitmap& operator|=(const RoaringBitmap& other);
+    // Разность (ANDNOT)
+    RoaringBitmap& operator-=(const RoaringBitmap& other);
+
+    // fn(id) по возрастанию ID
+    template<typename F>
+    void forEach(F fn) const {
+        for (const Container& c : containers) {
+            int high = (int)c.key << 16;
+            if (!c.isBitmap()) {
+                for (uint16_t low : c.array) fn(high | low);
+                continue;
+            }
+            for (size_t w = 0; w < c.words.size(); ++w) {
+                uint64_t bits = c.words[w];
+                while (bits) {
+                    uint64_t lowest = bits & (~bits + 1);
+                    fn(high | (int)(w * 64 + bitIndex(lowest)));
+                    bits ^= lowest;
+                }
+            }
+        }
+    }
+
+    void toVector(std::vector<int>& out) const;
+    size_t memoryBytes() const;
+
+private:
+    static unsigned bitIndex(uint64_t singleBit);
+};
+
+#endif // BITMAP_H
@@ -0,0 +1,111 @@
+﻿#include "bulkedit.h"
+#include "utils.h"
+#include "network.h"
+
+using namespace std;
+
+static bool splitAssignment(const string& token, string& key, string& value) {
+    size_t eq = token.find('=');
+    if (eq == string::npos || eq == 0) return false;
+    key = trim(token.substr(0, eq));
+    value = trim(token.substr(eq + 1));
+    return true;
+}
+
+bool PipeAssignment::apply(Pipe& p) const {
+    bool changed = false;
+    if (inRepair && p.isInRepair() != *inRepair) { p.setInRepair(*inRepair); changed = true; }
+    if (diameter && p.getDiameter() != *diameter) { p.setDiameter(*diameter); changed = true; }
+    if (length && p.getLength() != *length) { p.setLength(*length); changed = true; }
+    return changed;
+}
+
+string PipeAssignment::describe() const {
+    string s;
+    if (inRepair) s += string(" repair=") + (*inRepair ? "1" : "0");
+    if (diameter) s += " diameter=" + to_string(*diameter);
+    if (length) s += " length=" + to_string(*length);
+    return s.empty() ? s : s.substr(1);
+}
+
+bool PipeAssignment::parse(const string& token, string& error) {
+    string key, value;
+    if (!splitAssignment(token, key, value)) {
+        error = "ожидалось поле=значение, получено '" + token + "'";
+        return false;
+    }
+    if (key == "repair") {
+        int v;
+        if (!parseInt(value, v) || (v != 0 && v != 1)) { error = "repair должен быть 0 или 1"; return false; }
+        inRepair = (v == 1);
+    }
+    else if (key == "diameter") {
+        int v;
+        if (!parseInt(value, v) || !GasNetwork::isValidDiameter(v)) {
+            error = "неверный диаметр '" + value + "' (допустимы 500, 700, 1000, 1400)";
+            return false;
+        }
+        diameter = v;
+    }
+    else if (key == "length") {
+        double v;
+        if (!parseDouble(value, v) || v <= 0) { error = "неверная длина '" + value + "'"; return false; }
+        length = v;
+    }
+    else {
+        error = "неизвестное поле трубы '" + key + "'";
+        return false;
+    }
+    return true;
+}
+
+bool CSAssignment::apply(CS& s) const {
+    int total = workshopsTotal ? *workshopsTotal : s.getWorkshopsTotal();
+    int working = workshopsWorking ? *workshopsWorking : s.getWorkshopsWorking();
+    if (working > total) return false;
+
+    bool changed = false;
+    if (workshopsTotal && s.getWorkshopsTotal() != total) { s.setWorkshopsTotal(total); changed = true; }
+    if (workshopsWorking && s.getWorkshopsWorking() != working) { s.setWorkshopsWorking(working); changed = true; }
+    if (stationClass && s.getStationClass() != *stationClass) { s.setStationClass(*stationClass); changed = true; }
+    return changed;
+}
+
+string CSAssignment::describe() const {
+    string s;
+    if (workshopsTotal) s += " total=" + to_string(*workshopsTotal);
+    if (workshopsWorking) s += " working=" + to_string(*workshopsWorking);
+    if (stationClass) s += " class=" + *stationClass;
+    return s.empty() ? s : s.substr(1);
+}
+
+bool CSAssignment::parse(const string& token, string& error) {
+    string key, value;
+    if (!splitAssignment(token, key, value)) {
+        error = "ожидалось поле=значение, получено '" + token + "'";
+        return false;
+    }
+    if (key == "total") {
+        int v;
+        if (!parseInt(value, v) || v <= 0) { error = "неверное число цехов '" + value + "'"; return false; }
+        workshopsTotal = v;
+    }
+    else if (key == "working") {
+        int v;
+        if (!parseInt(value, v) || v < 0) { error = "неверное число работающих цехов '" + value + "'"; return false; }
+        workshopsWorking = v;
+    }
+    else if (key == "class") {
+        if (value.empty()) { error = "пустой класс станции"; return false; }
+        stationClass = value;
+    }
+    else {
+        error = "неизвестное поле КС '" + key + "'";
+        return false;
+    }
+    if (workshopsTotal && workshopsWorking && *workshopsWorking > *workshopsTotal) {
+        error = "working не может превышать total";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef BULKEDIT_H
+#define BULKEDIT_H
+
+#include "entities.h"
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Предикаты отбора для массовых операций
+typedef std::function<bool(const Pipe&)> PipePredicate;
+typedef std::function<bool(const CS&)> CSPredicate;
+
+// Набор присваиваний полям трубы; незаданные поля не меняются
+struct PipeAssignment {
+    std::optional<bool> inRepair;
+    std::optional<int> diameter;
+    std::optional<double> length;
+
+    bool empty() const { return !inRepair && !diameter && !length; }
+    // Возвращает true, если хотя бы одно поле действительно изменилось
+    bool apply(Pipe& p) const;
+    std::string describe() const;
+    // Разбор пары "поле=значение" (repair, diameter, length)
+    bool parse(const std::string& token, std::string& error);
+};
+
+// Набор присваиваний полям КС; запись, которая нарушила бы working <= total, пропускается.
+// apply возвращает true, только если запись изменилась
+struct CSAssignment {
+    std::optional<int> workshopsTotal;
+    std::optional<int> workshopsWorking;
+    std::optional<std::string> stationClass;
+
+    bool empty() const { return !workshopsTotal && !workshopsWorking && !stationClass; }
+    bool apply(CS& s) const;
+    std::string describe() const;
+    // Разбор пары "поле=значение" (total, working, class)
+    bool parse(const std::string& token, std::string& error);
+};
+
+struct BulkUpdateResult {
+    size_t matched = 0;
+    size_t updated = 0;
+};
+
+#endif // BULKEDIT_H
@@ -0,0 +1,300 @@
+﻿#include "compact.h"
+#include "schema.h"
+#include "utils.h"
+#include <algorithm>
+#include <fstream>
+#include <climits>
+
+using namespace std;
+
+// Допустимые диаметры (GasNetwork::isValidDiameter) и их 2-битные коды
+static const int DIAMETER_CODES[4] = { 500, 700, 1000, 1400 };
+
+// Узел std::map: заголовок (цвет и три указателя) и пара ключ-значение
+template<typename T>
+static size_t mapNodeBytes(const T& item) {
+    return 4 * sizeof(void*) + sizeof(pair<const int, T>) + item.heapBytes();
+}
+
+namespace compact_codec {
+
+    static void appendVarint(string& out, uint32_t v) {
+        while (v >= 0x80) {
+            out += (char)(v | 0x80);
+            v >>= 7;
+        }
+        out += (char)v;
+    }
+
+    const char* readVarint(const char* p, uint32_t& v) {
+        v = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t byte = (uint8_t)*p++;
+            v |= (uint32_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return p;
+        }
+    }
+
+    static void appendName(string& out, const string& name) {
+        appendVarint(out, (uint32_t)name.size());
+        out += name;
+    }
+
+    static const char* readName(const char* p, string& name) {
+        uint32_t n;
+        p = readVarint(p, n);
+        name.assign(p, n);
+        return p + n;
+    }
+
+    const char* skipPipe(const char* p) {
+        uint32_t n;
+        p = readVarint(p, n);
+        return p + n;
+    }
+
+    const char* skipCS(const char* p) {
+        uint32_t v;
+        p = readVarint(p, v);
+        p = readVarint(p, v);
+        return skipPipe(p);
+    }
+}
+
+using namespace compact_codec;
+
+bool CompactRegister::Table::beginRecord(int id) {
+    if (count > 0 && id <= lastId) return false;
+    if (count % COMPACT_BLOCK == 0) {
+        blocks.push_back(Block{ id, (uint32_t)bytes.size() });
+        appendVarint(bytes, 0);
+    }
+    else {
+        appendVarint(bytes, (uint32_t)(id - lastId));
+    }
+    lastId = id;
+    ++count;
+    return true;
+}
+
+bool CompactRegister::Table::locate(int id, size_t& index, const char*& payload,
+    const char* (*skip)(const char*)) const {
+    // Последний блок с firstId <= id, затем последовательный разбор внутри блока
+    auto it = upper_bound(blocks.begin(), blocks.end(), id,
+        [](int key, const Block& b) { return key < b.firstId; });
+    if (it == blocks.begin()) return false;
+    size_t b = (size_t)(it - blocks.begin()) - 1;
+    const char* p = bytes.data() + blocks[b].offset;
+    int cur = blocks[b].firstId;
+    size_t end = min(count, (b + 1) * COMPACT_BLOCK);
+    for (size_t i = b * COMPACT_BLOCK; i < end; ++i) {
+        uint32_t delta;
+        p = readVarint(p, delta);
+        cur += (int)delta;
+        if (cur == id) {
+            index = i;
+            payload = p;
+            return true;
+        }
+        if (cur > id) return false;
+        p = skip(p);
+    }
+    return false;
+}
+
+void CompactRegister::Table::clear() {
+    blocks.clear();
+    bytes.clear();
+    count = 0;
+    lastId = 0;
+}
+
+size_t CompactRegister::Table::memoryBytes() const {
+    return blocks.capacity() * sizeof(Block) + bytes.capacity();
+}
+
+void CompactRegister::clear() {
+    pipes.clear();
+    pipeLengths.clear();
+    pipeDiameterCodes.clear();
+    pipeRepairBits.clear();
+    pipeDiameterExceptions.clear();
+    stations.clear();
+    stationClassCodes.clear();
+    classDictionary.clear();
+    classLookup.clear();
+    expandedBytes = 0;
+}
+
+bool CompactRegister::appendPipe(const Pipe& p) {
+    if (!pipes.beginRecord(p.getId())) return false;
+    appendName(pipes.bytes, p.getName());
+
+    size_t index = pipes.count - 1;
+    pipeLengths.push_back((float)p.getLength());
+    if (index % 32 == 0) pipeDiameterCodes.push_back(0);
+    if (index % 64 == 0) pipeRepairBits.push_back(0);
+
+    const int* code = find(begin(DIAMETER_CODES), end(DIAMETER_CODES), p.getDiameter());
+    if (code != end(DIAMETER_CODES)) {
+        pipeDiameterCodes[index / 32] |= (uint64_t)(code - DIAMETER_CODES) << (2 * (index % 32));
+    }
+    else {
+        pipeDiameterExceptions.emplace_back((uint32_t)index, p.getDiameter());
+    }
+    if (p.isInRepair()) pipeRepairBits[index / 64] |= uint64_t(1) << (index % 64);
+
+    expandedBytes += mapNodeBytes(p);
+    return true;
+}
+
+bool CompactRegister::appendCS(const CS& s) {
+    if (!stations.beginRecord(s.getId())) return false;
+    appendVarint(stations.bytes, (uint32_t)s.getWorkshopsTotal());
+    appendVarint(stations.bytes, (uint32_t)s.getWorkshopsWorking());
+    appendName(stations.bytes, s.getName());
+
+    auto it = classLookup.find(s.getStationClass());
+    if (it == classLookup.end()) {
+        it = classLookup.emplace(s.getStationClass(), (uint32_t)classDictionary.size()).first;
+        classDictionary.push_back(s.getStationClass());
+    }
+    stationClassCodes.push_back(it->second);
+
+    expandedBytes += mapNodeBytes(s);
+    return true;
+}
+
+void CompactRegister::seal() {
+    unordered_map<string, uint32_t>().swap(classLookup);
+    pipes.bytes.shrink_to_fit();
+    pipes.blocks.shrink_to_fit();
+    pipeLengths.shrink_to_fit();
+    pipeDiameterCodes.shrink_to_fit();
+    pipeRepairBits.shrink_to_fit();
+    pipeDiameterExceptions.shrink_to_fit();
+    stations.bytes.shrink_to_fit();
+    stations.blocks.shrink_to_fit();
+    stationClassCodes.shrink_to_fit();
+}
+
+void CompactRegister::build(const StorageSnapshot& snap) {
+    clear();
+    if (snap.pipes) snap.pipes->forEach([this](const Pipe& p) { appendPipe(p); });
+    if (snap.stations) snap.stations->forEach([this](const CS& s) { appendCS(s); });
+    seal();
+}
+
+// Разделы PIPES и CS одного файла сохранения; записи идут сразу в реестр
+static bool readSections(CompactRegister& reg, const string& filename, string& error) {
+    ifstream f(filename);
+    if (!f) {
+        error = "не удалось открыть файл " + filename;
+        return false;
+    }
+    enum { None, Pipes, Stations } section = None;
+    string line;
+    Pipe pipe;
+    CS cs;
+    while (getline(f, line)) {
+        trimInPlace(line);
+        if (line.empty()) continue;
+        if (line == "PIPES") section = Pipes;
+        else if (line == "CS") section = Stations;
+        else if (line == "ENDPIPES" || line == "ENDCS" || line == "CONNECTIONS" || line == "ENDCONNECTIONS") section = None;
+        else if (section == Pipes && TextCodec<Pipe>::decode(line.data(), line.data() + line.size(), pipe)) {
+            if (!reg.appendPipe(pipe)) {
+                error = "ID труб в файле " + filename + " не по возрастанию (" + to_string(pipe.getId()) + ")";
+                return false;
+            }
+        }
+        else if (section == Stations && TextCodec<CS>::decode(line.data(), line.data() + line.size(), cs)) {
+            Schema<CS>::finish(cs);
+            if (!reg.appendCS(cs)) {
+                error = "ID КС в файле " + filename + " не по возрастанию (" + to_string(cs.getId()) + ")";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool CompactRegister::loadFromFile(const string& filename, string& error) {
+    clear();
+    ifstream f(filename);
+    if (!f) {
+        error = "не удалось открыть файл " + filename;
+        return false;
+    }
+    // Части сохранения по частям (Storage::saveSharded) идут по возрастанию ID
+    string first;
+    int parts = 0;
+    getline(f, first);
+    trimInPlace(first);
+    f.close();
+    bool ok = true;
+    if (first.compare(0, 8, "SHARDED ") == 0) {
+        if (!parseInt(first.substr(8), parts) || parts <= 0) {
+            error = "неверное оглавление " + filename;
+            ok = false;
+        }
+        for (int k = 0; ok && k < parts; ++k) ok = readSections(*this, filename + "." + to_string(k), error);
+    }
+    else {
+        ok = readSections(*this, filename, error);
+    }
+    if (!ok) clear();
+    seal();
+    return ok;
+}
+
+int CompactRegister::pipeDiameter(size_t index) const {
+    if (!pipeDiameterExceptions.empty()) {
+        auto it = lower_bound(pipeDiameterExceptions.begin(), pipeDiameterExceptions.end(),
+            make_pair((uint32_t)index, INT_MIN));
+        if (it != pipeDiameterExceptions.end() && it->first == index) return it->second;
+    }
+    return DIAMETER_CODES[(pipeDiameterCodes[index / 32] >> (2 * (index % 32))) & 3];
+}
+
+Pipe CompactRegister::decodePipe(size_t index, int id, const char* payload) const {
+    string name;
+    readName(payload, name);
+    bool inRepair = (pipeRepairBits[index / 64] >> (index % 64)) & 1;
+    return Pipe(id, std::move(name), pipeLengths[index], pipeDiameter(index), inRepair);
+}
+
+CS CompactRegister::decodeCS(size_t index, int id, const char* payload) const {
+    uint32_t total, working;
+    payload = readVarint(payload, total);
+    payload = readVarint(payload, working);
+    string name;
+    readName(payload, name);
+    return CS(id, std::move(name), (int)total, (int)working, classDictionary[stationClassCodes[index]]);
+}
+
+bool CompactRegister::findPipe(int id, Pipe& out) const {
+    size_t index;
+    const char* payload;
+    if (!pipes.locate(id, index, payload, skipPipe)) return false;
+    out = decodePipe(index, id, payload);
+    return true;
+}
+
+bool CompactRegister::findCS(int id, CS& out) const {
+    size_t index;
+    const char* payload;
+    if (!stations.locate(id, index, payload, skipCS)) return false;
+    out = decodeCS(index, id, payload);
+    return true;
+}
+
+size_t CompactRegister::memoryBytes() const {
+    size_t bytes = pipes.memoryBytes() + stations.memoryBytes();
+    bytes += pipeLengths.capacity() * sizeof(float);
+    bytes += (pipeDiameterCodes.capacity() + pipeRepairBits.capacity()) * sizeof(uint64_t);
+    bytes += pipeDiameterExceptions.capacity() * sizeof(pair<uint32_t, int>);
+    bytes += stationClassCodes.capacity() * sizeof(uint32_t);
+    for (const string& c : classDictionary) bytes += sizeof(string) + c.capacity();
+    return bytes;
+}
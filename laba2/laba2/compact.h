@@ -0,0 +1,130 @@
+#pragma once
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include "entities.h"
+#include "snapshot.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+// Компактный реестр только для чтения: записи лежат блоками по COMPACT_BLOCK,
+// ID хранятся разностями varint, переменная часть записи (имя, число цехов) -
+// в том же потоке байт; фиксированные поля - отдельными упакованными столбцами.
+// Объект Pipe/CS собирается при обращении.
+//
+// Трубы: диаметр - 2-битный код из допустимого набора (как GasNetwork::isValidDiameter),
+// прочие диаметры - в списке исключений; ремонт - бит; длина - float (6 значащих
+// цифр формата сохранения сохраняются). КС: класс - номер в словаре классов.
+const size_t COMPACT_BLOCK = 64;
+
+class CompactRegister {
+    struct Block {
+        int firstId;
+        uint32_t offset;    // начало блока в потоке байт
+    };
+
+    // Общая часть таблиц: блоки, поток байт и число записей
+    struct Table {
+        std::vector<Block> blocks;
+        std::string bytes;
+        size_t count = 0;
+        int lastId = 0;
+
+        // Начинает запись с данным ID (ID строго возрастают); false - нарушен порядок
+        bool beginRecord(int id);
+        // Номер записи и позиция её переменной части; false - ID нет
+        bool locate(int id, size_t& index, const char*& payload,
+            const char* (*skip)(const char*)) const;
+        void clear();
+        size_t memoryBytes() const;
+    };
+
+    Table pipes;
+    std::vector<float> pipeLengths;
+    std::vector<uint64_t> pipeDiameterCodes;                // по 2 бита на трубу
+    std::vector<uint64_t> pipeRepairBits;
+    std::vector<std::pair<uint32_t, int>> pipeDiameterExceptions;   // номер записи -> диаметр
+
+    Table stations;
+    std::vector<uint32_t> stationClassCodes;
+    std::vector<std::string> classDictionary;
+    std::unordered_map<std::string, uint32_t> classLookup;  // только на время заполнения
+
+    // Оценка того же содержимого в обычном виде (узлы map и строки в куче)
+    size_t expandedBytes = 0;
+
+    int pipeDiameter(size_t index) const;
+    Pipe decodePipe(size_t index, int id, const char* payload) const;
+    CS decodeCS(size_t index, int id, const char* payload) const;
+
+    template<typename F>
+    void walk(const Table& t, const char* (*skip)(const char*), F fn) const;
+
+public:
+    void clear();
+
+    // Записи добавляются по возрастанию ID; false - нарушен порядок
+    bool appendPipe(const Pipe& p);
+    bool appendCS(const CS& s);
+    // Завершает заполнение (освобождает временный словарь)
+    void seal();
+
+    // Из опубликованного снимка
+    void build(const StorageSnapshot& snap);
+    // Прямо из файла сохранения (обычного или по частям), без промежуточных map
+    bool loadFromFile(const std::string& filename, std::string& error);
+
+    bool findPipe(int id, Pipe& out) const;
+    bool findCS(int id, CS& out) const;
+    template<typename F> void forEachPipe(F fn) const;
+    template<typename F> void forEachCS(F fn) const;
+
+    size_t pipeCount() const { return pipes.count; }
+    size_t csCount() const { return stations.count; }
+    size_t classCount() const { return classDictionary.size(); }
+    size_t memoryBytes() const;
+    size_t expandedMemoryBytes() const { return expandedBytes; }
+};
+
+// Разбор переменной части записей (compact.cpp)
+namespace compact_codec {
+    const char* readVarint(const char* p, uint32_t& v);
+    const char* skipPipe(const char* p);
+    const char* skipCS(const char* p);
+}
+
+template<typename F>
+void CompactRegister::walk(const Table& t, const char* (*skip)(const char*), F fn) const {
+    size_t index = 0;
+    for (size_t b = 0; b < t.blocks.size(); ++b) {
+        const char* p = t.bytes.data() + t.blocks[b].offset;
+        int id = t.blocks[b].firstId;
+        size_t end = std::min(t.count, (b + 1) * COMPACT_BLOCK);
+        for (; index < end; ++index) {
+            uint32_t delta;
+            p = compact_codec::readVarint(p, delta);
+            id += (int)delta;
+            fn(index, id, p);
+            p = skip(p);
+        }
+    }
+}
+
+template<typename F>
+void CompactRegister::forEachPipe(F fn) const {
+    walk(pipes, compact_codec::skipPipe, [&](size_t index, int id, const char* payload) {
+        fn(decodePipe(index, id, payload));
+    });
+}
+
+template<typename F>
+void CompactRegister::forEachCS(F fn) const {
+    walk(stations, compact_codec::skipCS, [&](size_t index, int id, const char* payload) {
+        fn(decodeCS(index, id, payload));
+    });
+}
+
+#endif // COMPACT_H
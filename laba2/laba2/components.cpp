@@ -0,0 +1,73 @@
+﻿#include "components.h"
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+void ComponentIndex::clear() {
+    vertexById.clear();
+    ids.clear();
+    parent.clear();
+    size.clear();
+    components = 0;
+    stale = false;
+}
+
+int ComponentIndex::touch(int id) {
+    auto inserted = vertexById.emplace(id, (int)ids.size());
+    if (!inserted.second) return inserted.first->second;
+    int v = inserted.first->second;
+    ids.push_back(id);
+    parent.push_back(v);
+    size.push_back(1);
+    ++components;
+    return v;
+}
+
+int ComponentIndex::root(int v) {
+    int r = v;
+    while (parent[r] != r) r = parent[r];
+    while (parent[v] != r) {
+        int next = parent[v];
+        parent[v] = r;
+        v = next;
+    }
+    return r;
+}
+
+int ComponentIndex::vertexOf(int csId) const {
+    auto it = vertexById.find(csId);
+    return it == vertexById.end() ? -1 : it->second;
+}
+
+int ComponentIndex::find(int csId) {
+    int v = vertexOf(csId);
+    return v < 0 ? -1 : root(v);
+}
+
+void ComponentIndex::addEdge(int a, int b) {
+    if (a < 0 || b < 0) return;
+    int ra = root(touch(a)), rb = root(touch(b));
+    if (ra == rb) return;
+    // Меньшее дерево подвешивается к большему
+    if (size[ra] < size[rb]) swap(ra, rb);
+    parent[rb] = ra;
+    size[ra] += size[rb];
+    --components;
+}
+
+size_t ComponentIndex::label(vector<int>& componentOf) {
+    componentOf.assign(ids.size(), -1);
+    vector<int> byRoot(ids.size(), -1);
+    // Обход по возрастанию ID: компонента получает номер при встрече её наименьшей КС
+    vector<int> order(ids.size());
+    for (size_t v = 0; v < order.size(); ++v) order[v] = (int)v;
+    sort(order.begin(), order.end(), [this](int a, int b) { return ids[a] < ids[b]; });
+    size_t count = 0;
+    for (int v : order) {
+        int r = root(v);
+        if (byRoot[r] < 0) byRoot[r] = (int)count++;
+        componentOf[v] = byRoot[r];
+    }
+    return count;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+
+// Слабые компоненты связности графа КС (система непересекающихся множеств).
+// Рёбра добавляются по одному за почти O(1); удалить ребро из такой структуры
+// нельзя, поэтому после удаления соединения индекс помечается устаревшим и
+// владелец перестраивает его при следующем запросе. КС получают плотные номера
+// вершин в порядке появления, поэтому память не зависит от величины ID.
+class ComponentIndex {
+    std::unordered_map<int, int> vertexById;
+    std::vector<int> ids;       // номер вершины -> ID КС
+    std::vector<int> parent;
+    std::vector<int> size;
+    size_t components = 0;
+    bool stale = false;
+
+    int touch(int id);
+    int root(int v);
+
+public:
+    void clear();
+    void addEdge(int a, int b);
+    // Представитель компоненты КС (номер вершины); -1, если КС нет в графе
+    int find(int csId);
+    // Номер вершины КС; -1, если КС нет в графе
+    int vertexOf(int csId) const;
+    const std::vector<int>& vertexIds() const { return ids; }
+
+    void invalidate() { stale = true; }
+    bool isStale() const { return stale; }
+
+    size_t vertexCount() const { return ids.size(); }
+    size_t componentCount() const { return components; }
+
+    // Номер компоненты для каждой вершины: componentOf[vertexOf(id)], компоненты
+    // пронумерованы по возрастанию наименьшего ID КС; возвращает их число
+    size_t label(std::vector<int>& componentOf);
+};
+
+#endif // COMPONENTS_H
@@ -0,0 +1,382 @@
+﻿#include "csv.h"
+#include "utils.h"
+#include "schema.h"
+#include <fstream>
+#include <thread>
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+static const size_t CSV_CHUNK_MIN = 1 << 20;        // меньше мегабайта на поток не делим
+static const size_t CSV_FLUSH_SIZE = 256 * 1024;
+
+namespace {
+
+    bool toInt(const string& s, int& out) {
+        const char* b = s.data();
+        const char* e = b + s.size();
+        while (b < e && (*b == ' ' || *b == '\t')) ++b;
+        while (e > b && (e[-1] == ' ' || e[-1] == '\t')) --e;
+        if (b == e) { out = 0; return true; }
+        auto r = from_chars(b, e, out);
+        return r.ec == errc() && r.ptr == e;
+    }
+
+    bool toDouble(const string& s, double& out) {
+        const char* b = s.data();
+        const char* e = b + s.size();
+        while (b < e && (*b == ' ' || *b == '\t')) ++b;
+        while (e > b && (e[-1] == ' ' || e[-1] == '\t')) --e;
+        auto r = from_chars(b, e, out);
+        return b != e && r.ec == errc() && r.ptr == e;
+    }
+
+    bool toFlag(const string& s, bool& out) {
+        int v;
+        if (!toInt(s, v) || (v != 0 && v != 1)) return false;
+        out = (v == 1);
+        return true;
+    }
+
+    // Разбор строк одного куска файла в сущности
+    struct ChunkResult {
+        size_t lines = 0;
+        vector<size_t> rowLines;                     // номер строки (в куске) для каждой записи
+        vector<pair<size_t, string>> errors;         // номер строки в куске, причина
+    };
+
+    bool parseValue(string& s, int& out) { return toInt(s, out); }
+    bool parseValue(string& s, double& out) { return toDouble(s, out); }
+    bool parseValue(string& s, bool& out) { return toFlag(s, out); }
+    bool parseValue(string& s, string& out) { out = std::move(s); return true; }
+
+    // Проверки значений сверх формата
+    bool validate(const Pipe& p, string& error) {
+        if (p.getLength() <= 0) { error = "неверная длина"; return false; }
+        if (p.getDiameter() <= 0) { error = "неверный диаметр"; return false; }
+        if (trim(p.getName()).empty()) { error = "пустое название"; return false; }
+        return true;
+    }
+
+    bool validate(const CS& s, string& error) {
+        if (s.getWorkshopsTotal() <= 0) { error = "неверное число цехов"; return false; }
+        if (s.getWorkshopsWorking() < 0 || s.getWorkshopsWorking() > s.getWorkshopsTotal()) {
+            error = "неверное число работающих цехов";
+            return false;
+        }
+        if (trim(s.getName()).empty()) { error = "пустое название"; return false; }
+        return true;
+    }
+
+    bool validate(const Connection&, string&) { return true; }
+
+    template<typename T>
+    size_t csvFieldCount() {
+        size_t n = 0;
+        forEachField<T>([&](const auto& f) { if (!f.computed) ++n; });
+        return n;
+    }
+
+    // Столбцы CSV - невычисляемые поля схемы по порядку
+    template<typename T>
+    string csvHeader() {
+        string header;
+        forEachField<T>([&](const auto& f) {
+            if (f.computed) return;
+            if (!header.empty()) header += ',';
+            header += f.name;
+        });
+        return header;
+    }
+
+    template<typename T>
+    bool parseRecord(vector<string>& f, T& out, string& error) {
+        size_t expected = csvFieldCount<T>();
+        if (f.size() != expected) {
+            error = "ожидалось " + to_string(expected) + " полей, получено " + to_string(f.size());
+            return false;
+        }
+        size_t i = 0;
+        bool ok = allFields<T>([&](const auto& field) {
+            if (field.computed) return true;
+            if (parseValue(f[i++], field.get(out))) return true;
+            error = string("неверное значение поля ") + field.name;
+            return false;
+        });
+        if (!ok) return false;
+        Schema<T>::finish(out);
+        return validate(out, error);
+    }
+
+    template<typename T>
+    void parseChunk(const char* begin, const char* end, vector<T>& items, ChunkResult& res) {
+        vector<string> fields;
+        string error;
+        items.reserve((end - begin) / 32 + 1);
+        const char* p = begin;
+        while (p < end) {
+            const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!eol) eol = end;
+            const char* lineEnd = eol;
+            if (lineEnd > p && lineEnd[-1] == '\r') --lineEnd;
+            ++res.lines;
+
+            if (lineEnd > p) {
+                T item;
+                if (!CsvIO::splitRow(p, lineEnd, fields)) {
+                    res.errors.emplace_back(res.lines, "незакрытая кавычка");
+                }
+                else if (!parseRecord(fields, item, error)) {
+                    res.errors.emplace_back(res.lines, error);
+                }
+                else {
+                    items.push_back(std::move(item));
+                    res.rowLines.push_back(res.lines);
+                }
+            }
+            p = eol + 1;
+        }
+    }
+
+    void appendValue(string& out, int v) {
+        char buf[16];
+        out.append(buf, to_chars(buf, buf + sizeof(buf), v).ptr);
+    }
+    void appendValue(string& out, double v) {
+        char buf[32];
+        out.append(buf, to_chars(buf, buf + sizeof(buf), v).ptr);
+    }
+    void appendValue(string& out, bool v) { out += v ? '1' : '0'; }
+    void appendValue(string& out, const string& v) { CsvIO::appendField(out, v); }
+
+    template<typename T>
+    void appendRecord(string& out, const T& item) {
+        bool first = true;
+        forEachField<T>([&](const auto& f) {
+            if (f.computed) return;
+            if (!first) out += ',';
+            first = false;
+            appendValue(out, f.get(item));
+        });
+    }
+
+    // Загрузка CSV: чтение файла целиком, разбор кусков в потоках,
+    // затем однопроходная вставка с перемещением
+    template<typename T, typename Insert>
+    bool importRecords(const string& filename, CsvImportResult& result, Insert insert) {
+        ifstream f(filename, ios::binary);
+        if (!f) return false;
+        string data((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+
+        // Пропускаем строку заголовка
+        size_t start = 0;
+        size_t headerLines = 0;
+        if (data.compare(0, 3, "\xEF\xBB\xBF") == 0) start = 3;
+        size_t firstEol = data.find('\n', start);
+        string firstLine = trim(data.substr(start, firstEol == string::npos ? string::npos : firstEol - start));
+        if (firstLine == csvHeader<T>()) {
+            start = (firstEol == string::npos) ? data.size() : firstEol + 1;
+            headerLines = 1;
+        }
+
+        size_t bytes = data.size() - start;
+        size_t threads = max<size_t>(1, min<size_t>(thread::hardware_concurrency(), bytes / CSV_CHUNK_MIN + 1));
+
+        // Границы кусков выравниваются на конец строки
+        vector<size_t> bounds(1, start);
+        for (size_t i = 1; i < threads; ++i) {
+            size_t pos = start + bytes * i / threads;
+            if (pos <= bounds.back()) continue;
+            size_t eol = data.find('\n', pos);
+            if (eol == string::npos) break;
+            if (eol + 1 > bounds.back()) bounds.push_back(eol + 1);
+        }
+        bounds.push_back(data.size());
+
+        size_t chunks = bounds.size() - 1;
+        vector<vector<T>> parts(chunks);
+        vector<ChunkResult> results(chunks);
+        vector<thread> workers;
+        for (size_t i = 1; i < chunks; ++i) {
+            workers.emplace_back([&, i]() {
+                parseChunk(data.data() + bounds[i], data.data() + bounds[i + 1], parts[i], results[i]);
+            });
+        }
+        parseChunk(data.data() + bounds[0], data.data() + bounds[1], parts[0], results[0]);
+        for (thread& t : workers) t.join();
+
+        // Склейка с заранее зарезервированным местом
+        size_t total = 0;
+        for (const auto& part : parts) total += part.size();
+        vector<T> items;
+        vector<size_t> rowLines;
+        items.reserve(total);
+        rowLines.reserve(total);
+
+        size_t lineBase = headerLines;
+        for (size_t i = 0; i < chunks; ++i) {
+            for (T& item : parts[i]) items.push_back(std::move(item));
+            for (size_t line : results[i].rowLines) rowLines.push_back(lineBase + line);
+            for (const auto& err : results[i].errors) {
+                result.errors.push_back("строка " + to_string(lineBase + err.first) + ": " + err.second);
+            }
+            result.rows += results[i].rowLines.size() + results[i].errors.size();
+            lineBase += results[i].lines;
+            vector<T>().swap(parts[i]);
+        }
+
+        vector<size_t> rejected;
+        result.imported += insert(items, rejected);
+        for (size_t idx : rejected) {
+            result.errors.push_back("строка " + to_string(rowLines[idx]) + ": запись отклонена (повторяющийся id или ссылка на несуществующий объект)");
+        }
+        return true;
+    }
+
+    // Потоковая запись через буфер
+    class CsvWriter {
+        ofstream& os;
+        string buf;
+    public:
+        explicit CsvWriter(ofstream& f) : os(f) { buf.reserve(CSV_FLUSH_SIZE + 1024); }
+        ~CsvWriter() { flush(); }
+        string& buffer() { return buf; }
+        void endRow() {
+            buf += '\n';
+            if (buf.size() >= CSV_FLUSH_SIZE) flush();
+        }
+        void flush() {
+            os.write(buf.data(), (streamsize)buf.size());
+            buf.clear();
+        }
+    };
+
+    // Заголовок и строки; each(fn) перечисляет записи
+    template<typename T, typename Each>
+    void writeRecords(CsvWriter& w, size_t& written, Each each) {
+        w.buffer() += csvHeader<T>();
+        w.endRow();
+        each([&](const T& item) {
+            appendRecord(w.buffer(), item);
+            w.endRow();
+            ++written;
+        });
+    }
+
+}
+
+bool CsvIO::parseKind(const string& s, CsvKind& kind) {
+    if (s == "pipes") kind = CsvKind::Pipes;
+    else if (s == "cs") kind = CsvKind::Stations;
+    else if (s == "connections") kind = CsvKind::Connections;
+    else return false;
+    return true;
+}
+
+bool CsvIO::splitRow(const char* begin, const char* end, vector<string>& fields) {
+    size_t n = 0;
+    const char* p = begin;
+    while (true) {
+        if (fields.size() <= n) fields.emplace_back();
+        string& field = fields[n++];
+        field.clear();
+
+        if (p < end && *p == '"') {
+            ++p;
+            while (true) {
+                if (p >= end) return false;
+                if (*p == '"') {
+                    if (p + 1 < end && p[1] == '"') { field += '"'; p += 2; continue; }
+                    ++p;
+                    break;
+                }
+                field += *p++;
+            }
+            while (p < end && *p != ',') ++p;
+        }
+        else {
+            const char* comma = static_cast<const char*>(memchr(p, ',', end - p));
+            if (!comma) comma = end;
+            field.assign(p, comma);
+            p = comma;
+        }
+
+        if (p >= end) break;
+        ++p;   // запятая
+    }
+    fields.resize(n);
+    return true;
+}
+
+void CsvIO::appendField(string& out, const string& value) {
+    if (value.find_first_of(",\"\n\r") == string::npos) {
+        out += value;
+        return;
+    }
+    out += '"';
+    for (char c : value) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    out += '"';
+}
+
+bool CsvIO::importFile(Storage& storage, CsvKind kind, const string& filename, CsvImportResult& result) {
+    switch (kind) {
+    case CsvKind::Pipes:
+        return importRecords<Pipe>(filename, result,
+            [&](vector<Pipe>& items, vector<size_t>& rejected) { return storage.addPipesBulk(items, rejected); });
+    case CsvKind::Stations:
+        return importRecords<CS>(filename, result,
+            [&](vector<CS>& items, vector<size_t>& rejected) { return storage.addCSBulk(items, rejected); });
+    case CsvKind::Connections:
+        return importRecords<Connection>(filename, result,
+            [&](vector<Connection>& items, vector<size_t>& rejected) {
+                // Соединение допустимо, только если его труба и обе КС существуют
+                vector<Connection> valid;
+                vector<size_t> validIndex;
+                valid.reserve(items.size());
+                validIndex.reserve(items.size());
+                for (size_t i = 0; i < items.size(); ++i) {
+                    const Connection& c = items[i];
+                    if (storage.findPipeById(c.pipeId) && storage.findCSById(c.csInId) &&
+                        storage.findCSById(c.csOutId) && c.csInId != c.csOutId) {
+                        valid.push_back(std::move(items[i]));
+                        validIndex.push_back(i);
+                    }
+                    else {
+                        rejected.push_back(i);
+                    }
+                }
+                vector<size_t> duplicates;
+                size_t added = storage.addConnectionsBulk(valid, duplicates);
+                for (size_t idx : duplicates) rejected.push_back(validIndex[idx]);
+                sort(rejected.begin(), rejected.end());
+                return added;
+            });
+    }
+    return false;
+}
+
+bool CsvIO::exportFile(const Storage& storage, CsvKind kind, const string& filename, size_t& written) {
+    ofstream f(filename, ios::binary);
+    if (!f) return false;
+    written = 0;
+
+    CsvWriter w(f);
+    switch (kind) {
+    case CsvKind::Pipes:
+        writeRecords<Pipe>(w, written, [&](auto&& fn) { storage.forEachPipe(fn); });
+        break;
+    case CsvKind::Stations:
+        writeRecords<CS>(w, written, [&](auto&& fn) { storage.forEachCS(fn); });
+        break;
+    case CsvKind::Connections:
+        writeRecords<Connection>(w, written, [&](auto&& fn) { storage.getNetwork().forEachConnection(fn); });
+        break;
+    }
+    w.flush();
+    return (bool)f;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef CSV_H
+#define CSV_H
+
+#include "storage.h"
+#include <string>
+#include <vector>
+
+// Вид записей в CSV-файле
+enum class CsvKind { Pipes, Stations, Connections };
+
+struct CsvImportResult {
+    size_t rows = 0;
+    size_t imported = 0;
+    std::vector<std::string> errors;   // "строка N: причина"
+};
+
+// Массовый импорт/экспорт в CSV (разделитель ',', поля с запятыми - в кавычках).
+// Столбцы:
+//   трубы:      id,name,length,diameter,inRepair
+//   КС:         id,name,workshopsTotal,workshopsWorking,stationClass
+//   соединения: id,pipeId,csInId,csOutId,isActive
+// Пустой или нулевой id означает "назначить автоматически".
+class CsvIO {
+public:
+    static bool importFile(Storage& storage, CsvKind kind, const std::string& filename, CsvImportResult& result);
+    static bool exportFile(const Storage& storage, CsvKind kind, const std::string& filename, size_t& written);
+    static bool parseKind(const std::string& s, CsvKind& kind);
+
+    // Разбор одной строки CSV; fields переиспользуется между вызовами
+    static bool splitRow(const char* begin, const char* end, std::vector<std::string>& fields);
+    static void appendField(std::string& out, const std::string& value);
+};
+
+#endif // CSV_H
@@ -0,0 +1,58 @@
+#pragma once
+#ifndef DIRTY_H
+#define DIRTY_H
+
+#include <unordered_set>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <cstddef>
+
+// Записи, изменённые с последнего сохранения (по ID). Когда изменений становится
+// слишком много, вместо множества хранится признак "изменено всё".
+class DirtyTracker {
+    mutable std::mutex lock;
+    std::unordered_set<int> ids;
+    bool all = false;
+
+public:
+    // total - размер таблицы: при изменении больше её восьмой части считается, что изменено всё
+    static size_t limit(size_t total) { return std::max<size_t>(1024, total / 8); }
+
+    void mark(int id, size_t total) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (all) return;
+        ids.insert(id);
+        if (ids.size() > limit(total)) {
+            all = true;
+            std::unordered_set<int>().swap(ids);
+        }
+    }
+
+    void markAll() {
+        std::lock_guard<std::mutex> guard(lock);
+        all = true;
+        std::unordered_set<int>().swap(ids);
+    }
+
+    // Изменённые ID по возрастанию; false - изменено всё
+    bool collect(std::vector<int>& out) const {
+        std::lock_guard<std::mutex> guard(lock);
+        out.assign(ids.begin(), ids.end());
+        std::sort(out.begin(), out.end());
+        return !all;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> guard(lock);
+        all = false;
+        ids.clear();
+    }
+
+    bool empty() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return !all && ids.empty();
+    }
+};
+
+#endif // DIRTY_H
@@ -1,5 +1,8 @@
 #include "entities.h"
 #include "utils.h"
+#include "schema.h"
+#include "memstats.h"
+#include "report.h"
 #include <algorithm>
 #include <vector>
 #include <iomanip>
@@ -10,13 +13,14 @@ using namespace std;
 Pipe::Pipe() : id(0), name(""), length(0.0), diameter(0), inRepair(false) {}
 
 Pipe::Pipe(int id, string name, double length, int diameter, bool inRepair)
-    : id(id), name(name), length(length), diameter(diameter), inRepair(inRepair) {
+    : id(id), name(std::move(name)), length(length), diameter(diameter), inRepair(inRepair) {
 }
 
 int Pipe::getId() const { return id; }
 void Pipe::setId(int newId) { id = newId; }
-string Pipe::getName() const { return name; }
+const string& Pipe::getName() const { return name; }
 void Pipe::setName(const string& newName) { name = newName; }
+void Pipe::setName(string&& newName) { name = std::move(newName); }
 double Pipe::getLength() const { return length; }
 void Pipe::setLength(double newLength) { length = newLength; }
 int Pipe::getDiameter() const { return diameter; }
@@ -25,47 +29,38 @@ bool Pipe::isInRepair() const { return inRepair; }
 void Pipe::setInRepair(bool repair) { inRepair = repair; }
 
 string Pipe::toSingleLine() const {
-    ostringstream oss;
-    oss << id << "|" << name << "|" << length << "|" << diameter << "|" << (inRepair ? 1 : 0);
-    return oss.str();
+    return TextCodec<Pipe>::encode(*this);
 }
 
 bool Pipe::fromSingleLine(const string& line, Pipe& out) {
-    vector<string> parts;
-    string tmp;
-    istringstream iss(line);
-    while (getline(iss, tmp, '|')) parts.push_back(tmp);
-    if (parts.size() != 5) return false;
-    try {
-        out.id = stoi(parts[0]);
-        out.name = parts[1];
-        out.length = stod(parts[2]);
-        out.diameter = stoi(parts[3]);
-        out.inRepair = (parts[4] == "1");
-        return true;
-    }
-    catch (...) { return false; }
+    return TextCodec<Pipe>::decode(line.data(), line.data() + line.size(), out);
 }
 
 void Pipe::printDetails() const {
-    cout << "\n---  (ID=" << id << ") ---\n";
-    cout << ": " << name << "\n";
-    cout << ": " << length << " \n";
-    cout << ": " << diameter << " \n";
-    cout << ": " << (inRepair ? " " : "") << "\n";
+    ReportWriter out(cout);
+    writeDetails(out);
+}
+
+void Pipe::writeDetails(ReportWriter& out) const {
+    out << "\n---  (ID=" << id << ") ---\n";
+    out << ": " << name << "\n";
+    out << ": " << length << " \n";
+    out << ": " << diameter << " \n";
+    out << ": " << (inRepair ? " " : "") << "\n";
 }
 
 void Pipe::editInteractive() {
     cout << "  ID=" << id << ".   ,   .\n";
     cout << " : " << name << "\n";
     cout << " : ";
-    string s; getline(cin, s); s = trim(s);
-    if (!s.empty()) name = s;
+    string s; getline(cin, s); trimInPlace(s);
+    // swap:        
+    if (!s.empty()) name.swap(s);
 
     cout << " : " << length << " \n";
     cout << "  ( ): ";
-    getline(cin, s);
-    if (!trim(s).empty()) {
+    getline(cin, s); trimInPlace(s);
+    if (!s.empty()) {
         double v;
         if (parseDouble(s, v) && v > 0) length = v;
         else cout << "   .\n";
@@ -73,8 +68,8 @@ void Pipe::editInteractive() {
 
     cout << " : " << diameter << " \n";
     cout << "  ( ): ";
-    getline(cin, s);
-    if (!trim(s).empty()) {
+    getline(cin, s); trimInPlace(s);
+    if (!s.empty()) {
         int v;
         if (parseInt(s, v) && v > 0) diameter = v;
         else cout << "   .\n";
@@ -82,27 +77,32 @@ void Pipe::editInteractive() {
 
     cout << " : " << (inRepair ? " " : "") << "\n";
     cout << " ? (1 -  , 0 - ,   -  ): ";
-    getline(cin, s);
-    if (!trim(s).empty()) {
+    getline(cin, s); trimInPlace(s);
+    if (!s.empty()) {
         int v;
         if (parseInt(s, v) && (v == 0 || v == 1)) inRepair = (v == 1);
         else cout << "   .\n";
     }
 }
 
+size_t Pipe::heapBytes() const {
+    return stringHeapBytes(name);
+}
+
 // CS implementation
 CS::CS() : id(0), name(""), workshopsTotal(0), workshopsWorking(0), stationClass(""), efficiency(0.0) {}
 
 CS::CS(int id, string name, int workshopsTotal, int workshopsWorking, string stationClass)
-    : id(id), name(name), workshopsTotal(workshopsTotal), workshopsWorking(workshopsWorking), stationClass(stationClass)
+    : id(id), name(std::move(name)), workshopsTotal(workshopsTotal), workshopsWorking(workshopsWorking), stationClass(std::move(stationClass))
 {
     updateEfficiency();
 }
 
 int CS::getId() const { return id; }
 void CS::setId(int newId) { id = newId; }
-string CS::getName() const { return name; }
+const string& CS::getName() const { return name; }
 void CS::setName(const string& newName) { name = newName; }
+void CS::setName(string&& newName) { name = std::move(newName); }
 int CS::getWorkshopsTotal() const { return workshopsTotal; }
 void CS::setWorkshopsTotal(int total) {
     workshopsTotal = total;
@@ -117,8 +117,9 @@ double CS::getIdlePercent() const {
     if (workshopsTotal == 0) return 0.0;
     return 100.0 * (workshopsTotal - workshopsWorking) / workshopsTotal;
 }
-string CS::getStationClass() const { return stationClass; }
+const string& CS::getStationClass() const { return stationClass; }
 void CS::setStationClass(const string& cls) { stationClass = cls; }
+void CS::setStationClass(string&& cls) { stationClass = std::move(cls); }
 
 double CS::getEfficiency() const { return efficiency; }
 void CS::setEfficiency(double eff) { efficiency = eff; }
@@ -127,50 +128,41 @@ void CS::updateEfficiency() {
 }
 
 string CS::toSingleLine() const {
-    ostringstream oss;
-    oss << id << "|" << name << "|" << workshopsTotal << "|" << workshopsWorking << "|" << stationClass << "|" << efficiency;
-    return oss.str();
+    return TextCodec<CS>::encode(*this);
 }
 
 bool CS::fromSingleLine(const string& line, CS& out) {
-    vector<string> parts;
-    string tmp;
-    istringstream iss(line);
-    while (getline(iss, tmp, '|')) parts.push_back(tmp);
-    if (parts.size() != 6) return false;
-    try {
-        out.id = stoi(parts[0]);
-        out.name = parts[1];
-        out.workshopsTotal = stoi(parts[2]);
-        out.workshopsWorking = stoi(parts[3]);
-        out.stationClass = parts[4];
-        out.efficiency = stod(parts[5]);
-        return true;
-    }
-    catch (...) { return false; }
+    return TextCodec<CS>::decode(line.data(), line.data() + line.size(), out);
 }
 
 void CS::printDetails() const {
-    cout << "\n---  (ID=" << id << ") ---\n";
-    cout << ": " << name << "\n";
-    cout << " : " << stationClass << "\n";
-    cout << " : " << workshopsTotal << "\n";
-    cout << " : " << workshopsWorking << "\n";
-    cout << ": " << fixed << setprecision(2) << efficiency << "%\n";
-    cout << "  : " << fixed << setprecision(2) << getIdlePercent() << "%\n";
+    ReportWriter out(cout);
+    writeDetails(out);
+}
+
+void CS::writeDetails(ReportWriter& out) const {
+    out << "\n---  (ID=" << id << ") ---\n";
+    out << ": " << name << "\n";
+    out << " : " << stationClass << "\n";
+    out << " : " << workshopsTotal << "\n";
+    out << " : " << workshopsWorking << "\n";
+    out << ": ";
+    out.fixed(efficiency) << "%\n";
+    out << "  : ";
+    out.fixed(getIdlePercent()) << "%\n";
 }
 
 void CS::editInteractive() {
     cout << "  ID=" << id << ".   ,   .\n";
     cout << " : " << name << "\n";
     cout << " : ";
-    string line; getline(cin, line); line = trim(line);
-    if (!line.empty()) name = line;
+    string line; getline(cin, line); trimInPlace(line);
+    if (!line.empty()) name.swap(line);
 
     cout << "   : " << workshopsTotal << "\n";
     cout << "    (,   -  ): ";
-    getline(cin, line);
-    if (!trim(line).empty()) {
+    getline(cin, line); trimInPlace(line);
+    if (!line.empty()) {
         int v;
         if (parseInt(line, v) && v > 0) setWorkshopsTotal(v);
         else cout << "  .\n";
@@ -178,8 +170,8 @@ void CS::editInteractive() {
 
     cout << "   : " << workshopsWorking << "\n";
     cout << "    (<= ): ";
-    getline(cin, line);
-    if (!trim(line).empty()) {
+    getline(cin, line); trimInPlace(line);
+    if (!line.empty()) {
         int v;
         if (parseInt(line, v) && v >= 0 && v <= workshopsTotal) setWorkshopsWorking(v);
         else cout << "  .\n";
@@ -187,6 +179,10 @@ void CS::editInteractive() {
 
     cout << "  : " << stationClass << "\n";
     cout << "   (  -  ): ";
-    getline(cin, line);
-    if (!trim(line).empty()) stationClass = line;
+    getline(cin, line); trimInPlace(line);
+    if (!line.empty()) stationClass.swap(line);
+}
+
+size_t CS::heapBytes() const {
+    return stringHeapBytes(name) + stringHeapBytes(stationClass);
 }
\ No newline at end of file
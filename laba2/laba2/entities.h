@@ -7,6 +7,11 @@
 #include <sstream>
 #include <iomanip>
 
+class ReportWriter;
+
+// Описание полей для форматов сериализации (schema.h)
+template<typename T> struct Schema;
+
 class Pipe {
     int id;
     std::string name;
@@ -14,14 +19,17 @@ class Pipe {
     int diameter;
     bool inRepair;
 
+    friend struct Schema<Pipe>;
+
 public:
     Pipe();
     Pipe(int id, std::string name, double length, int diameter, bool inRepair);
 
     int getId() const;
     void setId(int newId);
-    std::string getName() const;
+    const std::string& getName() const;
     void setName(const std::string& newName);
+    void setName(std::string&& newName);
     double getLength() const;
     void setLength(double newLength);
     int getDiameter() const;
@@ -33,7 +41,10 @@ public:
     static bool fromSingleLine(const std::string& line, Pipe& out);
 
     void printDetails() const;
+    void writeDetails(ReportWriter& out) const;
     void editInteractive();
+
+    size_t heapBytes() const;
 };
 
 class CS {
@@ -44,21 +55,25 @@ class CS {
     std::string stationClass;
     double efficiency;
 
+    friend struct Schema<CS>;
+
 public:
     CS();
     CS(int id, std::string name, int workshopsTotal, int workshopsWorking, std::string stationClass);
 
     int getId() const;
     void setId(int newId);
-    std::string getName() const;
+    const std::string& getName() const;
     void setName(const std::string& newName);
+    void setName(std::string&& newName);
     int getWorkshopsTotal() const;
     void setWorkshopsTotal(int total);
     int getWorkshopsWorking() const;
     void setWorkshopsWorking(int working);
     double getIdlePercent() const;
-    std::string getStationClass() const;
+    const std::string& getStationClass() const;
     void setStationClass(const std::string& cls);
+    void setStationClass(std::string&& cls);
 
     double getEfficiency() const;
     void setEfficiency(double eff);
@@ -68,7 +83,10 @@ public:
     static bool fromSingleLine(const std::string& line, CS& out);
 
     void printDetails() const;
+    void writeDetails(ReportWriter& out) const;
     void editInteractive();
+
+    size_t heapBytes() const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,411 @@
+﻿#include "filter.h"
+#include "utils.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+// Описание полей, доступных в выражениях
+template<typename T> struct FilterFields;
+
+template<> struct FilterFields<Pipe> {
+    enum { Id, Name, Length, Diameter, InRepair };
+
+    // Возвращает номер поля или -1; isString - строковое поле, isBool - логическое
+    static int find(const string& name, bool& isString, bool& isBool) {
+        isString = false;
+        isBool = false;
+        if (name == "id") return Id;
+        if (name == "name") { isString = true; return Name; }
+        if (name == "length") return Length;
+        if (name == "diameter") return Diameter;
+        if (name == "inrepair" || name == "repair") { isBool = true; return InRepair; }
+        return -1;
+    }
+
+    static void gather(int field, const Pipe* const* items, size_t n, double* out) {
+        switch (field) {
+        case Id: for (size_t i = 0; i < n; ++i) out[i] = items[i]->getId(); break;
+        case Length: for (size_t i = 0; i < n; ++i) out[i] = items[i]->getLength(); break;
+        case Diameter: for (size_t i = 0; i < n; ++i) out[i] = items[i]->getDiameter(); break;
+        case InRepair: for (size_t i = 0; i < n; ++i) out[i] = items[i]->isInRepair() ? 1.0 : 0.0; break;
+        }
+    }
+
+    static const string& text(int, const Pipe& p) { return p.getName(); }
+};
+
+template<> struct FilterFields<CS> {
+    enum { Id, Name, Class, Total, Working, Idle, Efficiency };
+
+    static int find(const string& name, bool& isString, bool& isBool) {
+        isString = false;
+        isBool = false;
+        if (name == "id") return Id;
+        if (name == "name") { isString = true; return Name; }
+        if (name == "class") { isString = true; return Class; }
+        if (name == "total") return Total;
+        if (name == "working") return Working;
+        if (name == "idle") return Idle;
+        if (name == "efficiency") return Efficiency;
+        return -1;
+    }
+
+    static void gather(int field, const CS* const* items, size_t n, double* out) {
+        switch (field) {
+        case Id: for (size_t i = 0; i < n; ++i) out[i] = items[i]->getId(); break;
+        case Total: for (size_t i = 0; i < n; ++i) out[i] = items[i]->getWorkshopsTotal(); break;
+        case Working: for (size_t i = 0; i < n; ++i) out[i] = items[i]->getWorkshopsWorking(); break;
+        case Idle: for (size_t i = 0; i < n; ++i) out[i] = items[i]->getIdlePercent(); break;
+        case Efficiency: for (size_t i = 0; i < n; ++i) out[i] = items[i]->getEfficiency(); break;
+        }
+    }
+
+    static const string& text(int field, const CS& s) {
+        return field == Class ? s.getStationClass() : s.getName();
+    }
+};
+
+// Разбор выражения методом рекурсивного спуска сразу в постфиксную программу
+template<typename T>
+class FilterParser {
+    enum class Tok { End, Ident, Number, String, LParen, RParen, Comma, Cmp };
+
+    const string& src;
+    size_t pos;
+    Tok tok;
+    string tokText;
+    double tokNumber;
+    CompiledFilter<T>& out;
+    size_t depth;
+
+public:
+    string error;
+
+    FilterParser(const string& s, CompiledFilter<T>& f) : src(s), pos(0), tok(Tok::End), tokNumber(0), out(f), depth(0) {}
+
+    bool parse() {
+        if (!next()) return false;
+        if (tok == Tok::End) return fail("пустое выражение");
+        if (!parseOr()) return false;
+        if (tok != Tok::End) return fail("лишний текст: '" + tokText + "'");
+        return true;
+    }
+
+private:
+    bool fail(const string& msg) {
+        if (error.empty()) error = msg + " (позиция " + to_string(pos) + ")";
+        return false;
+    }
+
+    bool next() {
+        while (pos < src.size() && isspace((unsigned char)src[pos])) ++pos;
+        tokText.clear();
+        if (pos >= src.size()) { tok = Tok::End; return true; }
+
+        char c = src[pos];
+        if (c == '(') { tok = Tok::LParen; tokText = "("; ++pos; return true; }
+        if (c == ')') { tok = Tok::RParen; tokText = ")"; ++pos; return true; }
+        if (c == ',') { tok = Tok::Comma; tokText = ","; ++pos; return true; }
+        if (c == '"' || c == '\'') {
+            size_t end = src.find(c, pos + 1);
+            if (end == string::npos) return fail("незакрытая строка");
+            tok = Tok::String;
+            tokText = src.substr(pos + 1, end - pos - 1);
+            pos = end + 1;
+            return true;
+        }
+        if (c == '=' || c == '!' || c == '<' || c == '>') {
+            tokText = c;
+            ++pos;
+            if (pos < src.size() && (src[pos] == '=' || (c == '<' && src[pos] == '>'))) tokText += src[pos++];
+            if (tokText == "!") return fail("ожидалось '!='");
+            if (tokText == "==") tokText = "=";
+            if (tokText == "<>") tokText = "!=";
+            tok = Tok::Cmp;
+            return true;
+        }
+        if (isdigit((unsigned char)c) || c == '-' || c == '.') {
+            const char* begin = src.c_str() + pos;
+            char* end = nullptr;
+            tokNumber = strtod(begin, &end);
+            if (end == begin) return fail("неверное число");
+            tokText.assign(begin, end - begin);
+            pos += end - begin;
+            tok = Tok::Number;
+            return true;
+        }
+        if (isalpha((unsigned char)c) || c == '_') {
+            size_t start = pos;
+            while (pos < src.size() && (isalnum((unsigned char)src[pos]) || src[pos] == '_')) ++pos;
+            tokText = src.substr(start, pos - start);
+            transform(tokText.begin(), tokText.end(), tokText.begin(), ::tolower);
+            tok = Tok::Ident;
+            return true;
+        }
+        return fail(string("неожиданный символ '") + c + "'");
+    }
+
+    bool isKeyword(const char* kw) const { return tok == Tok::Ident && tokText == kw; }
+
+    void emit(typename CompiledFilter<T>::Instr instr) {
+        typedef typename CompiledFilter<T>::Op Op;
+        if (instr.op == Op::And || instr.op == Op::Or) --depth;
+        else if (instr.op != Op::Not) out.maxDepth = max(out.maxDepth, ++depth);
+        out.program.push_back(std::move(instr));
+    }
+
+    void emitOp(typename CompiledFilter<T>::Op op) {
+        typename CompiledFilter<T>::Instr instr;
+        instr.op = op;
+        instr.column = -1;
+        instr.value = 0;
+        emit(std::move(instr));
+    }
+
+    bool parseOr() {
+        if (!parseAnd()) return false;
+        while (isKeyword("or")) {
+            if (!next() || !parseAnd()) return false;
+            emitOp(CompiledFilter<T>::Op::Or);
+        }
+        return true;
+    }
+
+    bool parseAnd() {
+        if (!parseUnary()) return false;
+        while (isKeyword("and")) {
+            if (!next() || !parseUnary()) return false;
+            emitOp(CompiledFilter<T>::Op::And);
+        }
+        return true;
+    }
+
+    bool parseUnary() {
+        if (isKeyword("not")) {
+            if (!next() || !parseUnary()) return false;
+            emitOp(CompiledFilter<T>::Op::Not);
+            return true;
+        }
+        if (tok == Tok::LParen) {
+            if (!next() || !parseOr()) return false;
+            if (tok != Tok::RParen) return fail("ожидалась ')'");
+            return next();
+        }
+        return parseComparison();
+    }
+
+    // Значение-литерал: число, строка или true/false
+    bool parseValue(bool isString, double& number, string& text) {
+        if (isString) {
+            if (tok != Tok::String && tok != Tok::Ident && tok != Tok::Number) return fail("ожидалась строка");
+            text = (tok == Tok::Ident || tok == Tok::Number) ? src.substr(pos - tokText.size(), tokText.size()) : tokText;
+            return next();
+        }
+        if (tok == Tok::Number) number = tokNumber;
+        else if (isKeyword("true")) number = 1;
+        else if (isKeyword("false")) number = 0;
+        else return fail("ожидалось число");
+        return next();
+    }
+
+    bool parseComparison() {
+        typedef typename CompiledFilter<T>::Op Op;
+        if (tok != Tok::Ident) return fail("ожидалось имя поля");
+        string fieldName = tokText;
+        bool isString, isBool;
+        int field = FilterFields<T>::find(fieldName, isString, isBool);
+        if (field < 0) return fail("неизвестное поле '" + fieldName + "'");
+        if (!next()) return false;
+
+        typename CompiledFilter<T>::Instr instr;
+        instr.column = isString ? out.stringColumn(field) : out.numericColumn(field);
+        instr.value = 0;
+
+        if (isKeyword("in")) {
+            if (!next()) return false;
+            if (tok != Tok::LParen) return fail("ожидалась '(' после in");
+            if (!next()) return false;
+            while (true) {
+                double number = 0;
+                string text;
+                if (!parseValue(isString, number, text)) return false;
+                if (isString) instr.texts.push_back(text);
+                else instr.set.push_back(number);
+                if (tok == Tok::Comma) { if (!next()) return false; continue; }
+                if (tok == Tok::RParen) break;
+                return fail("ожидалась ',' или ')'");
+            }
+            if (!next()) return false;
+            instr.op = isString ? Op::StrEq : Op::In;
+        }
+        else if (isKeyword("contains")) {
+            if (!isString) return fail("contains применим только к строковым полям");
+            if (!next()) return false;
+            string text;
+            double unused;
+            if (!parseValue(true, unused, text)) return false;
+            instr.texts.push_back(toLowerCopy(text));
+            instr.op = Op::StrContains;
+        }
+        else if (tok == Tok::Cmp) {
+            string cmp = tokText;
+            if (!next()) return false;
+            string text;
+            if (!parseValue(isString, instr.value, text)) return false;
+            if (isString) {
+                if (cmp != "=" && cmp != "!=") return fail("строки сравниваются только через = и !=");
+                instr.texts.push_back(text);
+                instr.op = (cmp == "=") ? Op::StrEq : Op::StrNe;
+            }
+            else {
+                instr.op = cmp == "<" ? Op::Lt : cmp == "<=" ? Op::Le : cmp == ">" ? Op::Gt :
+                    cmp == ">=" ? Op::Ge : cmp == "=" ? Op::Eq : Op::Ne;
+            }
+        }
+        else if (isBool) {
+            instr.op = Op::Truthy;
+        }
+        else {
+            return fail("ожидалось сравнение для поля '" + fieldName + "'");
+        }
+        emit(std::move(instr));
+        return true;
+    }
+};
+
+template<typename T>
+CompiledFilter<T>::CompiledFilter() : maxDepth(0) {}
+
+template<typename T>
+int CompiledFilter<T>::numericColumn(int field) {
+    auto it = std::find(numericFields.begin(), numericFields.end(), field);
+    if (it != numericFields.end()) return (int)(it - numericFields.begin());
+    numericFields.push_back(field);
+    return (int)numericFields.size() - 1;
+}
+
+template<typename T>
+int CompiledFilter<T>::stringColumn(int field) {
+    auto it = std::find(stringFields.begin(), stringFields.end(), field);
+    if (it != stringFields.end()) return (int)(it - stringFields.begin());
+    stringFields.push_back(field);
+    return (int)stringFields.size() - 1;
+}
+
+template<typename T>
+bool CompiledFilter<T>::compile(const string& expression, string& error) {
+    CompiledFilter<T> result;
+    result.text = expression;
+    FilterParser<T> parser(expression, result);
+    if (!parser.parse()) {
+        error = parser.error;
+        return false;
+    }
+    *this = std::move(result);
+    return true;
+}
+
+template<typename T>
+void CompiledFilter<T>::evaluateBatch(const T* const* items, size_t n, uint8_t* mask,
+    vector<vector<double>>& num, vector<vector<const string*>>& str, vector<vector<uint8_t>>& stack) const {
+    for (size_t c = 0; c < numericFields.size(); ++c) {
+        FilterFields<T>::gather(numericFields[c], items, n, num[c].data());
+    }
+    for (size_t c = 0; c < stringFields.size(); ++c) {
+        const string** col = str[c].data();
+        for (size_t i = 0; i < n; ++i) col[i] = &FilterFields<T>::text(stringFields[c], *items[i]);
+    }
+
+    size_t sp = 0;
+    for (const Instr& ins : program) {
+        switch (ins.op) {
+        case Op::And: {
+            --sp;
+            uint8_t* a = stack[sp - 1].data();
+            const uint8_t* b = stack[sp].data();
+            for (size_t i = 0; i < n; ++i) a[i] &= b[i];
+            break;
+        }
+        case Op::Or: {
+            --sp;
+            uint8_t* a = stack[sp - 1].data();
+            const uint8_t* b = stack[sp].data();
+            for (size_t i = 0; i < n; ++i) a[i] |= b[i];
+            break;
+        }
+        case Op::Not: {
+            uint8_t* a = stack[sp - 1].data();
+            for (size_t i = 0; i < n; ++i) a[i] ^= 1;
+            break;
+        }
+        case Op::StrEq:
+        case Op::StrNe:
+        case Op::StrContains: {
+            uint8_t* m = stack[sp++].data();
+            const string* const* col = str[ins.column].data();
+            for (size_t i = 0; i < n; ++i) {
+                bool hit = false;
+                for (const string& t : ins.texts) {
+                    hit = (ins.op == Op::StrContains) ? containsFolded(*col[i], t) : (*col[i] == t);
+                    if (hit) break;
+                }
+                m[i] = (ins.op == Op::StrNe) ? !hit : hit;
+            }
+            break;
+        }
+        default: {
+            uint8_t* m = stack[sp++].data();
+            const double* col = num[ins.column].data();
+            const double v = ins.value;
+            switch (ins.op) {
+            case Op::Lt: for (size_t i = 0; i < n; ++i) m[i] = col[i] < v; break;
+            case Op::Le: for (size_t i = 0; i < n; ++i) m[i] = col[i] <= v; break;
+            case Op::Gt: for (size_t i = 0; i < n; ++i) m[i] = col[i] > v; break;
+            case Op::Ge: for (size_t i = 0; i < n; ++i) m[i] = col[i] >= v; break;
+            case Op::Eq: for (size_t i = 0; i < n; ++i) m[i] = col[i] == v; break;
+            case Op::Ne: for (size_t i = 0; i < n; ++i) m[i] = col[i] != v; break;
+            case Op::Truthy: for (size_t i = 0; i < n; ++i) m[i] = col[i] != 0.0; break;
+            case Op::In:
+                for (size_t i = 0; i < n; ++i) m[i] = 0;
+                for (double s : ins.set) {
+                    for (size_t i = 0; i < n; ++i) m[i] |= col[i] == s;
+                }
+                break;
+            default: break;
+            }
+        }
+        }
+    }
+    memcpy(mask, stack[0].data(), n);
+}
+
+template<typename T>
+void CompiledFilter<T>::evaluate(const T* const* items, size_t count, uint8_t* mask) const {
+    if (program.empty()) {
+        memset(mask, 1, count);
+        return;
+    }
+    size_t batch = min(count, FILTER_BATCH);
+    vector<vector<double>> num(numericFields.size(), vector<double>(batch));
+    vector<vector<const string*>> str(stringFields.size(), vector<const string*>(batch));
+    vector<vector<uint8_t>> stack(maxDepth, vector<uint8_t>(batch));
+
+    for (size_t start = 0; start < count; start += FILTER_BATCH) {
+        size_t n = min(FILTER_BATCH, count - start);
+        evaluateBatch(items + start, n, mask + start, num, str, stack);
+    }
+}
+
+template<typename T>
+bool CompiledFilter<T>::matches(const T& item) const {
+    const T* p = &item;
+    uint8_t m = 0;
+    evaluate(&p, 1, &m);
+    return m != 0;
+}
+
+template class CompiledFilter<Pipe>;
+template class CompiledFilter<CS>;
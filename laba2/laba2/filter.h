@@ -0,0 +1,81 @@
+#pragma once
+#ifndef FILTER_H
+#define FILTER_H
+
+#include "entities.h"
+#include "utils.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Язык фильтров над полями сущностей, например:
+//   diameter in (700, 1000) and length > 12.5 and not inRepair
+//   idle >= 30 and class = "A"
+// Операции: = != < <= > >= in (...) contains; логика: and, or, not, скобки.
+// Поля трубы: id, name, length, diameter, inRepair (repair).
+// Поля КС: id, name, class, total, working, idle, efficiency.
+//
+// Выражение компилируется один раз в плоскую программу, которая вычисляется
+// пачками по FILTER_BATCH объектов над столбцами значений полей. Сравнения
+// чисел - простые циклы над массивами double, которые компилятор векторизует.
+
+const size_t FILTER_BATCH = 1024;
+
+template<typename T> class FilterParser;
+
+template<typename T>
+class CompiledFilter {
+public:
+    enum class Op { Lt, Le, Gt, Ge, Eq, Ne, In, StrEq, StrNe, StrContains, Truthy, And, Or, Not };
+
+    struct Instr {
+        Op op;
+        int column;                     // индекс столбца (для сравнений)
+        double value;
+        std::vector<double> set;        // для in (...)
+        std::vector<std::string> texts; // для строковых сравнений и in (...)
+    };
+
+    CompiledFilter();
+
+    // Возвращает false и текст ошибки, если выражение некорректно
+    bool compile(const std::string& expression, std::string& error);
+    bool isCompiled() const { return !program.empty(); }
+    const std::string& source() const { return text; }
+
+    // mask[i] = 1, если items[i] подходит; items.size() может быть любым
+    void evaluate(const T* const* items, size_t count, uint8_t* mask) const;
+    bool matches(const T& item) const;
+
+private:
+    std::string text;
+    std::vector<Instr> program;
+    std::vector<int> numericFields;     // поле для каждого числового столбца
+    std::vector<int> stringFields;      // поле для каждого строкового столбца
+    size_t maxDepth;
+
+    friend class FilterParser<T>;
+    int numericColumn(int field);
+    int stringColumn(int field);
+    void evaluateBatch(const T* const* items, size_t n, uint8_t* mask,
+        std::vector<std::vector<double>>& num, std::vector<std::vector<const std::string*>>& str,
+        std::vector<std::vector<uint8_t>>& stack) const;
+};
+
+// Отбор подходящих объектов: маска вычисляется пачками в нескольких потоках.
+// P - T* или const T*; порядок items сохраняется
+template<typename T, typename P>
+std::vector<P> selectMatching(const CompiledFilter<T>& filter, const std::vector<P>& items) {
+    std::vector<uint8_t> mask(items.size(), 0);
+    parallelFor(items.size(), [&](size_t begin, size_t end) {
+        filter.evaluate(items.data() + begin, end - begin, mask.data() + begin);
+    }, FILTER_BATCH);
+
+    std::vector<P> matched;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (mask[i]) matched.push_back(items[i]);
+    }
+    return matched;
+}
+
+#endif // FILTER_H
@@ -0,0 +1,494 @@
+﻿#include "flow.h"
+#include "components.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+using namespace std;
+
+namespace {
+
+// Калибровка: труба 1420 мм длиной 100 км при 7.5 -> 5.5 МПа пропускает около 90 млн м3/сут
+const double WEYMOUTH_K = 69.0;
+const double SMOOTHING = 1e-6;          // МПа^2: сглаживает корень около нулевого перепада
+const double MIN_LENGTH = 1e-3;         // км
+const double MILU_WEIGHT = 0.97;       // доля отброшенного заполнения, переносимая на диагональ
+const int SECANT_STEPS = 3;             // шагов с замороженными проводимостями перед методом Ньютона
+const size_t PARALLEL_ROWS = 20000;     // крупные компоненты считаются по одной, но с параллельными шагами
+const uint32_t NONE = UINT32_MAX;
+const size_t NO_POS = SIZE_MAX;
+
+struct Edge {
+    uint32_t from;
+    uint32_t to;
+    double k;
+    int connectionId;
+};
+
+// Задача одной компоненты связности в локальных номерах КС (по возрастанию ID)
+struct Component {
+    vector<int> csIds;
+    vector<Edge> edges;
+    vector<double> injection;
+    vector<char> source;            // нет входящих соединений
+    vector<char> fixed;             // давление задано
+    vector<double> x;               // квадраты давлений
+    vector<double> flow;            // по рёбрам
+    int iterations = 0;
+    double residual = 0.0;
+    bool converged = true;
+};
+
+// Во что превращается формула потока при вычислении небаланса:
+// Linear - q = K * dp^2, Secant - поток Веймута, но "якобиан" - проводимости q / dp^2
+// (шаг даёт решение с проводимостями, замороженными в текущей точке), Weymouth - метод Ньютона
+enum class Model { Linear, Secant, Weymouth };
+
+// Ребро в строке якобиана
+struct Incidence {
+    uint32_t edge;
+    double sign;            // +1 - газ уходит из узла, -1 - приходит
+    size_t offPos;          // внедиагональный элемент; NO_POS - у соседа давление задано
+};
+
+double maxAbs(const vector<double>& v) {
+    double m = 0.0;
+    for (double a : v) m = max(m, fabs(a));
+    return m;
+}
+
+double dot(const vector<double>& a, const vector<double>& b) {
+    double s = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) s += a[i] * b[i];
+    return s;
+}
+
+// Решатель одного потока: буферы переиспользуются от компоненты к компоненте
+class ComponentSolver {
+    Component* c = nullptr;
+    const FlowOptions& options;
+    size_t minPerThread;            // SIZE_MAX - без потоков (компоненты уже считаются параллельно)
+
+    // Строки якобиана - узлы без заданного давления в порядке исключения:
+    // от дальних от узлов с заданным давлением к ближним, для дерева разложение без заполнения
+    uint32_t rows = 0;
+    vector<uint32_t> rowOf;
+    vector<uint32_t> nodeOf;
+    vector<size_t> incOffsets;
+    vector<Incidence> incidence;
+    vector<size_t> offsets;         // якобиан (CSR, столбцы по возрастанию)
+    vector<uint32_t> cols;
+    vector<size_t> diagPos;
+    vector<double> values;
+    vector<double> factor;          // неполное LU в шаблоне якобиана
+    bool jacobi = false;            // разложение не удалось - диагональное предобуславливание
+    vector<double> q, g;            // поток и производная по рёбрам
+    // Рабочие массивы метода Ньютона, сопряжённых градиентов и построения шаблона
+    vector<double> f, fTrial, rhs, dx, trial;
+    vector<double> cgR, cgZ, cgP, cgAp;
+    vector<size_t> pos, adjOffsets;
+    vector<uint32_t> adjacent, queue, row;
+    vector<char> seen;
+
+public:
+    ComponentSolver(const FlowOptions& options, bool parallel)
+        : options(options), minPerThread(parallel ? 4096 : SIZE_MAX) {}
+
+    void solve(Component& component);
+
+private:
+    void buildPattern();
+    void evaluate(const vector<double>& x, Model model, bool jacobian, vector<double>& residual);
+    void factorize();
+    void precondition(const vector<double>& r, vector<double>& z) const;
+    void multiply(const vector<double>& v, vector<double>& out) const;
+    void solveLinear(const vector<double>& b, double relTolerance);
+};
+
+void ComponentSolver::buildPattern() {
+    uint32_t n = (uint32_t)c->csIds.size();
+    adjOffsets.assign(n + 1, 0);
+    for (const Edge& e : c->edges) {
+        ++adjOffsets[e.from + 1];
+        ++adjOffsets[e.to + 1];
+    }
+    for (uint32_t v = 0; v < n; ++v) adjOffsets[v + 1] += adjOffsets[v];
+    adjacent.resize(adjOffsets[n]);
+    {
+        vector<size_t> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+        for (uint32_t i = 0; i < c->edges.size(); ++i) {
+            adjacent[fill[c->edges[i].from]++] = i;
+            adjacent[fill[c->edges[i].to]++] = i;
+        }
+    }
+
+    // Обход в ширину от узлов с заданным давлением
+    queue.clear();
+    seen.assign(n, 0);
+    for (uint32_t v = 0; v < n; ++v) {
+        if (c->fixed[v]) {
+            queue.push_back(v);
+            seen[v] = 1;
+        }
+    }
+    for (size_t head = 0; head < queue.size(); ++head) {
+        uint32_t v = queue[head];
+        for (size_t p = adjOffsets[v]; p < adjOffsets[v + 1]; ++p) {
+            const Edge& e = c->edges[adjacent[p]];
+            uint32_t w = e.from == v ? e.to : e.from;
+            if (!seen[w]) {
+                seen[w] = 1;
+                queue.push_back(w);
+            }
+        }
+    }
+    rowOf.assign(n, NONE);
+    nodeOf.clear();
+    for (size_t i = queue.size(); i-- > 0;) {
+        if (c->fixed[queue[i]]) continue;
+        rowOf[queue[i]] = (uint32_t)nodeOf.size();
+        nodeOf.push_back(queue[i]);
+    }
+    rows = (uint32_t)nodeOf.size();
+
+    offsets.assign(rows + 1, 0);
+    cols.clear();
+    diagPos.assign(rows, 0);
+    incOffsets.assign(rows + 1, 0);
+    incidence.clear();
+    for (uint32_t r = 0; r < rows; ++r) {
+        uint32_t v = nodeOf[r];
+        row.assign(1, r);
+        for (size_t p = adjOffsets[v]; p < adjOffsets[v + 1]; ++p) {
+            const Edge& e = c->edges[adjacent[p]];
+            uint32_t w = e.from == v ? e.to : e.from;
+            if (rowOf[w] != NONE) row.push_back(rowOf[w]);
+        }
+        sort(row.begin(), row.end());
+        row.erase(unique(row.begin(), row.end()), row.end());
+        size_t base = cols.size();
+        cols.insert(cols.end(), row.begin(), row.end());
+        offsets[r + 1] = cols.size();
+        diagPos[r] = base + (lower_bound(row.begin(), row.end(), r) - row.begin());
+
+        for (size_t p = adjOffsets[v]; p < adjOffsets[v + 1]; ++p) {
+            uint32_t i = adjacent[p];
+            const Edge& e = c->edges[i];
+            uint32_t w = e.from == v ? e.to : e.from;
+            size_t offPos = rowOf[w] == NONE ? NO_POS : base + (lower_bound(row.begin(), row.end(), rowOf[w]) - row.begin());
+            incidence.push_back(Incidence{ i, e.from == v ? 1.0 : -1.0, offPos });
+        }
+        incOffsets[r + 1] = incidence.size();
+    }
+    values.assign(cols.size(), 0.0);
+    factor.assign(cols.size(), 0.0);
+}
+
+// Небаланс узлов (уходит минус подача) и, если нужно, якобиан по квадратам давлений
+void ComponentSolver::evaluate(const vector<double>& x, Model model, bool jacobian, vector<double>& residual) {
+    q.resize(c->edges.size());
+    g.resize(c->edges.size());
+    parallelFor(c->edges.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const Edge& e = c->edges[i];
+            double d = x[e.from] - x[e.to];
+            if (model == Model::Linear) {
+                q[i] = e.k * d;
+                g[i] = e.k;
+                continue;
+            }
+            double s = sqrt(fabs(d) + SMOOTHING);
+            q[i] = e.k * d / s;
+            g[i] = model == Model::Secant ? e.k / s : e.k * (0.5 * fabs(d) + SMOOTHING) / (s * s * s);
+        }
+    }, minPerThread);
+
+    residual.resize(rows);
+    parallelFor(rows, [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; ++r) {
+            double f = -c->injection[nodeOf[r]];
+            if (jacobian) fill(values.begin() + offsets[r], values.begin() + offsets[r + 1], 0.0);
+            for (size_t p = incOffsets[r]; p < incOffsets[r + 1]; ++p) {
+                const Incidence& in = incidence[p];
+                f += in.sign * q[in.edge];
+                if (!jacobian) continue;
+                values[diagPos[r]] += g[in.edge];
+                if (in.offPos != NO_POS) values[in.offPos] -= g[in.edge];
+            }
+            residual[r] = f;
+        }
+    }, minPerThread);
+}
+
+// Модифицированное неполное LU-разложение без заполнения: отброшенное заполнение
+// переносится на диагональ (с коэффициентом MILU_WEIGHT), суммы строк сохраняются -
+// для матриц вида лапласиана это заметно сокращает число итераций
+void ComponentSolver::factorize() {
+    jacobi = false;
+    factor = values;
+    pos.assign(rows, NO_POS);
+    for (uint32_t i = 0; i < rows; ++i) {
+        for (size_t p = offsets[i]; p < offsets[i + 1]; ++p) pos[cols[p]] = p;
+        for (size_t p = offsets[i]; p < diagPos[i]; ++p) {
+            uint32_t k = cols[p];
+            factor[p] /= factor[diagPos[k]];
+            for (size_t u = diagPos[k] + 1; u < offsets[k + 1]; ++u) {
+                size_t target = pos[cols[u]];
+                if (target != NO_POS) factor[target] -= factor[p] * factor[u];
+                else factor[diagPos[i]] -= MILU_WEIGHT * factor[p] * factor[u];
+            }
+        }
+        for (size_t p = offsets[i]; p < offsets[i + 1]; ++p) pos[cols[p]] = NO_POS;
+        if (!(factor[diagPos[i]] > 0.0)) {
+            jacobi = true;
+            return;
+        }
+    }
+}
+
+void ComponentSolver::precondition(const vector<double>& r, vector<double>& z) const {
+    z.resize(rows);
+    if (jacobi) {
+        for (uint32_t i = 0; i < rows; ++i) z[i] = r[i] / values[diagPos[i]];
+        return;
+    }
+    for (uint32_t i = 0; i < rows; ++i) {
+        double s = r[i];
+        for (size_t p = offsets[i]; p < diagPos[i]; ++p) s -= factor[p] * z[cols[p]];
+        z[i] = s;
+    }
+    for (uint32_t i = rows; i-- > 0;) {
+        double s = z[i];
+        for (size_t p = diagPos[i] + 1; p < offsets[i + 1]; ++p) s -= factor[p] * z[cols[p]];
+        z[i] = s / factor[diagPos[i]];
+    }
+}
+
+void ComponentSolver::multiply(const vector<double>& v, vector<double>& out) const {
+    out.resize(rows);
+    parallelFor(rows, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            double s = 0.0;
+            for (size_t p = offsets[i]; p < offsets[i + 1]; ++p) s += values[p] * v[cols[p]];
+            out[i] = s;
+        }
+    }, minPerThread);
+}
+
+// Сопряжённые градиенты с предобуславливанием; якобиан симметричен и положительно определён
+void ComponentSolver::solveLinear(const vector<double>& b, double relTolerance) {
+    dx.assign(rows, 0.0);
+    double bNorm = sqrt(dot(b, b));
+    if (bNorm == 0.0) return;
+    cgR = b;
+    precondition(cgR, cgZ);
+    cgP = cgZ;
+    double rz = dot(cgR, cgZ);
+    size_t limit = min<size_t>((size_t)rows + 100, 5000);
+    for (size_t it = 0; it < limit; ++it) {
+        multiply(cgP, cgAp);
+        double pap = dot(cgP, cgAp);
+        if (!(pap > 0.0)) break;
+        double alpha = rz / pap;
+        for (uint32_t i = 0; i < rows; ++i) {
+            dx[i] += alpha * cgP[i];
+            cgR[i] -= alpha * cgAp[i];
+        }
+        if (sqrt(dot(cgR, cgR)) <= relTolerance * bNorm) break;
+        precondition(cgR, cgZ);
+        double rzNext = dot(cgR, cgZ);
+        double beta = rzNext / rz;
+        rz = rzNext;
+        for (uint32_t i = 0; i < rows; ++i) cgP[i] = cgZ[i] + beta * cgP[i];
+    }
+}
+
+void ComponentSolver::solve(Component& component) {
+    c = &component;
+    buildPattern();
+    double base = options.deliveryPressure * options.deliveryPressure;
+    c->x.assign(c->csIds.size(), base);
+
+    auto step = [&](double relTolerance) {
+        factorize();
+        rhs.resize(rows);
+        for (uint32_t i = 0; i < rows; ++i) rhs[i] = -f[i];
+        solveLinear(rhs, relTolerance);
+    };
+
+    // Начальное приближение: линейная модель, затем несколько шагов с замороженными
+    // проводимостями - они сходятся из любой точки и убирают грубые ошибки в перепадах
+    evaluate(c->x, Model::Linear, true, f);
+    for (int i = 0; i <= SECANT_STEPS; ++i) {
+        step(1e-2);
+        for (uint32_t r = 0; r < rows; ++r) c->x[nodeOf[r]] += dx[r];
+        evaluate(c->x, Model::Secant, true, f);
+    }
+
+    // Неточный метод Ньютона: точность линейного шага растёт по мере сходимости
+    // (правило Айзенштата - Уокера), вдали от решения хватает грубого шага
+    c->iterations = 0;
+    evaluate(c->x, Model::Weymouth, true, f);
+    double norm = sqrt(dot(f, f)), forcing = 0.5;
+    while (maxAbs(f) > options.tolerance && c->iterations < options.maxIterations) {
+        ++c->iterations;
+        // Линейный шаг точнее десятой доли допустимого небаланса не нужен
+        step(max(forcing, 0.1 * options.tolerance / norm));
+        // Дробление шага, пока небаланс не уменьшится
+        double t = 1.0, trialNorm;
+        trial = c->x;
+        for (;;) {
+            for (uint32_t i = 0; i < rows; ++i) trial[nodeOf[i]] = c->x[nodeOf[i]] + t * dx[i];
+            evaluate(trial, Model::Weymouth, false, fTrial);
+            trialNorm = sqrt(dot(fTrial, fTrial));
+            if (trialNorm < (1.0 - 1e-4 * t) * norm || t < 1e-3) break;
+            t *= 0.5;
+        }
+        c->x.swap(trial);
+        evaluate(c->x, Model::Weymouth, true, f);
+        double ratio = trialNorm / norm;
+        double next = 0.9 * ratio * ratio;
+        if (0.9 * forcing * forcing > 0.1) next = max(next, 0.9 * forcing * forcing);
+        forcing = min(next, 0.5);
+        norm = trialNorm;
+    }
+    c->residual = maxAbs(f);
+    c->converged = c->residual <= options.tolerance;
+    c->flow = q;
+}
+
+} // namespace
+
+const char* flowRoleName(FlowRole role) {
+    switch (role) {
+    case FlowRole::Source: return "source";
+    case FlowRole::Delivery: return "delivery";
+    default: return "transit";
+    }
+}
+
+const StationFlow* FlowResult::findStation(int csId) const {
+    auto it = lower_bound(stations.begin(), stations.end(), csId,
+        [](const StationFlow& s, int id) { return s.csId < id; });
+    return it != stations.end() && it->csId == csId ? &*it : nullptr;
+}
+
+const ConnectionFlow* FlowResult::findConnection(int id) const {
+    auto it = lower_bound(connections.begin(), connections.end(), id,
+        [](const ConnectionFlow& f, int key) { return f.connectionId < key; });
+    return it != connections.end() && it->connectionId == id ? &*it : nullptr;
+}
+
+size_t FlowResult::overloadedCount() const {
+    return (size_t)count_if(stations.begin(), stations.end(), [](const StationFlow& s) { return s.overloaded(); });
+}
+
+FlowResult solveFlow(const StorageSnapshot& snap, const FlowOptions& options) {
+    // Рёбра с ID КС вместо локальных номеров; КС нумеруются плотно (ComponentIndex),
+    // поэтому память не зависит от величины ID
+    vector<Edge> edges;
+    ComponentIndex index;
+    if (snap.connections) {
+        snap.connections->forEach([&](const Connection& conn) {
+            if (!conn.isActive || conn.csInId < 0 || conn.csOutId < 0 || conn.csInId == conn.csOutId) return;
+            const Pipe* pipe = snap.findPipe(conn.pipeId);
+            if (!pipe || pipe->isInRepair()) return;
+            if (!snap.findCS(conn.csInId) || !snap.findCS(conn.csOutId)) return;
+            double d = pipe->getDiameter() / 1000.0;
+            double k = WEYMOUTH_K * pow(d, 8.0 / 3.0) / sqrt(max(pipe->getLength(), MIN_LENGTH));
+            edges.push_back(Edge{ (uint32_t)conn.csInId, (uint32_t)conn.csOutId, k, conn.id });
+            index.addEdge(conn.csInId, conn.csOutId);
+        });
+    }
+
+    vector<int> label;
+    size_t count = index.label(label);
+    const vector<int>& ids = index.vertexIds();
+    vector<Component> parts(count);
+    for (size_t v = 0; v < ids.size(); ++v) parts[label[v]].csIds.push_back(ids[v]);
+    for (const Edge& e : edges) parts[label[index.vertexOf((int)e.from)]].edges.push_back(e);
+    vector<Edge>().swap(edges);
+
+    // Локальные номера (по возрастанию ID), роли узлов и подача источников
+    parallelFor(count, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            Component& c = parts[k];
+            sort(c.csIds.begin(), c.csIds.end());
+            auto local = [&c](uint32_t id) {
+                return (uint32_t)(lower_bound(c.csIds.begin(), c.csIds.end(), (int)id) - c.csIds.begin());
+            };
+            size_t n = c.csIds.size();
+            vector<char> hasIn(n, 0), hasOut(n, 0);
+            for (Edge& e : c.edges) {
+                e.from = local(e.from);
+                e.to = local(e.to);
+                hasOut[e.from] = 1;
+                hasIn[e.to] = 1;
+            }
+            c.injection.assign(n, 0.0);
+            c.source.assign(n, 0);
+            c.fixed.assign(n, 0);
+            bool anyFixed = false;
+            for (size_t v = 0; v < n; ++v) {
+                if (!hasIn[v]) {
+                    c.source[v] = 1;
+                    c.injection[v] = snap.findCS(c.csIds[v])->getWorkshopsWorking() * options.workshopCapacity;
+                }
+                if (!hasOut[v]) {
+                    c.fixed[v] = 1;
+                    anyFixed = true;
+                }
+            }
+            // Без потребителей давление задаётся на КС с наименьшим ID, в которую газ приходит
+            for (size_t v = 0; v < n && !anyFixed; ++v) {
+                if (hasIn[v]) {
+                    c.fixed[v] = 1;
+                    anyFixed = true;
+                }
+            }
+        }
+    }, 1);
+
+    vector<size_t> small, large;
+    for (size_t k = 0; k < count; ++k) (parts[k].csIds.size() >= PARALLEL_ROWS ? large : small).push_back(k);
+    parallelFor(small.size(), [&](size_t begin, size_t end) {
+        ComponentSolver solver(options, false);
+        for (size_t i = begin; i < end; ++i) solver.solve(parts[small[i]]);
+    }, 1);
+    ComponentSolver solver(options, true);
+    for (size_t k : large) solver.solve(parts[k]);
+
+    FlowResult result;
+    result.components = count;
+    for (const Component& c : parts) {
+        result.converged = result.converged && c.converged;
+        result.iterations = max(result.iterations, c.iterations);
+        result.residual = max(result.residual, c.residual);
+
+        size_t first = result.stations.size();
+        for (size_t v = 0; v < c.csIds.size(); ++v) {
+            StationFlow s;
+            s.csId = c.csIds[v];
+            s.role = c.fixed[v] ? FlowRole::Delivery : c.source[v] ? FlowRole::Source : FlowRole::Transit;
+            s.pressure = sqrt(max(c.x[v], 0.0));
+            s.throughput = c.injection[v];
+            s.capacity = snap.findCS(s.csId)->getWorkshopsWorking() * options.workshopCapacity;
+            result.stations.push_back(s);
+            result.supplied += c.injection[v];
+        }
+        for (size_t i = 0; i < c.edges.size(); ++i) {
+            const Edge& e = c.edges[i];
+            double f = c.flow[i];
+            result.stations[first + (f > 0.0 ? e.to : e.from)].throughput += fabs(f);
+            if (c.fixed[e.to]) result.delivered += f;
+            if (c.fixed[e.from]) result.delivered -= f;
+            result.connections.push_back(ConnectionFlow{ e.connectionId, f });
+        }
+    }
+    sort(result.stations.begin(), result.stations.end(),
+        [](const StationFlow& a, const StationFlow& b) { return a.csId < b.csId; });
+    sort(result.connections.begin(), result.connections.end(),
+        [](const ConnectionFlow& a, const ConnectionFlow& b) { return a.connectionId < b.connectionId; });
+    return result;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#ifndef FLOW_H
+#define FLOW_H
+
+#include "snapshot.h"
+#include <vector>
+#include <cstddef>
+
+// Установившийся режим течения газа по сети. Модель:
+//  - ребро - активное соединение между существующими КС, труба которого не в ремонте;
+//    поток по формуле Веймута Q = K * D^(8/3) * sqrt((p_in^2 - p_out^2) / L)
+//    (Q - млн м3/сут, D - м, L - км, p - МПа); поток против направления соединения отрицателен;
+//  - КС без входящих соединений - источники: подают мощность работающих цехов;
+//  - КС без исходящих соединений - потребители с заданным давлением;
+//    в компоненте без них давление задаётся на КС с наименьшим ID, в которую приходит газ;
+//  - остальные КС транзитные: сколько газа пришло, столько ушло.
+// Неизвестные - квадраты давлений; система решается неточным методом Ньютона по
+// разреженному якобиану, линейные шаги - методом сопряжённых градиентов с модифицированным
+// неполным LU-разложением. Компоненты связности независимы и считаются параллельно.
+
+struct FlowOptions {
+    double deliveryPressure = 5.5;      // МПа на КС-потребителях
+    double workshopCapacity = 3.0;      // млн м3/сут на один работающий цех
+    double tolerance = 1e-6;            // допустимый небаланс в узле, млн м3/сут
+    int maxIterations = 50;             // итераций Ньютона на компоненту
+
+    bool operator==(const FlowOptions& o) const {
+        return deliveryPressure == o.deliveryPressure && workshopCapacity == o.workshopCapacity &&
+            tolerance == o.tolerance && maxIterations == o.maxIterations;
+    }
+};
+
+enum class FlowRole { Source, Transit, Delivery };
+
+const char* flowRoleName(FlowRole role);
+
+struct StationFlow {
+    int csId = 0;
+    FlowRole role = FlowRole::Transit;
+    double pressure = 0.0;      // МПа
+    double throughput = 0.0;    // поступает газа (подача источника + входящие потоки), млн м3/сут
+    double capacity = 0.0;      // мощность работающих цехов, млн м3/сут
+
+    bool overloaded() const { return throughput > capacity * (1.0 + 1e-9) + 1e-9; }
+};
+
+struct ConnectionFlow {
+    int connectionId = 0;
+    double flow = 0.0;          // млн м3/сут
+};
+
+struct FlowResult {
+    bool converged = true;
+    int iterations = 0;         // наибольшее число итераций Ньютона среди компонент
+    double residual = 0.0;      // наибольший небаланс в узле, млн м3/сут
+    size_t components = 0;
+    double supplied = 0.0;
+    double delivered = 0.0;
+    std::vector<StationFlow> stations;          // по возрастанию ID КС; только КС с соединениями
+    std::vector<ConnectionFlow> connections;    // по возрастанию ID соединения
+
+    const StationFlow* findStation(int csId) const;
+    const ConnectionFlow* findConnection(int id) const;
+    size_t overloadedCount() const;
+};
+
+FlowResult solveFlow(const StorageSnapshot& snap, const FlowOptions& options = FlowOptions());
+
+#endif // FLOW_H
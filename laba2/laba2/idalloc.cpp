@@ -0,0 +1,111 @@
+﻿#include "idalloc.h"
+
+using namespace std;
+
+const char* idPolicyName(IdPolicy policy) {
+    return policy == IdPolicy::Reuse ? "reuse" : "stable";
+}
+
+int IdAllocator::allocate() {
+    lock_guard<mutex> guard(lock);
+    if (policy == IdPolicy::Stable || freeRanges.empty()) {
+        if (exhausted) return 0;
+        int id = nextId;
+        advancePast(id);
+        return id;
+    }
+    auto it = freeRanges.begin();
+    int id = it->first;
+    int end = it->second;
+    auto hint = freeRanges.erase(it);
+    if (id + 1 < end) freeRanges.emplace_hint(hint, id + 1, end);
+    --freeCount;
+    return id;
+}
+
+// Вызывается под блокировкой
+void IdAllocator::removeFree(int id) {
+    auto it = freeRanges.upper_bound(id);
+    if (it == freeRanges.begin()) return;
+    --it;
+    int begin = it->first;
+    int end = it->second;
+    if (id >= end) return;
+    auto hint = freeRanges.erase(it);
+    if (id + 1 < end) hint = freeRanges.emplace_hint(hint, id + 1, end);
+    if (begin < id) freeRanges.emplace_hint(hint, begin, id);
+    --freeCount;
+}
+
+void IdAllocator::claim(int id) {
+    if (id <= 0) return;
+    lock_guard<mutex> guard(lock);
+    if (id < nextId || exhausted) {
+        removeFree(id);
+        return;
+    }
+    if (id > nextId) {
+        // Дыра сливается с последним свободным диапазоном, если он заканчивается на nextId
+        auto last = freeRanges.empty() ? freeRanges.end() : prev(freeRanges.end());
+        if (last != freeRanges.end() && last->second == nextId) last->second = id;
+        else freeRanges.emplace_hint(freeRanges.end(), nextId, id);
+        freeCount += (size_t)(id - nextId);
+    }
+    advancePast(id);
+}
+
+void IdAllocator::release(int id) {
+    if (id <= 0) return;
+    lock_guard<mutex> guard(lock);
+    // INT_MAX после исчерпания не освобождается: диапазон [INT_MAX, INT_MAX + 1) не представим
+    if (id >= nextId) return;
+    auto next = freeRanges.upper_bound(id);
+    if (next != freeRanges.begin()) {
+        auto before = prev(next);
+        if (id < before->second) return;    // уже свободен
+        if (before->second == id) {
+            before->second = id + 1;
+            if (next != freeRanges.end() && next->first == id + 1) {
+                before->second = next->second;
+                freeRanges.erase(next);
+            }
+            ++freeCount;
+            return;
+        }
+    }
+    if (next != freeRanges.end() && next->first == id + 1) {
+        int end = next->second;
+        freeRanges.emplace_hint(freeRanges.erase(next), id, end);
+    }
+    else {
+        freeRanges.emplace_hint(next, id, id + 1);
+    }
+    ++freeCount;
+}
+
+void IdAllocator::setPolicy(IdPolicy p) {
+    lock_guard<mutex> guard(lock);
+    policy = p;
+}
+
+IdPolicy IdAllocator::getPolicy() const {
+    lock_guard<mutex> guard(lock);
+    return policy;
+}
+
+int IdAllocator::peekNext() const {
+    lock_guard<mutex> guard(lock);
+    if (policy == IdPolicy::Reuse && !freeRanges.empty()) return freeRanges.begin()->first;
+    return exhausted ? 0 : nextId;
+}
+
+size_t IdAllocator::freeIds() const {
+    lock_guard<mutex> guard(lock);
+    return freeCount;
+}
+
+size_t IdAllocator::available() const {
+    lock_guard<mutex> guard(lock);
+    size_t tail = exhausted ? 0 : (size_t)numeric_limits<int>::max() - (size_t)nextId + 1;
+    return policy == IdPolicy::Reuse ? tail + freeCount : tail;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#ifndef IDALLOC_H
+#define IDALLOC_H
+
+#include <map>
+#include <mutex>
+#include <limits>
+#include <cstddef>
+
+// Политика выдачи ID. Reuse - сначала наименьший освободившийся ID, чтобы
+// пространство ID оставалось плотным; Stable - только новые ID (для аудита:
+// удалённый ID больше никогда не появится)
+enum class IdPolicy { Reuse, Stable };
+
+const char* idPolicyName(IdPolicy policy);
+
+// Выдача ID для труб, КС и соединений. Свободные ID хранятся диапазонами
+// [начало, конец), поэтому и редкие пропуски, и огромные дыры стоят одинаково.
+// Список свободных ведётся при любой политике, политика влияет только на allocate()
+class IdAllocator {
+    mutable std::mutex lock;
+    int nextId = 1;                     // все ID >= nextId свободны, если не exhausted
+    bool exhausted = false;             // занят INT_MAX: за nextId свободных ID нет
+    std::map<int, int> freeRanges;      // начало -> конец (не включая)
+    size_t freeCount = 0;
+    IdPolicy policy = IdPolicy::Stable;
+
+    void removeFree(int id);
+    // nextId = id + 1 без переполнения: после INT_MAX новых ID не остаётся
+    void advancePast(int id) {
+        if (id == std::numeric_limits<int>::max()) {
+            nextId = id;
+            exhausted = true;
+        }
+        else {
+            nextId = id + 1;
+        }
+    }
+
+public:
+    // 0, если пространство ID исчерпано
+    int allocate();
+    // ID занят явно (загрузка, добавление с заданным ID); пропущенные ID ниже него становятся свободными
+    void claim(int id);
+    // ID больше не используется
+    void release(int id);
+    // Состояние по существующим ID; forEachId(fn) перечисляет их по возрастанию
+    template<typename F>
+    void rebuild(F forEachId) {
+        std::lock_guard<std::mutex> guard(lock);
+        freeRanges.clear();
+        freeCount = 0;
+        nextId = 1;
+        exhausted = false;
+        forEachId([this](int id) {
+            if (id < nextId || exhausted) return;
+            if (id > nextId) {
+                freeRanges.emplace_hint(freeRanges.end(), nextId, id);
+                freeCount += (size_t)(id - nextId);
+            }
+            advancePast(id);
+        });
+    }
+
+    void setPolicy(IdPolicy p);
+    IdPolicy getPolicy() const;
+    // ID, который выдаст allocate(); 0, если выдавать нечего
+    int peekNext() const;
+    size_t freeIds() const;
+    // Сколько ID ещё может выдать allocate() при текущей политике
+    size_t available() const;
+};
+
+#endif // IDALLOC_H
@@ -0,0 +1,253 @@
+﻿#include "lazysnapshot.h"
+#include "utils.h"
+#include <fstream>
+#include <vector>
+#include <cstring>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const size_t INDEX_ENTRY_SIZE = 16;
+static const size_t FOOTER_SIZE = 7 * 8 + 8;
+
+// Запись таблицы: данные записей пишутся в поток, индекс копится в памяти
+template<typename T, typename Each>
+static bool writeRecords(ostream& os, uint64_t& pos, string& index, Each each) {
+    const size_t flushSize = 64 * 1024;
+    string buf;
+    buf.reserve(flushSize + 256);
+    each([&](const T& item) {
+        size_t start = buf.size();
+        BinaryCodec<T>::encode(item, buf);
+        schema_binary::appendRaw<int32_t>(index, item.getId());
+        schema_binary::appendRaw<uint32_t>(index, (uint32_t)(buf.size() - start));
+        schema_binary::appendRaw<uint64_t>(index, pos + start);
+        if (buf.size() >= flushSize) {
+            os.write(buf.data(), buf.size());
+            pos += buf.size();
+            buf.clear();
+        }
+    });
+    os.write(buf.data(), buf.size());
+    pos += buf.size();
+    return (bool)os;
+}
+
+bool writeIndexedSnapshot(const StorageSnapshot& snap, const string& filename) {
+    return writeFileAtomically(filename, [&](ostream& os) {
+        uint64_t pos = 8;
+        os.write(INDEXED_SNAPSHOT_MAGIC, 8);
+        string pipeIdx, csIdx, connIdx;
+        writeRecords<Pipe>(os, pos, pipeIdx, [&](auto&& fn) { if (snap.pipes) snap.pipes->forEach(fn); });
+        writeRecords<CS>(os, pos, csIdx, [&](auto&& fn) { if (snap.stations) snap.stations->forEach(fn); });
+        writeRecords<Connection>(os, pos, connIdx, [&](auto&& fn) { if (snap.connections) snap.connections->forEach(fn); });
+
+        // Индексы выравниваются на 8 байт
+        static const char zeros[8] = {};
+        os.write(zeros, (8 - pos % 8) % 8);
+        pos += (8 - pos % 8) % 8;
+
+        string footer;
+        for (const string* idx : { &pipeIdx, &csIdx, &connIdx }) {
+            schema_binary::appendRaw<uint64_t>(footer, pos);
+            schema_binary::appendRaw<uint64_t>(footer, idx->size() / INDEX_ENTRY_SIZE);
+            os.write(idx->data(), idx->size());
+            pos += idx->size();
+        }
+        schema_binary::appendRaw<uint64_t>(footer, snap.version);
+        footer.append(INDEXED_SNAPSHOT_MAGIC, 8);
+        os.write(footer.data(), footer.size());
+        return (bool)os;
+    }, true);
+}
+
+bool isIndexedSnapshot(const string& filename) {
+    ifstream f(filename, ios::binary);
+    char magic[8];
+    return f.read(magic, 8) && memcmp(magic, INDEXED_SNAPSHOT_MAGIC, 8) == 0;
+}
+
+// MappedFile
+#if defined(_WIN32)
+MappedFile::MappedFile() : data(nullptr), length(0), fileHandle(nullptr), mappingHandle(nullptr) {}
+#else
+MappedFile::MappedFile() : data(nullptr), length(0) {}
+#endif
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const string& filename) {
+    close();
+#if defined(_WIN32)
+    HANDLE f = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(f, &size) || size.QuadPart == 0) {
+        CloseHandle(f);
+        return false;
+    }
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = m ? MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (m) CloseHandle(m);
+        CloseHandle(f);
+        return false;
+    }
+    fileHandle = f;
+    mappingHandle = m;
+    data = static_cast<const char*>(view);
+    length = (size_t)size.QuadPart;
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) return false;
+    data = static_cast<const char*>(view);
+    length = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (!data) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(data);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    fileHandle = mappingHandle = nullptr;
+#else
+    munmap(const_cast<char*>(data), length);
+#endif
+    data = nullptr;
+    length = 0;
+}
+
+// LazySnapshot
+LazySnapshot::LazySnapshot(size_t cacheCapacity)
+    : pipeCache(cacheCapacity), csCache(cacheCapacity), connectionCache(cacheCapacity) {}
+
+bool LazySnapshot::open(const string& filename, string& error) {
+    close();
+    if (!file.open(filename)) {
+        error = "не удалось открыть файл " + filename;
+        return false;
+    }
+    const char* base = file.begin();
+    size_t size = file.size();
+    if (size < 8 + FOOTER_SIZE || memcmp(base, INDEXED_SNAPSHOT_MAGIC, 8) != 0 ||
+        memcmp(base + size - 8, INDEXED_SNAPSHOT_MAGIC, 8) != 0) {
+        error = "файл " + filename + " не является индексированным снимком";
+        close();
+        return false;
+    }
+
+    const char* p = base + size - FOOTER_SIZE;
+    const char* end = base + size;
+    for (TableIndex* t : { &pipeIndex, &csIndex, &connectionIndex }) {
+        schema_binary::readRaw(p, end, t->offset);
+        schema_binary::readRaw(p, end, t->count);
+        if (t->offset > size - FOOTER_SIZE || t->count > (size - FOOTER_SIZE - t->offset) / INDEX_ENTRY_SIZE) {
+            error = "повреждено оглавление файла " + filename;
+            close();
+            return false;
+        }
+    }
+    uint64_t version = 0;
+    schema_binary::readRaw(p, end, version);
+    savedVersion = version;
+    return true;
+}
+
+void LazySnapshot::close() {
+    file.close();
+    pipeIndex = csIndex = connectionIndex = TableIndex();
+    savedVersion = 0;
+    lock_guard<mutex> lock(cacheMutex);
+    pipeCache.clear();
+    csCache.clear();
+    connectionCache.clear();
+    decoded = 0;
+}
+
+const char* LazySnapshot::indexEntry(const TableIndex& index, size_t i, int& id, size_t& length) const {
+    const char* e = file.begin() + index.offset + i * INDEX_ENTRY_SIZE;
+    int32_t entryId;
+    uint32_t entryLength;
+    uint64_t offset;
+    memcpy(&entryId, e, 4);
+    memcpy(&entryLength, e + 4, 4);
+    memcpy(&offset, e + 8, 8);
+    id = entryId;
+    // Запись за пределами файла читается как пустая и не декодируется;
+    // сравнение без сложения, чтобы огромное смещение не переполнилось
+    length = offset <= file.size() && entryLength <= file.size() - offset ? entryLength : 0;
+    return file.begin() + (length ? offset : 0);
+}
+
+bool LazySnapshot::locate(const TableIndex& index, int id, const char*& record, size_t& length) const {
+    size_t lo = 0, hi = (size_t)index.count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int midId;
+        size_t midLength;
+        const char* p = indexEntry(index, mid, midId, midLength);
+        if (midId == id) {
+            record = p;
+            length = midLength;
+            return true;
+        }
+        if (midId < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return false;
+}
+
+template<typename T>
+shared_ptr<const T> LazySnapshot::fetch(const TableIndex& index, LruCache<T>& cache, int id) const {
+    if (!isOpen()) return nullptr;
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        if (shared_ptr<const T> hit = cache.get(id)) return hit;
+    }
+    const char* record;
+    size_t length;
+    if (!locate(index, id, record, length)) return nullptr;
+    shared_ptr<T> item = make_shared<T>();
+    if (!BinaryCodec<T>::decode(record, record + length, *item)) return nullptr;
+
+    lock_guard<mutex> lock(cacheMutex);
+    cache.put(id, item);
+    ++decoded;
+    return item;
+}
+
+shared_ptr<const Pipe> LazySnapshot::findPipeById(int id) const { return fetch(pipeIndex, pipeCache, id); }
+shared_ptr<const CS> LazySnapshot::findCSById(int id) const { return fetch(csIndex, csCache, id); }
+shared_ptr<const Connection> LazySnapshot::findConnectionById(int id) const {
+    return fetch(connectionIndex, connectionCache, id);
+}
+
+size_t LazySnapshot::decodedCount() const {
+    lock_guard<mutex> lock(cacheMutex);
+    return decoded;
+}
+
+size_t LazySnapshot::cachedCount() const {
+    lock_guard<mutex> lock(cacheMutex);
+    return pipeCache.size() + csCache.size() + connectionCache.size();
+}
@@ -0,0 +1,150 @@
+#pragma once
+#ifndef LAZYSNAPSHOT_H
+#define LAZYSNAPSHOT_H
+
+#include "entities.h"
+#include "network.h"
+#include "snapshot.h"
+#include "schema.h"
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Индексированный снимок: записи в бинарном виде (BinaryCodec), за ними по таблице
+// отсортированный индекс ID -> смещение, в конце файла - оглавление фиксированного размера.
+// Открытие читает только оглавление, поэтому время до первого запроса не зависит
+// от размера файла.
+const char INDEXED_SNAPSHOT_MAGIC[9] = "GTSNAP01";
+
+bool writeIndexedSnapshot(const StorageSnapshot& snap, const std::string& filename);
+// true, если файл начинается с INDEXED_SNAPSHOT_MAGIC
+bool isIndexedSnapshot(const std::string& filename);
+
+// Файл, отображённый в память только для чтения
+class MappedFile {
+    const char* data;
+    size_t length;
+#if defined(_WIN32)
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& filename);
+    void close();
+    const char* begin() const { return data; }
+    size_t size() const { return length; }
+};
+
+// Ограниченный кэш последних прочитанных записей (вытесняется давно не использованная)
+template<typename T>
+class LruCache {
+    typedef std::pair<int, std::shared_ptr<const T>> Entry;
+    std::list<Entry> order;     // в начале - последние использованные
+    std::unordered_map<int, typename std::list<Entry>::iterator> byId;
+    size_t capacity;
+
+public:
+    explicit LruCache(size_t cap = 1024) : capacity(cap ? cap : 1) {}
+
+    std::shared_ptr<const T> get(int id) {
+        auto it = byId.find(id);
+        if (it == byId.end()) return nullptr;
+        order.splice(order.begin(), order, it->second);
+        return it->second->second;
+    }
+
+    void put(int id, std::shared_ptr<const T> item) {
+        order.emplace_front(id, std::move(item));
+        byId[id] = order.begin();
+        if (order.size() > capacity) {
+            byId.erase(order.back().first);
+            order.pop_back();
+        }
+    }
+
+    void clear() { order.clear(); byId.clear(); }
+    size_t size() const { return order.size(); }
+    void setCapacity(size_t cap) {
+        capacity = cap ? cap : 1;
+        while (order.size() > capacity) {
+            byId.erase(order.back().first);
+            order.pop_back();
+        }
+    }
+};
+
+// Ленивое чтение индексированного снимка: запись декодируется при первом обращении
+// и попадает в кэш. Возвращаемые объекты остаются действительными и после вытеснения.
+class LazySnapshot {
+    struct TableIndex {
+        uint64_t offset = 0;    // начало индекса: count записей {int32 ID, uint32 длина, uint64 смещение}
+        uint64_t count = 0;
+    };
+
+    MappedFile file;
+    TableIndex pipeIndex, csIndex, connectionIndex;
+    unsigned long long savedVersion = 0;
+
+    mutable std::mutex cacheMutex;  // кэши меняются при чтении
+    mutable LruCache<Pipe> pipeCache;
+    mutable LruCache<CS> csCache;
+    mutable LruCache<Connection> connectionCache;
+    mutable size_t decoded = 0;
+
+    // Двоичный поиск по отображённому индексу; false - ID нет
+    bool locate(const TableIndex& index, int id, const char*& record, size_t& length) const;
+    template<typename T>
+    std::shared_ptr<const T> fetch(const TableIndex& index, LruCache<T>& cache, int id) const;
+
+public:
+    explicit LazySnapshot(size_t cacheCapacity = 4096);
+
+    bool open(const std::string& filename, std::string& error);
+    void close();
+    bool isOpen() const { return file.begin() != nullptr; }
+
+    std::shared_ptr<const Pipe> findPipeById(int id) const;
+    std::shared_ptr<const CS> findCSById(int id) const;
+    std::shared_ptr<const Connection> findConnectionById(int id) const;
+
+    // Полный проход по таблице по возрастанию ID, без кэша (загрузка целиком)
+    template<typename F> void forEachPipe(F fn) const { scan<Pipe>(pipeIndex, fn); }
+    template<typename F> void forEachCS(F fn) const { scan<CS>(csIndex, fn); }
+    template<typename F> void forEachConnection(F fn) const { scan<Connection>(connectionIndex, fn); }
+
+    size_t pipeCount() const { return (size_t)pipeIndex.count; }
+    size_t csCount() const { return (size_t)csIndex.count; }
+    size_t connectionCount() const { return (size_t)connectionIndex.count; }
+    unsigned long long version() const { return savedVersion; }
+    size_t fileSize() const { return file.size(); }
+    size_t decodedCount() const;
+    size_t cachedCount() const;
+
+private:
+    template<typename T, typename F>
+    void scan(const TableIndex& index, F fn) const;
+    const char* indexEntry(const TableIndex& index, size_t i, int& id, size_t& length) const;
+};
+
+template<typename T, typename F>
+void LazySnapshot::scan(const TableIndex& index, F fn) const {
+    for (size_t i = 0; i < index.count; ++i) {
+        int id;
+        size_t length;
+        const char* p = indexEntry(index, i, id, length);
+        T item;
+        if (BinaryCodec<T>::decode(p, p + length, item)) fn(item);
+    }
+}
+
+#endif // LAZYSNAPSHOT_H
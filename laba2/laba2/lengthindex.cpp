@@ -0,0 +1,107 @@
+﻿#include "lengthindex.h"
+#include <algorithm>
+
+using namespace std;
+
+// Первый блок, последняя запись которого не меньше e (или последний блок)
+size_t LengthIndex::Column::blockFor(const Entry& e) const {
+    size_t b = (size_t)(lower_bound(fences.begin(), fences.end(), e) - fences.begin());
+    return b < blocks.size() ? b : blocks.size() - 1;
+}
+
+void LengthIndex::Column::insert(const Entry& e) {
+    ++count;
+    if (blocks.empty()) {
+        blocks.emplace_back(1, e);
+        fences.push_back(e);
+        return;
+    }
+    size_t b = blockFor(e);
+    vector<Entry>& block = blocks[b];
+    block.insert(upper_bound(block.begin(), block.end(), e), e);
+    fences[b] = block.back();
+
+    if (block.size() > 2 * LENGTH_BLOCK) {
+        vector<Entry> tail(block.begin() + LENGTH_BLOCK, block.end());
+        block.resize(LENGTH_BLOCK);
+        fences[b] = block.back();
+        fences.insert(fences.begin() + b + 1, tail.back());
+        blocks.insert(blocks.begin() + b + 1, std::move(tail));
+    }
+}
+
+bool LengthIndex::Column::erase(const Entry& e) {
+    if (blocks.empty()) return false;
+    size_t b = blockFor(e);
+    vector<Entry>& block = blocks[b];
+    auto it = lower_bound(block.begin(), block.end(), e);
+    if (it == block.end() || !(*it == e)) return false;
+    block.erase(it);
+    --count;
+    if (block.empty()) {
+        blocks.erase(blocks.begin() + b);
+        fences.erase(fences.begin() + b);
+    }
+    else {
+        fences[b] = block.back();
+    }
+    return true;
+}
+
+void LengthIndex::Column::range(double minLength, double maxLength, vector<int>& out) const {
+    auto fit = lower_bound(fences.begin(), fences.end(), minLength,
+        [](const Entry& f, double key) { return f.length < key; });
+    for (size_t b = (size_t)(fit - fences.begin()); b < blocks.size(); ++b) {
+        const vector<Entry>& block = blocks[b];
+        auto it = lower_bound(block.begin(), block.end(), minLength,
+            [](const Entry& x, double key) { return x.length < key; });
+        for (; it != block.end(); ++it) {
+            if (it->length > maxLength) return;
+            out.push_back(it->id);
+        }
+    }
+}
+
+void LengthIndex::insert(int diameter, double length, int id) {
+    columns[diameter].insert(Entry{ length, id });
+}
+
+void LengthIndex::erase(int diameter, double length, int id) {
+    auto it = columns.find(diameter);
+    if (it == columns.end()) return;
+    it->second.erase(Entry{ length, id });
+    if (it->second.count == 0) columns.erase(it);
+}
+
+void LengthIndex::build(vector<pair<int, Entry>>& items) {
+    columns.clear();
+    sort(items.begin(), items.end(), [](const pair<int, Entry>& a, const pair<int, Entry>& b) {
+        return a.first < b.first || (a.first == b.first && a.second < b.second);
+    });
+    for (size_t i = 0; i < items.size();) {
+        Column& col = columns[items[i].first];
+        size_t j = i;
+        while (j < items.size() && items[j].first == items[i].first) ++j;
+        for (size_t k = i; k < j; k += LENGTH_BLOCK) {
+            size_t end = min(j, k + LENGTH_BLOCK);
+            vector<Entry> block;
+            block.reserve(2 * LENGTH_BLOCK + 1);
+            for (size_t m = k; m < end; ++m) block.push_back(items[m].second);
+            col.fences.push_back(block.back());
+            col.blocks.push_back(std::move(block));
+        }
+        col.count = j - i;
+        i = j;
+    }
+}
+
+void LengthIndex::range(double minLength, double maxLength, int diameter, vector<int>& out) const {
+    out.clear();
+    if (minLength > maxLength) return;
+    if (diameter > 0) {
+        auto it = columns.find(diameter);
+        if (it != columns.end()) it->second.range(minLength, maxLength, out);
+        return;
+    }
+    for (const auto& pair : columns) pair.second.range(minLength, maxLength, out);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef LENGTHINDEX_H
+#define LENGTHINDEX_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+
+// Индекс длин труб для интервальных запросов: для каждого диаметра -
+// отсортированный массив (длина, ID), разбитый на блоки до 2 * LENGTH_BLOCK
+// записей. Последние записи блоков лежат отдельным массивом, по нему блок
+// находится двоичным поиском; вставка и удаление сдвигают только один блок.
+// Запрос [min, max] - O(log N + k).
+const size_t LENGTH_BLOCK = 128;
+
+class LengthIndex {
+public:
+    struct Entry {
+        double length;
+        int id;
+        bool operator<(const Entry& other) const {
+            return length < other.length || (length == other.length && id < other.id);
+        }
+        bool operator==(const Entry& other) const { return length == other.length && id == other.id; }
+    };
+
+private:
+    struct Column {
+        std::vector<std::vector<Entry>> blocks;
+        std::vector<Entry> fences;      // последняя (наибольшая) запись каждого блока
+        size_t count = 0;
+
+        size_t blockFor(const Entry& e) const;
+        void insert(const Entry& e);
+        bool erase(const Entry& e);
+        void range(double minLength, double maxLength, std::vector<int>& out) const;
+    };
+
+    std::unordered_map<int, Column> columns;    // по диаметру
+
+public:
+    void insert(int diameter, double length, int id);
+    void erase(int diameter, double length, int id);
+    void clear() { columns.clear(); }
+
+    // Перестроение по всем трубам: items - (диаметр, запись), порядок любой
+    void build(std::vector<std::pair<int, Entry>>& items);
+
+    // ID труб с длиной в [minLength, maxLength] по возрастанию длины;
+    // diameter <= 0 - все диаметры (тогда порядок по диаметрам не задан)
+    void range(double minLength, double maxLength, int diameter, std::vector<int>& out) const;
+};
+
+#endif // LENGTHINDEX_H
@@ -2,15 +2,42 @@
 #include <iostream>
 #include <locale.h>
 #include "network.h"
+#include "batch.h"
+#include "server.h"
+#include <string>
 
 using namespace std;
 
-int main() {
+int main(int argc, char* argv[]) {
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
     setlocale(LC_ALL, "Russian");
 
     Storage storage;
+
+    // Пакетный режим: laba2 --batch <файл команд> (или "-" для стандартного ввода)
+    if (argc >= 2 && string(argv[1]) == "--batch") {
+        CommandProcessor processor(storage, cout);
+        bool ok = (argc < 3 || string(argv[2]) == "-")
+            ? processor.runStream(cin)
+            : processor.runFile(argv[2]);
+        return ok ? 0 : 1;
+    }
+
+    // Режим сервера: laba2 --serve <путь к сокету> [файл данных]
+    if (argc >= 2 && string(argv[1]) == "--serve") {
+        if (argc < 3) {
+            cout << "Использование: laba2 --serve <путь к сокету> [файл данных]\n";
+            return 1;
+        }
+        if (argc >= 4 && !storage.loadFromFile(argv[3])) {
+            cout << "Ошибка чтения файла " << argv[3] << "\n";
+            return 1;
+        }
+        QueryServer server(storage, argv[2]);
+        return server.run() ? 0 : 1;
+    }
+
     UserInterface ui(storage);
 
     cout << "Программа управления трубами и КС \n";
@@ -0,0 +1,81 @@
+﻿#include "memstats.h"
+#include <iomanip>
+
+using namespace std;
+
+void MemCounter::onAllocate(size_t n) {
+    long long now = bytes.fetch_add((long long)n) + (long long)n;
+    allocations.fetch_add(1);
+    long long peak = peakBytes.load();
+    while (now > peak && !peakBytes.compare_exchange_weak(peak, now)) {}
+}
+
+void MemCounter::onDeallocate(size_t n) {
+    bytes.fetch_sub((long long)n);
+    deallocations.fetch_add(1);
+}
+
+MemCounter& MemoryAccounting::counter(MemSubsystem s) {
+    static MemCounter counters[(int)MemSubsystem::Count];
+    return counters[(int)s];
+}
+
+const char* MemoryAccounting::name(MemSubsystem s) {
+    switch (s) {
+    case MemSubsystem::Pipes: return "EntityManager<Pipe>";
+    case MemSubsystem::Stations: return "EntityManager<CS>";
+    case MemSubsystem::Connections: return "GasNetwork::connections";
+    case MemSubsystem::Snapshots: return "Storage snapshots (MVCC)";
+    default: return "?";
+    }
+}
+
+size_t stringHeapBytes(const string& s) {
+    // Данные внутри самого объекта строки - это SSO, кучу они не занимают
+    const char* data = s.data();
+    const char* self = reinterpret_cast<const char*>(&s);
+    if (data >= self && data < self + sizeof(string)) return 0;
+    return s.capacity() + 1;
+}
+
+double MemoryUsage::bytesPerEntity() const {
+    return entities ? (double)(entityBytes + stringBytes) / entities : 0.0;
+}
+
+double MemoryUsage::footprintPerEntity() const {
+    return entities ? (double)totalBytes() / entities : 0.0;
+}
+
+MemoryUsage makeMemoryUsage(MemSubsystem s, size_t entities, size_t capacity, long long entityBytes,
+    long long stringBytes) {
+    const MemCounter& c = MemoryAccounting::counter(s);
+    MemoryUsage u;
+    u.subsystem = MemoryAccounting::name(s);
+    u.entities = entities;
+    u.capacity = capacity;
+    u.containerBytes = c.bytes.load();
+    u.entityBytes = entityBytes;
+    u.peakBytes = c.peakBytes.load();
+    u.allocations = c.allocations.load();
+    u.deallocations = c.deallocations.load();
+    u.stringBytes = stringBytes;
+    return u;
+}
+
+void printMemoryReport(ostream& os, const vector<MemoryUsage>& report) {
+    long long total = 0;
+    os << "\n=== ИСПОЛЬЗОВАНИЕ ПАМЯТИ ===\n";
+    for (const MemoryUsage& u : report) {
+        os << "\n" << u.subsystem << "\n"
+            << "  Объектов: " << u.entities << ", мест: " << u.capacity << "\n"
+            << "  Контейнер: " << u.containerBytes << " байт (пик " << u.peakBytes << "), из них объекты: "
+            << u.entityBytes << " байт, резерв и служебные данные: " << u.containerBytes - u.entityBytes << " байт\n"
+            << "  Строки в куче: " << u.stringBytes << " байт\n"
+            << "  Итого: " << u.totalBytes() << " байт\n"
+            << "  На объект: " << fixed << setprecision(2) << u.bytesPerEntity() << " байт данных, "
+            << u.footprintPerEntity() << " байт с резервом\n"
+            << "  Выделений/освобождений: " << u.allocations << "/" << u.deallocations << "\n";
+        total += u.totalBytes();
+    }
+    os << "\nВсего учтено: " << total << " байт\n";
+}
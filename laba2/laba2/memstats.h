@@ -0,0 +1,88 @@
+#pragma once
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Подсистемы, для которых ведётся учёт памяти
+enum class MemSubsystem { Pipes = 0, Stations = 1, Connections = 2, Snapshots = 3, Count = 4 };
+
+// Счётчики выделений одной подсистемы
+struct MemCounter {
+    std::atomic<long long> bytes{ 0 };
+    std::atomic<long long> peakBytes{ 0 };
+    std::atomic<long long> allocations{ 0 };
+    std::atomic<long long> deallocations{ 0 };
+
+    void onAllocate(size_t n);
+    void onDeallocate(size_t n);
+};
+
+class MemoryAccounting {
+public:
+    static MemCounter& counter(MemSubsystem s);
+    static const char* name(MemSubsystem s);
+};
+
+// Сколько байт строка занимает в куче (0, если строка поместилась в SSO-буфер)
+size_t stringHeapBytes(const std::string& s);
+
+// Аллокатор, учитывающий все выделения контейнера в счётчике подсистемы S
+template<typename T, MemSubsystem S>
+class TrackedAllocator {
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind { typedef TrackedAllocator<U, S> other; };
+
+    TrackedAllocator() noexcept {}
+    template<typename U>
+    TrackedAllocator(const TrackedAllocator<U, S>&) noexcept {}
+
+    T* allocate(size_t n) {
+        T* p = static_cast<T*>(::operator new(n * sizeof(T)));
+        MemoryAccounting::counter(S).onAllocate(n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        MemoryAccounting::counter(S).onDeallocate(n * sizeof(T));
+        ::operator delete(p);
+    }
+
+    template<typename U>
+    bool operator==(const TrackedAllocator<U, S>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const TrackedAllocator<U, S>&) const noexcept { return false; }
+};
+
+// Строка отчёта по одной подсистеме
+struct MemoryUsage {
+    std::string subsystem;
+    size_t entities;
+    size_t capacity;            // мест под объекты; у блочного хранилища - ячейки всех блоков
+    long long containerBytes;   // живые байты контейнера (блоки или узлы вместе с объектами)
+    long long entityBytes;      // из них занято самими объектами: entities * размер объекта
+    long long peakBytes;
+    long long allocations;
+    long long deallocations;
+    long long stringBytes;      // строковые данные в куче (имена, классы)
+
+    long long totalBytes() const { return containerBytes + stringBytes; }
+    // Объект со своими строками, без пустых ячеек и служебных данных контейнера
+    double bytesPerEntity() const;
+    // Вся занятая память подсистемы в расчёте на объект
+    double footprintPerEntity() const;
+};
+
+MemoryUsage makeMemoryUsage(MemSubsystem s, size_t entities, size_t capacity, long long entityBytes,
+    long long stringBytes);
+void printMemoryReport(std::ostream& os, const std::vector<MemoryUsage>& report);
+
+#endif // MEMSTATS_H
@@ -0,0 +1,263 @@
+﻿#include "nameindex.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NAMEINDEX_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(NAMEINDEX_X86) && (defined(__GNUC__) || defined(__clang__))
+#define NAMEINDEX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define NAMEINDEX_TARGET_AVX2
+#endif
+
+using namespace std;
+
+static const size_t NOT_FOUND = (size_t)-1;
+
+// Позиция первого вхождения needle в hay[from, n) или NOT_FOUND
+typedef size_t (*FindKernel)(const char* hay, size_t from, size_t n, const char* needle, size_t k);
+
+static size_t findScalar(const char* hay, size_t from, size_t n, const char* needle, size_t k) {
+    if (n < k) return NOT_FOUND;
+    const char* p = hay + from;
+    const char* last = hay + (n - k) + 1;
+    while (p < last) {
+        p = static_cast<const char*>(memchr(p, needle[0], last - p));
+        if (!p) break;
+        if (memcmp(p + 1, needle + 1, k - 1) == 0) return p - hay;
+        ++p;
+    }
+    return NOT_FOUND;
+}
+
+#if defined(NAMEINDEX_X86)
+
+static inline unsigned lowestBit(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return (unsigned)idx;
+#else
+    return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+// Проверка кандидатов из битовой маски совпадений первого и последнего байта
+static inline size_t verifyCandidates(uint32_t mask, const char* hay, size_t base, const char* needle, size_t k) {
+    size_t middle = k > 2 ? k - 2 : 0;
+    while (mask) {
+        unsigned bit = lowestBit(mask);
+        if (memcmp(hay + base + bit + 1, needle + 1, middle) == 0) return base + bit;
+        mask &= mask - 1;
+    }
+    return NOT_FOUND;
+}
+
+static size_t findSse2(const char* hay, size_t from, size_t n, const char* needle, size_t k) {
+    if (n < k) return NOT_FOUND;
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[k - 1]);
+    size_t i = from;
+    for (; i + k - 1 + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i + k - 1));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        size_t pos = verifyCandidates(mask, hay, i, needle, k);
+        if (pos != NOT_FOUND) return pos;
+    }
+    return findScalar(hay, i, n, needle, k);
+}
+
+NAMEINDEX_TARGET_AVX2
+static size_t findAvx2(const char* hay, size_t from, size_t n, const char* needle, size_t k) {
+    if (n < k) return NOT_FOUND;
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[k - 1]);
+    size_t i = from;
+    for (; i + k - 1 + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay + i + k - 1));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        size_t pos = verifyCandidates(mask, hay, i, needle, k);
+        if (pos != NOT_FOUND) return pos;
+    }
+    return findSse2(hay, i, n, needle, k);
+}
+
+static bool cpuHasAvx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+static FindKernel selectKernel(const char** name) {
+#if defined(NAMEINDEX_X86)
+    if (cpuHasAvx2()) {
+        *name = "AVX2";
+        return findAvx2;
+    }
+    *name = "SSE2";
+    return findSse2;
+#else
+    *name = "scalar";
+    return findScalar;
+#endif
+}
+
+static const char* kernelLabel = nullptr;
+static const FindKernel findKernel = selectKernel(&kernelLabel);
+
+const char* NameIndex::kernelName() {
+    return kernelLabel;
+}
+
+NameIndex::NameIndex() : records(0), deadBytes(0) {}
+
+bool NameIndex::findSlot(int id, uint32_t& slot) const {
+    if (id > 0 && (size_t)id < denseSlots.size()) {
+        if (denseSlots[id] == 0) return false;
+        slot = denseSlots[id] - 1;
+        return true;
+    }
+    auto it = sparseSlots.find(id);
+    if (it == sparseSlots.end()) return false;
+    slot = it->second;
+    return true;
+}
+
+void NameIndex::assignSlot(int id, uint32_t slot) {
+    // Массив растёт, только пока ID не слишком разрежены относительно числа записей
+    if (id > 0 && (size_t)id >= denseSlots.size() && (size_t)id < 4 * records + 65536) {
+        denseSlots.resize(max((size_t)id + 1, denseSlots.size() * 2), 0);
+    }
+    if (id > 0 && (size_t)id < denseSlots.size()) denseSlots[id] = slot + 1;
+    else sparseSlots[id] = slot;
+}
+
+void NameIndex::eraseSlot(int id) {
+    if (id > 0 && (size_t)id < denseSlots.size()) denseSlots[id] = 0;
+    else sparseSlots.erase(id);
+}
+
+void NameIndex::set(int id, const string& name) {
+    remove(id);
+    uint32_t slot = (uint32_t)ids.size();
+    starts.push_back((uint32_t)blob.size());
+    ids.push_back(id);
+    assignSlot(id, slot);
+    ++records;
+
+    size_t at = blob.size();
+    blob.append(name);
+    // '\0' между именами: образец не может совпасть на стыке двух имён
+    blob.push_back('\0');
+    if (!name.empty()) foldCaseInPlace(&blob[at], name.size());
+}
+
+void NameIndex::remove(int id) {
+    uint32_t slot;
+    if (!findSlot(id, slot)) return;
+    uint32_t end = (slot + 1 < starts.size()) ? starts[slot + 1] : (uint32_t)blob.size();
+    deadBytes += end - starts[slot];
+    ids[slot] = 0;
+    eraseSlot(id);
+    --records;
+
+    // Перестраиваем, когда удалённых данных больше половины
+    if (deadBytes > 4096 && deadBytes * 2 > blob.size()) compact();
+}
+
+void NameIndex::clear() {
+    blob.clear();
+    starts.clear();
+    ids.clear();
+    denseSlots.clear();
+    sparseSlots.clear();
+    records = 0;
+    deadBytes = 0;
+}
+
+void NameIndex::reserve(size_t count, size_t bytes) {
+    blob.reserve(bytes + count);
+    starts.reserve(count);
+    ids.reserve(count);
+}
+
+void NameIndex::compact() {
+    string newBlob;
+    newBlob.reserve(blob.size() - deadBytes);
+    vector<uint32_t> newStarts;
+    vector<int> newIds;
+    newStarts.reserve(records);
+    newIds.reserve(records);
+
+    for (size_t slot = 0; slot < ids.size(); ++slot) {
+        if (ids[slot] == 0) continue;
+        size_t end = (slot + 1 < starts.size()) ? starts[slot + 1] : blob.size();
+        assignSlot(ids[slot], (uint32_t)newIds.size());
+        newStarts.push_back((uint32_t)newBlob.size());
+        newIds.push_back(ids[slot]);
+        newBlob.append(blob, starts[slot], end - starts[slot]);
+    }
+    blob.swap(newBlob);
+    starts.swap(newStarts);
+    ids.swap(newIds);
+    deadBytes = 0;
+}
+
+void NameIndex::find(const string& substr, vector<int>& out) const {
+    out.clear();
+    if (substr.empty()) {
+        for (int id : ids) if (id != 0) out.push_back(id);
+        return;
+    }
+    string needle = toLowerCopy(substr);
+    const char* hay = blob.data();
+    size_t n = blob.size();
+    size_t k = needle.size();
+
+    size_t pos = 0;
+    size_t slot = 0;
+    while ((pos = findKernel(hay, pos, n, needle.data(), k)) != NOT_FOUND) {
+        // Слот, в который попало совпадение: совпадения идут по возрастанию,
+        // поэтому ищем вперёд от предыдущего слота с удвоением шага
+        size_t step = 1;
+        size_t hi = slot + 1;
+        while (hi < starts.size() && starts[hi] <= pos) {
+            slot = hi;
+            hi += step;
+            step *= 2;
+        }
+        hi = min(hi, starts.size());
+        slot = (size_t)(upper_bound(starts.begin() + slot, starts.begin() + hi, (uint32_t)pos) - starts.begin()) - 1;
+
+        if (ids[slot] != 0) out.push_back(ids[slot]);
+        // Остаток этого имени пропускаем
+        pos = (slot + 1 < starts.size()) ? starts[slot + 1] : n;
+    }
+}
+
+size_t NameIndex::memoryBytes() const {
+    return blob.capacity() + starts.capacity() * sizeof(uint32_t) + ids.capacity() * sizeof(int)
+        + denseSlots.capacity() * sizeof(uint32_t)
+        + sparseSlots.size() * (sizeof(int) + sizeof(uint32_t) + 2 * sizeof(void*));
+}
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef NAMEINDEX_H
+#define NAMEINDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Имена в нижнем регистре (foldCaseInPlace), уложенные подряд в один буфер
+// через '\0', и смещения начала каждого имени. Поиск подстроки - один проход
+// по буферу векторным ядром (AVX2 или SSE2, иначе скалярный вариант):
+// сравниваются первый и последний байт образца, совпадения проверяются memcmp.
+// Удалённые и переименованные записи помечаются и вычищаются при перестроении.
+class NameIndex {
+    std::string blob;
+    std::vector<uint32_t> starts;           // начало имени в blob для каждого слота
+    std::vector<int> ids;                   // ID записи слота, 0 - слот удалён
+    // Слот по ID: ID выдаются подряд, поэтому обычно хватает массива (слот + 1,
+    // 0 - нет записи); редкие очень большие или отрицательные ID - в хеш-таблице
+    std::vector<uint32_t> denseSlots;
+    std::unordered_map<int, uint32_t> sparseSlots;
+    size_t records;
+    size_t deadBytes;
+
+public:
+    NameIndex();
+
+    // Добавить запись или заменить её имя
+    void set(int id, const std::string& name);
+    void remove(int id);
+    void clear();
+    void reserve(size_t count, size_t bytes);
+
+    // ID записей, имя которых содержит подстроку без учёта регистра (в порядке слотов)
+    void find(const std::string& substr, std::vector<int>& out) const;
+
+    size_t size() const { return records; }
+    size_t memoryBytes() const;
+    // Ядро поиска, выбранное для этого процессора
+    static const char* kernelName();
+
+private:
+    bool findSlot(int id, uint32_t& slot) const;
+    void assignSlot(int id, uint32_t slot);
+    void eraseSlot(int id);
+    void compact();
+};
+
+#endif // NAMEINDEX_H
@@ -1,6 +1,8 @@
 ﻿#include "network.h"
 #include "storage.h"
 #include "utils.h"
+#include "schema.h"
+#include "report.h"
 #include <algorithm>
 #include <fstream>
 #include <stack>
@@ -17,62 +19,103 @@ Connection::Connection(int id, int pipeId, int csInId, int csOutId)
 }
 
 string Connection::toSingleLine() const {
-    ostringstream oss;
-    oss << id << "|" << pipeId << "|" << csInId << "|" << csOutId << "|" << (isActive ? 1 : 0);
-    return oss.str();
+    return TextCodec<Connection>::encode(*this);
 }
 
 bool Connection::fromSingleLine(const string& line, Connection& out) {
-    vector<string> parts;
-    string tmp;
-    istringstream iss(line);
-    while (getline(iss, tmp, '|')) parts.push_back(tmp);
-    if (parts.size() != 5) return false;
-    try {
-        out.id = stoi(parts[0]);
-        out.pipeId = stoi(parts[1]);
-        out.csInId = stoi(parts[2]);
-        out.csOutId = stoi(parts[3]);
-        out.isActive = (parts[4] == "1");
-        return true;
-    }
-    catch (...) { return false; }
+    return TextCodec<Connection>::decode(line.data(), line.data() + line.size(), out);
 }
 
 void Connection::printDetails() const {
-    cout << "\n--- Соединение [ID=" << id << "] ---\n";
-    cout << "Труба ID: " << pipeId << "\n";
-    cout << "КС входа ID: " << csInId << "\n";
-    cout << "КС выхода ID: " << csOutId << "\n";
-    cout << "Статус: " << (isActive ? "Активно" : "Неактивно") << "\n";
+    ReportWriter out(cout);
+    writeDetails(out);
+}
+
+void Connection::writeDetails(ReportWriter& out) const {
+    out << "\n--- Соединение [ID=" << id << "] ---\n";
+    out << "Труба ID: " << pipeId << "\n";
+    out << "КС входа ID: " << csInId << "\n";
+    out << "КС выхода ID: " << csOutId << "\n";
+    out << "Статус: " << (isActive ? "Активно" : "Неактивно") << "\n";
 }
 
 // GasNetwork implementation
-GasNetwork::GasNetwork() : nextId(1) {}
+GasNetwork::GasNetwork() {}
 
-bool GasNetwork::isValidDiameter(int diameter) const {
+bool GasNetwork::isValidDiameter(int diameter) {
     return diameter == 500 || diameter == 700 ||
         diameter == 1000 || diameter == 1400;
 }
 
 int GasNetwork::getNextId() {
-    return nextId++;
+    return ids.allocate();
 }
 
 int GasNetwork::addConnection(const Connection& conn) {
+    lock_guard<mutex> lock(componentsMutex);
+    auto it = connections.find(conn.id);
+    if (it != connections.end() && it->second.isActive) components.invalidate();
     connections[conn.id] = conn;
-    if (conn.id >= nextId) {
-        nextId = conn.id + 1;
-    }
+    ids.claim(conn.id);
+    if (conn.isActive && !components.isStale()) components.addEdge(conn.csInId, conn.csOutId);
     return conn.id;
 }
 
+size_t GasNetwork::addConnectionsBulk(vector<Connection>& items, vector<size_t>& rejected) {
+    lock_guard<mutex> lock(componentsMutex);
+    for (const Connection& conn : items) ids.claim(conn.id);
+
+    // Всё или ничего: при исключении (например, нехватке памяти) добавленное удаляется,
+    // соединения возвращаются в items
+    vector<size_t> added;
+    added.reserve(items.size());
+    size_t rejectedBefore = rejected.size();
+    try {
+        for (size_t i = 0; i < items.size(); ++i) {
+            Connection& conn = items[i];
+            if (conn.id == 0) conn.id = getNextId();
+            if (conn.id <= 0) {
+                rejected.push_back(i);
+                continue;
+            }
+            auto inserted = connections.try_emplace(conn.id, std::move(conn));
+            if (!inserted.second) {
+                rejected.push_back(i);
+                continue;
+            }
+            added.push_back(i);
+            const Connection& c = inserted.first->second;
+            if (c.isActive && !components.isStale()) components.addEdge(c.csInId, c.csOutId);
+        }
+    }
+    catch (...) {
+        for (size_t i : added) {
+            auto it = connections.find(items[i].id);
+            items[i] = std::move(it->second);
+            connections.erase(it);
+        }
+        rejected.resize(rejectedBefore);
+        components.invalidate();
+        rebuildIdAllocator();
+        throw;
+    }
+    return added.size();
+}
+
 bool GasNetwork::removeConnection(int id) {
-    return connections.erase(id) > 0;
+    auto it = connections.find(id);
+    if (it == connections.end()) return false;
+    if (it->second.isActive) {
+        lock_guard<mutex> lock(componentsMutex);
+        components.invalidate();
+    }
+    connections.erase(it);
+    ids.release(id);
+    return true;
 }
 
 map<int, Connection> GasNetwork::getAllConnections() const {
-    return connections;
+    return map<int, Connection>(connections.begin(), connections.end());
 }
 
 Connection* GasNetwork::findConnectionById(int id) {
@@ -85,29 +128,8 @@ map<int, Pipe*> GasNetwork::findAvailablePipesByDiameter(int diameter, Storage&
         return {};
     }
 
-    // Получаем все трубы нужного диаметра
-    map<int, Pipe*> allPipes = storage.getAllPipesMap();
-    map<int, Pipe*> result;
-
-    // Собираем ID труб, уже используемых в соединениях
-    set<int> usedPipeIds;
-    for (const auto& pair : connections) {
-        if (pair.second.isActive) {
-            usedPipeIds.insert(pair.second.pipeId);
-        }
-    }
-
-    // Фильтруем: нужный диаметр, не в ремонте, не используется
-    for (const auto& pair : allPipes) {
-        Pipe* pipe = pair.second;
-        if (pipe->getDiameter() == diameter &&
-            !pipe->isInRepair() &&
-            usedPipeIds.find(pipe->getId()) == usedPipeIds.end()) {
-            result[pipe->getId()] = pipe;
-        }
-    }
-
-    return result;
+    // Нужный диаметр, не в ремонте, не используется: разность битовых индексов Storage
+    return storage.findFreePipes(diameter);
 }
 
 bool GasNetwork::createConnectionInteractive(Storage& storage) {
@@ -139,11 +161,15 @@ bool GasNetwork::createConnectionInteractive(Storage& storage) {
         cout << "Создаем новую трубу...\n";
 
         pipeId = storage.getNextPipeId();
+        if (pipeId == 0) {
+            cout << "Ошибка! Свободные ID труб закончились.\n";
+            return false;
+        }
         Pipe newPipe = storage.createPipeInteractive(pipeId);
         newPipe.setDiameter(diameter);  // Устанавливаем нужный диаметр
 
         // Сохраняем трубу
-        storage.addPipe(newPipe);
+        storage.addPipe(std::move(newPipe));
         cout << "Создана новая труба ID=" << pipeId << " диаметром " << diameter << " мм\n";
     }
 
@@ -171,6 +197,10 @@ bool GasNetwork::createConnectionInteractive(Storage& storage) {
 
     // Создание соединения
     int connId = getNextId();
+    if (connId == 0) {
+        cout << "Ошибка! Свободные ID соединений закончились.\n";
+        return false;
+    }
     Connection conn(connId, pipeId, csInId, csOutId);
     addConnection(conn);
 
@@ -187,71 +217,147 @@ bool GasNetwork::createConnectionInteractive(Storage& storage) {
     return true;
 }
 
-vector<int> GasNetwork::topologicalSort(Storage& storage) const {
-    vector<int> result;
+int GasNetwork::createConnection(Storage& storage, int csInId, int csOutId, int diameter, string& error) {
+    if (!isValidDiameter(diameter)) {
+        error = "недопустимый диаметр " + to_string(diameter) + " (500, 700, 1000, 1400)";
+        return 0;
+    }
+    if (!storage.findCSById(csInId)) {
+        error = "КС входа с ID=" + to_string(csInId) + " не найдена";
+        return 0;
+    }
+    if (!storage.findCSById(csOutId)) {
+        error = "КС выхода с ID=" + to_string(csOutId) + " не найдена";
+        return 0;
+    }
+    if (csInId == csOutId) {
+        error = "КС входа и выхода не могут быть одинаковыми";
+        return 0;
+    }
+
+    map<int, Pipe*> availablePipes = findAvailablePipesByDiameter(diameter, storage);
+    if (availablePipes.empty()) {
+        error = "нет свободных труб диаметром " + to_string(diameter) + " мм";
+        return 0;
+    }
+
+    int connId = getNextId();
+    if (connId == 0) {
+        error = "свободные ID соединений закончились";
+        return 0;
+    }
+    addConnection(Connection(connId, availablePipes.begin()->first, csInId, csOutId));
+    return connId;
+}
+
+int GasNetwork::connect(int pipeId, int csInId, int csOutId) {
+    int connId = getNextId();
+    if (connId) addConnection(Connection(connId, pipeId, csInId, csOutId));
+    return connId;
+}
+
+void GasNetwork::ensureComponents() const {
+    if (!components.isStale()) return;
+    components.clear();
+    for (const auto& pair : connections) {
+        if (pair.second.isActive) components.addEdge(pair.second.csInId, pair.second.csOutId);
+    }
+}
+
+size_t GasNetwork::componentCount() const {
+    lock_guard<mutex> lock(componentsMutex);
+    ensureComponents();
+    return components.componentCount();
+}
+
+vector<vector<const Connection*>> GasNetwork::connectionsByComponent() const {
+    lock_guard<mutex> lock(componentsMutex);
+    ensureComponents();
+    vector<int> componentOf;
+    size_t count = components.label(componentOf);
+    vector<vector<const Connection*>> parts(count);
+    for (const auto& pair : connections) {
+        const Connection& conn = pair.second;
+        if (!conn.isActive || conn.csInId < 0 || conn.csOutId < 0) continue;
+        parts[componentOf[components.vertexOf(conn.csInId)]].push_back(&conn);
+    }
+    return parts;
+}
+
+// Соединений на поток при параллельной сортировке компонент
+static const size_t SORT_MIN_PER_THREAD = 4096;
+
+// Алгоритм Кана для одной компоненты; cycles - не все КС попали в порядок
+static void sortComponent(const vector<const Connection*>& edges, Storage& storage, vector<int>& result, bool& cycles) {
     map<int, int> inDegree;
     map<int, vector<int>> adjList;
-
-    // Инициализируем все КС из соединений
-    for (const auto& connPair : connections) {
-        const Connection& conn = connPair.second;
-        if (conn.isActive) {
-            // Убедимся что обе КС существуют
-            CS* csIn = storage.findCSById(conn.csInId);
-            CS* csOut = storage.findCSById(conn.csOutId);
-
-            if (csIn && csOut) {
-                adjList[conn.csInId].push_back(conn.csOutId);
-                inDegree[conn.csOutId]++;
-
-                // Добавляем КС входа если её еще нет
-                if (inDegree.find(conn.csInId) == inDegree.end()) {
-                    inDegree[conn.csInId] = 0;
-                }
-            }
-        }
+    for (const Connection* conn : edges) {
+        // Обе КС должны существовать
+        if (!storage.findCSById(conn->csInId) || !storage.findCSById(conn->csOutId)) continue;
+        adjList[conn->csInId].push_back(conn->csOutId);
+        inDegree[conn->csOutId]++;
+        // КС входа без входящих соединений
+        inDegree.emplace(conn->csInId, 0);
     }
 
-    // Очередь для вершин с нулевой входящей степенью
     queue<int> zeroInDegree;
     for (const auto& pair : inDegree) {
-        if (pair.second == 0) {
-            zeroInDegree.push(pair.first);
-        }
+        if (pair.second == 0) zeroInDegree.push(pair.first);
     }
-
-    // Алгоритм Кана
     while (!zeroInDegree.empty()) {
         int csId = zeroInDegree.front();
         zeroInDegree.pop();
         result.push_back(csId);
-
-        if (adjList.find(csId) != adjList.end()) {
-            for (int neighbor : adjList[csId]) {
-                inDegree[neighbor]--;
-                if (inDegree[neighbor] == 0) {
-                    zeroInDegree.push(neighbor);
-                }
-            }
+        auto it = adjList.find(csId);
+        if (it == adjList.end()) continue;
+        for (int neighbor : it->second) {
+            if (--inDegree[neighbor] == 0) zeroInDegree.push(neighbor);
         }
     }
+    cycles = result.size() != inDegree.size();
+}
 
-    return result;
+void GasNetwork::analyzeOrder(Storage& storage, vector<int>& order, bool& cycles) const {
+    vector<vector<const Connection*>> parts = connectionsByComponent();
+    vector<vector<int>> orders(parts.size());
+    vector<char> cyclic(parts.size(), 0);
+    // Минимум на поток - в компонентах, чтобы в среднем выходило SORT_MIN_PER_THREAD соединений:
+    // небольшой граф сортируется в вызывающем потоке
+    size_t edges = 0;
+    for (const auto& part : parts) edges += part.size();
+    size_t minPerThread = max<size_t>(1, parts.size() * SORT_MIN_PER_THREAD / max<size_t>(1, edges));
+    parallelFor(parts.size(), [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            bool c = false;
+            sortComponent(parts[k], storage, orders[k], c);
+            cyclic[k] = c;
+        }
+    }, minPerThread);
+
+    size_t total = 0;
+    for (const vector<int>& o : orders) total += o.size();
+    order.clear();
+    order.reserve(total);
+    for (const vector<int>& o : orders) order.insert(order.end(), o.begin(), o.end());
+    cycles = find(cyclic.begin(), cyclic.end(), 1) != cyclic.end();
 }
 
-bool GasNetwork::hasCycles(Storage& storage) const {
-    vector<int> sorted = topologicalSort(storage);
-    map<int, int> inDegree;
+vector<int> GasNetwork::topologicalSort(Storage& storage) const {
+    bool cycles;
+    return topologicalSort(storage, cycles);
+}
 
-    // Подсчитываем КС с ненулевой входящей степенью
-    for (const auto& connPair : connections) {
-        if (connPair.second.isActive) {
-            inDegree[connPair.second.csOutId]++;
-        }
-    }
+vector<int> GasNetwork::topologicalSort(Storage& storage, bool& cycles) const {
+    vector<int> result;
+    analyzeOrder(storage, result, cycles);
+    return result;
+}
 
-    // Если отсортировали не все вершины - есть циклы
-    return sorted.size() != inDegree.size();
+bool GasNetwork::hasCycles(Storage& storage) const {
+    vector<int> order;
+    bool cycles;
+    analyzeOrder(storage, order, cycles);
+    return cycles;
 }
 
 void GasNetwork::printNetworkGraph(Storage& storage) const {
@@ -287,6 +393,8 @@ void GasNetwork::printNetworkGraph(Storage& storage) const {
         }
     }
 
+    cout << "\nНезависимых подсетей: " << componentCount() << "\n";
+
     // Проверка на циклы
     if (hasCycles(storage)) {
         cout << "\n ВНИМАНИЕ: Сеть содержит циклы!\n";
@@ -296,22 +404,24 @@ void GasNetwork::printNetworkGraph(Storage& storage) const {
     }
 }
 
+MemoryUsage GasNetwork::memoryUsage() const {
+    return makeMemoryUsage(MemSubsystem::Connections, connections.size(), connections.size(),
+        (long long)(connections.size() * sizeof(Connection)), 0);
+}
+
 void GasNetwork::saveToStream(ostream& os) const {
-    os << "CONNECTIONS\n";
-    for (const auto& pair : connections) {
-        os << pair.second.toSingleLine() << "\n";
-    }
-    os << "ENDCONNECTIONS\n";
+    writeTextSection<Connection>(os, "CONNECTIONS", [this](auto&& write) {
+        for (const auto& pair : connections) write(pair.second);
+    });
 }
 
 bool GasNetwork::loadFromStream(istream& is) {
-    map<int, Connection> newConnections;
+    ConnectionMap newConnections;
     string line;
     bool inSection = false;
-    int maxId = 0;
 
     while (getline(is, line)) {
-        line = trim(line);
+        trimInPlace(line);
         if (line.empty()) continue;
 
         if (line == "CONNECTIONS") {
@@ -325,17 +435,34 @@ bool GasNetwork::loadFromStream(istream& is) {
 
         if (inSection) {
             Connection conn;
-            if (Connection::fromSingleLine(line, conn)) {
+            if (TextCodec<Connection>::decode(line.data(), line.data() + line.size(), conn)) {
                 newConnections[conn.id] = conn;
-                if (conn.id > maxId) maxId = conn.id;
             }
         }
     }
 
     if (!newConnections.empty()) {
-        connections = newConnections;
-        nextId = maxId + 1;
+        connections.swap(newConnections);
+        rebuildIdAllocator();
+        lock_guard<mutex> lock(componentsMutex);
+        components.invalidate();
         return true;
     }
     return false;
-}
\ No newline at end of file
+}
+void GasNetwork::rebuildIdAllocator() {
+    ids.rebuild([this](const function<void(int)>& use) {
+        for (const auto& pair : connections) use(pair.first);
+    });
+}
+
+bool GasNetwork::replaceAll(vector<Connection>& items) {
+    if (items.empty()) return false;
+    ConnectionMap newConnections;
+    for (Connection& conn : items) newConnections[conn.id] = conn;
+    connections.swap(newConnections);
+    rebuildIdAllocator();
+    lock_guard<mutex> lock(componentsMutex);
+    components.invalidate();
+    return true;
+}
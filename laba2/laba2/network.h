@@ -3,7 +3,12 @@
 #define NETWORK_H
 
 #include "entities.h"
+#include "memstats.h"
+#include "dirty.h"
+#include "idalloc.h"
+#include "components.h"
 #include <map>
+#include <mutex>
 #include <vector>
 #include <set>
 #include <string>
@@ -28,6 +33,7 @@ public:
     std::string toSingleLine() const;
     static bool fromSingleLine(const std::string& line, Connection& out);
     void printDetails() const;
+    void writeDetails(ReportWriter& out) const;
 
     // 
     int getId() const { return id; }
@@ -38,14 +44,24 @@ public:
 };
 
 class GasNetwork {
-    std::map<int, Connection> connections;
-    int nextId;
+    typedef std::map<int, Connection, std::less<int>,
+        TrackedAllocator<std::pair<const int, Connection>, MemSubsystem::Connections>> ConnectionMap;
+
+    ConnectionMap connections;
+    IdAllocator ids;
+    DirtyTracker dirty;
+    //    :   ,
+    //        .  
+    //  const-,      -  componentsMutex
+    mutable std::mutex componentsMutex;
+    mutable ComponentIndex components;
 
 public:
     GasNetwork();
 
     //  
     int addConnection(const Connection& conn);
+    size_t addConnectionsBulk(std::vector<Connection>& items, std::vector<size_t>& rejected);
     bool removeConnection(int id);
     std::map<int, Connection> getAllConnections() const;
     Connection* findConnectionById(int id);
@@ -53,22 +69,54 @@ public:
     //    
     std::map<int, Pipe*> findAvailablePipesByDiameter(int diameter, Storage& storage);
     bool createConnectionInteractive(Storage& storage);
+    //  :    ,    0    error
+    int createConnection(Storage& storage, int csInId, int csOutId, int diameter, std::string& error);
+    //       (  );   ID
+    int connect(int pipeId, int csInId, int csOutId);
 
-    //   
+    //   .      :
+    //  -     ID ,  -  
     std::vector<int> topologicalSort(Storage& storage) const;
+    //        
+    std::vector<int> topologicalSort(Storage& storage, bool& cycles) const;
     bool hasCycles(Storage& storage) const;
+    size_t componentCount() const;
+    //     (  - )
+    std::vector<std::vector<const Connection*>> connectionsByComponent() const;
     void printNetworkGraph(Storage& storage) const;
 
     // 
     int getConnectionCount() const { return (int)connections.size(); }
 
+    //      (  EntityManager)
+    void markDirty(int id) { dirty.mark(id, connections.size()); }
+    void markAllDirty() { dirty.markAll(); }
+    const DirtyTracker& dirtyRecords() const { return dirty; }
+    void clearDirty() { dirty.clear(); }
+    //      ,   ID    
+    IdAllocator& idAllocator() { return ids; }
+    const IdAllocator& idAllocator() const { return ids; }
+    MemoryUsage memoryUsage() const;
+    template<typename F>
+    void forEachConnection(F fn) const {
+        for (const auto& pair : connections) fn(pair.second);
+    }
+
     // /
     void saveToStream(std::ostream& os) const;
     bool loadFromStream(std::istream& is);
+    //    (  );   items   
+    bool replaceAll(std::vector<Connection>& items);
+
+    // 500, 700, 1000  1400 
+    static bool isValidDiameter(int diameter);
 
 private:
-    bool isValidDiameter(int diameter) const;
     int getNextId();
+    void rebuildIdAllocator();
+    //  componentsMutex
+    void ensureComponents() const;
+    void analyzeOrder(Storage& storage, std::vector<int>& order, bool& cycles) const;
 };
 
 #endif // NETWORK_H
\ No newline at end of file
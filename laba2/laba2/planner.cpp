@@ -0,0 +1,123 @@
+﻿#include "planner.h"
+#include "utils.h"
+#include <set>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// Трубы одного диаметра: поиск по длине и по ID
+class PipePool {
+    set<pair<double, int>> byLength;
+    map<int, double> byId;
+
+public:
+    explicit PipePool(const vector<FreePipe>& pipes) {
+        for (const FreePipe& p : pipes) {
+            byLength.emplace(p.length, p.id);
+            byId.emplace(p.id, p.length);
+        }
+    }
+
+    bool empty() const { return byId.empty(); }
+
+    FreePipe takeNearest(double length) {
+        // Ближайшая из двух соседних по длине; при равенстве - более короткая
+        auto above = byLength.lower_bound(make_pair(length, 0));
+        double chosen;
+        if (above == byLength.end()) chosen = prev(above)->first;
+        else if (above == byLength.begin()) chosen = above->first;
+        else {
+            double below = prev(above)->first;
+            chosen = length - below <= above->first - length ? below : above->first;
+        }
+        // Из труб этой длины - с меньшим ID
+        auto best = byLength.lower_bound(make_pair(chosen, 0));
+        FreePipe p{ best->second, best->first };
+        byLength.erase(best);
+        byId.erase(p.id);
+        return p;
+    }
+
+    FreePipe takeLowestId() {
+        auto it = byId.begin();
+        FreePipe p{ it->first, it->second };
+        byLength.erase(make_pair(p.length, p.id));
+        byId.erase(it);
+        return p;
+    }
+};
+
+}
+
+void assignPipes(const vector<ConnectionRequest>& requests, map<int, vector<FreePipe>>& freeByDiameter,
+    bool createMissing, ConnectionPlan& plan) {
+    plan.items.assign(requests.size(), PlannedConnection());
+    map<size_t, string> failed;     // ошибки выводятся в порядке запросов
+
+    // Запросы по диаметрам: сначала с длиной (по возрастанию), затем без длины (по порядку)
+    map<int, vector<size_t>> byDiameter;
+    for (size_t i = 0; i < requests.size(); ++i) byDiameter[requests[i].diameter].push_back(i);
+
+    for (auto& group : byDiameter) {
+        vector<size_t>& order = group.second;
+        stable_sort(order.begin(), order.end(), [&requests](size_t a, size_t b) {
+            bool hasA = requests[a].length > 0, hasB = requests[b].length > 0;
+            if (hasA != hasB) return hasA;
+            return hasA && requests[a].length < requests[b].length;
+        });
+
+        PipePool pool(freeByDiameter[group.first]);
+        freeByDiameter.erase(group.first);
+        for (size_t i : order) {
+            const ConnectionRequest& r = requests[i];
+            PlannedConnection& item = plan.items[i];
+            if (!pool.empty()) {
+                FreePipe p = r.length > 0 ? pool.takeNearest(r.length) : pool.takeLowestId();
+                item.pipeId = p.id;
+                item.pipeLength = p.length;
+            }
+            else if (!createMissing) {
+                failed[i] = "нет свободной трубы диаметром " + to_string(r.diameter) + " мм";
+            }
+            else if (r.length <= 0) {
+                failed[i] = "для новой трубы нужна длина";
+            }
+            else {
+                item.pipeLength = r.length;
+                item.newPipe = true;
+                ++plan.newPipes;
+            }
+        }
+    }
+    for (const auto& pair : failed) plan.errors.push_back("запрос " + to_string(pair.first + 1) + ": " + pair.second);
+}
+
+bool parseConnectionRequests(istream& is, vector<ConnectionRequest>& requests, vector<string>& errors) {
+    string line;
+    size_t lineNo = 0;
+    size_t errorsBefore = errors.size();
+    while (getline(is, line)) {
+        ++lineNo;
+        trimInPlace(line);
+        if (line.empty() || line[0] == '#') continue;
+
+        istringstream fields(line);
+        vector<string> tokens;
+        string token;
+        while (fields >> token) tokens.push_back(token);
+
+        ConnectionRequest r;
+        bool valid = (tokens.size() == 3 || tokens.size() == 4) &&
+            parseInt(tokens[0], r.csInId) && parseInt(tokens[1], r.csOutId) && parseInt(tokens[2], r.diameter) &&
+            (tokens.size() == 3 || (parseDouble(tokens[3], r.length) && r.length > 0));
+        if (!valid) {
+            errors.push_back("строка " + to_string(lineNo) + ": ожидается <id_КС_входа> <id_КС_выхода> <диаметр_мм> [длина_км]");
+            continue;
+        }
+        requests.push_back(r);
+    }
+    return errors.size() == errorsBefore;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <iosfwd>
+#include <cstddef>
+
+// Пакетное планирование соединений: запросы (КС входа, КС выхода, диаметр,
+// желаемая длина) сопоставляются со свободными трубами за один проход.
+// План строит Storage::planConnections, выполняет Storage::commitConnectionPlan.
+
+struct ConnectionRequest {
+    int csInId = 0;
+    int csOutId = 0;
+    int diameter = 0;
+    double length = 0.0;        // <= 0 - любая длина
+};
+
+struct PlannedConnection {
+    int pipeId = 0;             // для новой трубы - 0 до выполнения
+    double pipeLength = 0.0;
+    bool newPipe = false;
+    int connectionId = 0;       // заполняется при выполнении
+};
+
+struct ConnectionPlan {
+    std::vector<PlannedConnection> items;       // по одному на запрос, в том же порядке
+    std::vector<std::string> errors;            // "запрос N: причина"; план с ошибками не выполняется
+    size_t newPipes = 0;
+
+    bool ok() const { return errors.empty(); }
+};
+
+// Свободная труба нужного диаметра
+struct FreePipe {
+    int id;
+    double length;
+};
+
+// Назначение труб запросам. Запросы с длиной разбираются по возрастанию длины, каждому
+// достаётся свободная труба с ближайшей длиной (при равенстве - более короткая, затем
+// с меньшим ID); запросы без длины получают оставшиеся трубы по возрастанию ID, как
+// при создании соединений по одному. Если труб не хватило, при createMissing планируется
+// новая труба желаемой длины, иначе запрос получает ошибку.
+// freeByDiameter - свободные трубы по диаметрам, расходуются по ходу назначения
+void assignPipes(const std::vector<ConnectionRequest>& requests, std::map<int, std::vector<FreePipe>>& freeByDiameter,
+    bool createMissing, ConnectionPlan& plan);
+
+// Запросы из текста: строки "<id_КС_входа> <id_КС_выхода> <диаметр_мм> [длина_км]",
+// пустые строки и строки с '#' пропускаются. Ошибки разбора - "строка N: причина"
+bool parseConnectionRequests(std::istream& is, std::vector<ConnectionRequest>& requests,
+    std::vector<std::string>& errors);
+
+#endif // PLANNER_H
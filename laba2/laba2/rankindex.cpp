@@ -0,0 +1,23 @@
+﻿#include "rankindex.h"
+#include <climits>
+#include <algorithm>
+
+using namespace std;
+
+void RankIndex::atLeast(double minKey, vector<int>& out) const {
+    out.clear();
+    for (auto it = entries.lower_bound(make_pair(minKey, INT_MIN)); it != entries.end(); ++it) {
+        out.push_back(it->second);
+    }
+}
+
+void RankIndex::top(size_t k, bool highest, vector<int>& out) const {
+    out.clear();
+    out.reserve(min(k, entries.size()));
+    if (highest) {
+        for (auto it = entries.rbegin(); it != entries.rend() && out.size() < k; ++it) out.push_back(it->second);
+    }
+    else {
+        for (auto it = entries.begin(); it != entries.end() && out.size() < k; ++it) out.push_back(it->second);
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#ifndef RANKINDEX_H
+#define RANKINDEX_H
+
+#include <set>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+// Упорядоченный индекс "значение -> ID" для пороговых запросов и top-K.
+// Для удаления нужно прежнее значение ключа (Storage берёт его из
+// опубликованного снимка), поэтому обратная таблица ID -> ключ не хранится.
+class RankIndex {
+    std::set<std::pair<double, int>> entries;
+
+public:
+    void insert(int id, double key) { entries.emplace(key, id); }
+    void erase(int id, double key) { entries.erase(std::make_pair(key, id)); }
+    void clear() { entries.clear(); }
+    size_t size() const { return entries.size(); }
+
+    // ID с ключом >= minKey по возрастанию ключа; просматриваются только они
+    void atLeast(double minKey, std::vector<int>& out) const;
+    // k записей с наибольшими (highest) или наименьшими ключами
+    void top(size_t k, bool highest, std::vector<int>& out) const;
+};
+
+#endif // RANKINDEX_H
@@ -0,0 +1,231 @@
+﻿#include "reach.h"
+#include "components.h"
+#include "utils.h"
+#include <algorithm>
+
+using namespace std;
+
+void ReachabilityIndex::build(const StorageSnapshot& snap) {
+    ComponentIndex index;
+    if (snap.connections) {
+        snap.connections->forEach([&](const Connection& c) {
+            if (!c.isActive || c.csInId < 0 || c.csOutId < 0) return;
+            if (!snap.findCS(c.csInId) || !snap.findCS(c.csOutId)) return;
+            index.addEdge(c.csInId, c.csOutId);
+        });
+    }
+    vector<int> label;
+    size_t count = index.label(label);
+    const vector<int>& ids = index.vertexIds();
+    vertexOf.clear();
+    vertexOf.reserve(ids.size());
+    for (size_t v = 0; v < ids.size(); ++v) vertexOf.emplace(ids[v], (uint32_t)v);
+
+    // Вершины (по возрастанию номера) и рёбра каждой компоненты в номерах вершин
+    vector<vector<int>> vertices(count);
+    vector<vector<pair<int, int>>> componentEdges(count);
+    for (size_t v = 0; v < label.size(); ++v) vertices[label[v]].push_back((int)v);
+    if (snap.connections) {
+        snap.connections->forEach([&](const Connection& c) {
+            if (!c.isActive || c.csInId < 0 || c.csOutId < 0) return;
+            if (!snap.findCS(c.csInId) || !snap.findCS(c.csOutId)) return;
+            int from = index.vertexOf(c.csInId);
+            componentEdges[label[from]].emplace_back(from, index.vertexOf(c.csOutId));
+        });
+    }
+
+    componentOf.assign(label.begin(), label.end());
+    sccOf.assign(label.size(), 0);
+    components.assign(count, Dag());
+    parallelFor(count, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) buildDag(vertices[k], componentEdges[k], sccOf, components[k]);
+    }, 1);
+
+    sccTotal = 0;
+    for (const Dag& dag : components) sccTotal += dag.size;
+}
+
+void ReachabilityIndex::buildDag(const vector<int>& vertices, const vector<pair<int, int>>& edges,
+    vector<uint32_t>& sccOf, Dag& dag) {
+    // Локальные номера вершин: позиция в vertices (по возрастанию номера)
+    uint32_t n = (uint32_t)vertices.size();
+    auto local = [&vertices](int id) {
+        return (uint32_t)(lower_bound(vertices.begin(), vertices.end(), id) - vertices.begin());
+    };
+    vector<uint32_t> offsets(n + 1, 0), targets(edges.size());
+    for (const auto& e : edges) ++offsets[local(e.first) + 1];
+    for (uint32_t v = 0; v < n; ++v) offsets[v + 1] += offsets[v];
+    {
+        vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (const auto& e : edges) targets[fill[local(e.first)]++] = local(e.second);
+    }
+
+    // Алгоритм Тарьяна без рекурсии; компоненты получают номера в порядке завершения,
+    // то есть в обратном топологическом (сначала стоки)
+    const uint32_t NONE = UINT32_MAX;
+    vector<uint32_t> order(n, NONE), low(n, 0), scc(n, NONE);
+    vector<uint32_t> stack, callStack, edgePos;
+    uint32_t counter = 0, sccCount = 0;
+    for (uint32_t root = 0; root < n; ++root) {
+        if (order[root] != NONE) continue;
+        callStack.push_back(root);
+        edgePos.push_back(offsets[root]);
+        order[root] = low[root] = counter++;
+        stack.push_back(root);
+        while (!callStack.empty()) {
+            uint32_t v = callStack.back();
+            uint32_t& pos = edgePos.back();
+            if (pos < offsets[v + 1]) {
+                uint32_t w = targets[pos++];
+                if (order[w] == NONE) {
+                    order[w] = low[w] = counter++;
+                    stack.push_back(w);
+                    callStack.push_back(w);
+                    edgePos.push_back(offsets[w]);
+                }
+                else if (scc[w] == NONE) {
+                    low[v] = min(low[v], order[w]);
+                }
+                continue;
+            }
+            callStack.pop_back();
+            edgePos.pop_back();
+            if (!callStack.empty()) low[callStack.back()] = min(low[callStack.back()], low[v]);
+            if (low[v] != order[v]) continue;
+            uint32_t w;
+            do {
+                w = stack.back();
+                stack.pop_back();
+                scc[w] = sccCount;
+            } while (w != v);
+            ++sccCount;
+        }
+    }
+
+    // Номер в DAG - топологический: 0 - источник, рёбра идут от меньших номеров к большим
+    dag.size = sccCount;
+    for (uint32_t v = 0; v < n; ++v) {
+        scc[v] = sccCount - 1 - scc[v];
+        sccOf[vertices[v]] = scc[v];
+    }
+
+    vector<pair<uint32_t, uint32_t>> dagEdges;
+    dagEdges.reserve(edges.size());
+    for (uint32_t v = 0; v < n; ++v) {
+        for (uint32_t i = offsets[v]; i < offsets[v + 1]; ++i) {
+            uint32_t a = scc[v], b = scc[targets[i]];
+            if (a != b) dagEdges.emplace_back(a, b);
+        }
+    }
+    sort(dagEdges.begin(), dagEdges.end());
+    dagEdges.erase(unique(dagEdges.begin(), dagEdges.end()), dagEdges.end());
+    dag.offsets.assign(sccCount + 1, 0);
+    dag.targets.resize(dagEdges.size());
+    for (size_t i = 0; i < dagEdges.size(); ++i) {
+        ++dag.offsets[dagEdges[i].first + 1];
+        dag.targets[i] = dagEdges[i].second;
+    }
+    for (uint32_t s = 0; s < sccCount; ++s) dag.offsets[s + 1] += dag.offsets[s];
+
+    if (sccCount <= CLOSURE_LIMIT) {
+        // Замыкание от стоков к источникам: строка вершины - она сама и строки её преемников
+        dag.words = (sccCount + 63) / 64;
+        dag.closure.assign((size_t)sccCount * dag.words, 0);
+        for (uint32_t s = sccCount; s-- > 0;) {
+            uint64_t* row = &dag.closure[(size_t)s * dag.words];
+            row[s / 64] |= 1ULL << (s % 64);
+            for (uint32_t i = dag.offsets[s]; i < dag.offsets[s + 1]; ++i) {
+                const uint64_t* next = &dag.closure[(size_t)dag.targets[i] * dag.words];
+                for (uint32_t w = 0; w < dag.words; ++w) row[w] |= next[w];
+            }
+        }
+        dag.offsets.clear();
+        dag.targets.clear();
+        return;
+    }
+
+    // Интервальные метки: post - номер завершения в обходе в глубину, low - наименьший
+    // post среди достижимых. Второй обход перебирает преемников в обратном порядке
+    for (int k = 0; k < 2; ++k) {
+        vector<Interval>& labels = dag.labels[k];
+        labels.assign(sccCount, Interval{ UINT32_MAX, UINT32_MAX });
+        uint32_t post = 0;
+        vector<pair<uint32_t, uint32_t>> frames;    // вершина, сколько преемников пройдено
+        for (uint32_t root = 0; root < sccCount; ++root) {
+            if (labels[root].low != UINT32_MAX) continue;
+            labels[root].low = UINT32_MAX - 1;      // в обходе
+            frames.emplace_back(root, 0);
+            while (!frames.empty()) {
+                uint32_t v = frames.back().first;
+                uint32_t degree = dag.offsets[v + 1] - dag.offsets[v];
+                if (frames.back().second < degree) {
+                    uint32_t i = frames.back().second++;
+                    uint32_t w = dag.targets[k == 0 ? dag.offsets[v] + i : dag.offsets[v + 1] - 1 - i];
+                    if (labels[w].low == UINT32_MAX) {
+                        labels[w].low = UINT32_MAX - 1;
+                        frames.emplace_back(w, 0);
+                    }
+                    continue;
+                }
+                frames.pop_back();
+                uint32_t low = post;
+                for (uint32_t i = dag.offsets[v]; i < dag.offsets[v + 1]; ++i) {
+                    low = min(low, labels[dag.targets[i]].low);
+                }
+                labels[v].post = post++;
+                labels[v].low = low;
+            }
+        }
+    }
+}
+
+bool ReachabilityIndex::Dag::mayReach(uint32_t a, uint32_t b) const {
+    // Номера вершин топологические: путь идёт только к большим номерам
+    if (a > b) return false;
+    for (const vector<Interval>& l : labels) {
+        if (l[b].low < l[a].low || l[b].post > l[a].post) return false;
+    }
+    return true;
+}
+
+bool ReachabilityIndex::Dag::reaches(uint32_t a, uint32_t b) const {
+    if (a == b) return true;
+    if (!closure.empty()) return (closure[(size_t)a * words + b / 64] >> (b % 64)) & 1;
+    if (!mayReach(a, b)) return false;
+    // Поиск в глубину только по вершинам, метки которых ещё допускают путь до b
+    vector<uint32_t> pending(1, a);
+    vector<bool> seen(size, false);
+    seen[a] = true;
+    while (!pending.empty()) {
+        uint32_t v = pending.back();
+        pending.pop_back();
+        for (uint32_t i = offsets[v]; i < offsets[v + 1]; ++i) {
+            uint32_t w = targets[i];
+            if (w == b) return true;
+            if (seen[w] || !mayReach(w, b)) continue;
+            seen[w] = true;
+            pending.push_back(w);
+        }
+    }
+    return false;
+}
+
+bool ReachabilityIndex::reaches(int fromCS, int toCS) const {
+    if (fromCS == toCS) return true;
+    auto from = vertexOf.find(fromCS), to = vertexOf.find(toCS);
+    if (from == vertexOf.end() || to == vertexOf.end()) return false;
+    int c = componentOf[from->second];
+    if (c != componentOf[to->second]) return false;
+    return components[c].reaches(sccOf[from->second], sccOf[to->second]);
+}
+
+size_t ReachabilityIndex::memoryBytes() const {
+    size_t bytes = componentOf.capacity() * sizeof(int32_t) + sccOf.capacity() * sizeof(uint32_t) +
+        vertexOf.size() * (sizeof(pair<const int, uint32_t>) + sizeof(void*)) + vertexOf.bucket_count() * sizeof(void*);
+    for (const Dag& dag : components) {
+        bytes += sizeof(Dag) + dag.closure.capacity() * sizeof(uint64_t) +
+            (dag.labels[0].capacity() + dag.labels[1].capacity()) * sizeof(Interval) +
+            (dag.offsets.capacity() + dag.targets.capacity()) * sizeof(uint32_t);
+    }
+    return bytes;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#ifndef REACH_H
+#define REACH_H
+
+#include "snapshot.h"
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+// Индекс достижимости "доходит ли газ от КС A до КС B" по активным соединениям
+// между существующими КС. Строится по снимку (можно в фоновом потоке), отдельно
+// для каждой компоненты связности (components.h):
+//  - сильно связные компоненты сжимаются в вершины (алгоритм Тарьяна), получается DAG;
+//  - для DAG до CLOSURE_LIMIT вершин хранится полное транзитивное замыкание битами;
+//  - для больших DAG - топологические номера и интервальные метки двух обходов в глубину:
+//    метка B вне метки A или номер A больше номера B означают "не доходит" сразу,
+//    иначе выполняется поиск, отсечённый теми же метками.
+// Разные компоненты и одна сильно связная компонента решаются без поиска.
+class ReachabilityIndex {
+public:
+    static const size_t CLOSURE_LIMIT = 4096;
+
+    void build(const StorageSnapshot& snap);
+    bool reaches(int fromCS, int toCS) const;
+
+    size_t componentCount() const { return components.size(); }
+    size_t stronglyConnectedCount() const { return sccTotal; }
+    size_t memoryBytes() const;
+
+private:
+    struct Interval {
+        uint32_t low;
+        uint32_t post;
+    };
+
+    // DAG одной компоненты связности; вершины - её сильно связные компоненты
+    // в топологическом порядке
+    struct Dag {
+        uint32_t size = 0;
+        std::vector<uint64_t> closure;          // size x words, если size <= CLOSURE_LIMIT
+        uint32_t words = 0;
+        std::vector<Interval> labels[2];        // иначе - метки двух обходов
+        std::vector<uint32_t> offsets;          // рёбра DAG (CSR) для поиска
+        std::vector<uint32_t> targets;
+
+        bool reaches(uint32_t a, uint32_t b) const;
+        bool mayReach(uint32_t a, uint32_t b) const;
+    };
+
+    // Вершины - КС с соединениями в плотной нумерации, память не зависит от величины ID
+    std::unordered_map<int, uint32_t> vertexOf;
+    std::vector<int32_t> componentOf;       // по номеру вершины
+    std::vector<uint32_t> sccOf;            // номер вершины DAG внутри компоненты
+    std::vector<Dag> components;
+    size_t sccTotal = 0;
+
+    static void buildDag(const std::vector<int>& vertices, const std::vector<std::pair<int, int>>& edges,
+        std::vector<uint32_t>& sccOf, Dag& dag);
+};
+
+#endif // REACH_H
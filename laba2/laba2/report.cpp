@@ -0,0 +1,139 @@
+﻿#include "report.h"
+#include <charconv>
+#include <cstdio>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const size_t REPORT_BUFFER_SIZE = 1 << 20;
+
+// Общий буфер потока: после первого отчёта память больше не выделяется
+static thread_local string sharedBuffer;
+static thread_local bool sharedBufferInUse = false;
+
+ReportWriter::ReportWriter(ostream& output, size_t pageLines)
+    : os(output), buf(nullptr), ownsBuffer(false), flushThreshold(REPORT_BUFFER_SIZE),
+    pageSize(pageLines), linesOnPage(0), stopped(false) {
+    if (!sharedBufferInUse) {
+        sharedBufferInUse = true;
+        buf = &sharedBuffer;
+    }
+    else {
+        buf = new string();
+        ownsBuffer = true;
+    }
+    buf->clear();
+    buf->reserve(REPORT_BUFFER_SIZE + 4096);
+}
+
+ReportWriter::~ReportWriter() {
+    flush();
+    if (ownsBuffer) delete buf;
+    else sharedBufferInUse = false;
+}
+
+ReportWriter& ReportWriter::operator<<(int v) {
+    char tmp[16];
+    auto r = to_chars(tmp, tmp + sizeof(tmp), v);
+    buf->append(tmp, r.ptr);
+    return *this;
+}
+
+ReportWriter& ReportWriter::operator<<(long long v) {
+    char tmp[24];
+    auto r = to_chars(tmp, tmp + sizeof(tmp), v);
+    buf->append(tmp, r.ptr);
+    return *this;
+}
+
+ReportWriter& ReportWriter::operator<<(size_t v) {
+    char tmp[24];
+    auto r = to_chars(tmp, tmp + sizeof(tmp), v);
+    buf->append(tmp, r.ptr);
+    return *this;
+}
+
+ReportWriter& ReportWriter::operator<<(double v) {
+    char tmp[32];
+    auto r = to_chars(tmp, tmp + sizeof(tmp), v, chars_format::general, 6);
+    buf->append(tmp, r.ptr);
+    return *this;
+}
+
+ReportWriter& ReportWriter::fixed(double v, int precision) {
+    char tmp[64];
+    auto r = to_chars(tmp, tmp + sizeof(tmp), v, chars_format::fixed, precision);
+    if (r.ec == errc()) buf->append(tmp, r.ptr);
+    else *this << v;
+    return *this;
+}
+
+// Число символов в строке UTF-8 (байты продолжения не считаются)
+static size_t displayWidth(const char* s, size_t n) {
+    size_t w = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (((unsigned char)s[i] & 0xC0) != 0x80) ++w;
+    }
+    return w;
+}
+
+ReportWriter& ReportWriter::cell(const string& s, size_t width) {
+    buf->append(s);
+    size_t w = displayWidth(s.data(), s.size());
+    if (w < width) buf->append(width - w, ' ');
+    buf->push_back(' ');
+    return *this;
+}
+
+ReportWriter& ReportWriter::cell(double v, size_t width, int precision) {
+    size_t start = buf->size();
+    fixed(v, precision);
+    size_t w = buf->size() - start;
+    if (w < width) buf->append(width - w, ' ');
+    buf->push_back(' ');
+    return *this;
+}
+
+ReportWriter& ReportWriter::cell(int v, size_t width) {
+    size_t start = buf->size();
+    *this << v;
+    size_t w = buf->size() - start;
+    if (w < width) buf->append(width - w, ' ');
+    buf->push_back(' ');
+    return *this;
+}
+
+void ReportWriter::endLine() {
+    buf->push_back('\n');
+    if (pageSize == 0 || stopped) {
+        maybeFlush();
+        return;
+    }
+    if (++linesOnPage < pageSize) return;
+
+    linesOnPage = 0;
+    flush();
+    os << "-- Enter - следующая страница, q - прервать вывод -- ";
+    os.flush();
+    string answer;
+    if (!getline(cin, answer) || answer == "q" || answer == "Q") stopped = true;
+}
+
+void ReportWriter::flush() {
+    if (buf->empty()) return;
+    os.write(buf->data(), (streamsize)buf->size());
+    os.flush();
+    buf->clear();
+}
+
+bool ReportWriter::outputIsRedirected() {
+#if defined(_WIN32)
+    return !_isatty(_fileno(stdout));
+#else
+    return !isatty(fileno(stdout));
+#endif
+}
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Буферизованный вывод отчётов и списков: текст копится в большом буфере
+// (переиспользуемом между отчётами) и уходит в поток блоками; числа
+// форматируются через std::to_chars без участия iostream.
+class ReportWriter {
+    std::ostream& os;
+    std::string* buf;
+    bool ownsBuffer;
+    size_t flushThreshold;
+    size_t pageSize;        // 0 - без постраничного вывода
+    size_t linesOnPage;
+    bool stopped;
+
+public:
+    explicit ReportWriter(std::ostream& output, size_t pageLines = 0);
+    ~ReportWriter();
+    ReportWriter(const ReportWriter&) = delete;
+    ReportWriter& operator=(const ReportWriter&) = delete;
+
+    ReportWriter& operator<<(const std::string& s) { buf->append(s); maybeFlush(); return *this; }
+    ReportWriter& operator<<(const char* s) { buf->append(s); maybeFlush(); return *this; }
+    ReportWriter& operator<<(char c) { buf->push_back(c); return *this; }
+    ReportWriter& operator<<(int v);
+    ReportWriter& operator<<(long long v);
+    ReportWriter& operator<<(size_t v);
+    ReportWriter& operator<<(double v);       // как ostream по умолчанию (6 значащих цифр)
+
+    ReportWriter& fixed(double v, int precision = 2);
+    // Поле фиксированной ширины (выравнивание по левому краю, UTF-8 учитывается)
+    ReportWriter& cell(const std::string& s, size_t width);
+    ReportWriter& cell(double v, size_t width, int precision = 2);
+    ReportWriter& cell(int v, size_t width);
+
+    // Конец строки; в постраничном режиме после каждой страницы спрашивает продолжение
+    void endLine();
+    bool isStopped() const { return stopped; }
+    void flush();
+
+    // Вывод перенаправлен в файл или канал (не терминал)
+    static bool outputIsRedirected();
+
+private:
+    void maybeFlush() { if (buf->size() >= flushThreshold) flush(); }
+};
+
+#endif // REPORT_H
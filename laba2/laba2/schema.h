@@ -0,0 +1,240 @@
+#pragma once
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include "entities.h"
+#include "network.h"
+#include <string>
+#include <tuple>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <ostream>
+
+// Описание полей сущностей на этапе компиляции. Форматы (текстовый, бинарный,
+// CSV) перебирают поля через forEachField/allFields, код для каждого поля
+// подставляется компилятором, без виртуальных вызовов и разбора строк формата.
+//
+// Вычисляемые поля (SchemaComputed) пишутся только в текстовый формат ради
+// совместимости со старыми файлами; остальные форматы их пропускают, а после
+// чтения вызывается Schema<T>::finish.
+
+enum SchemaFieldFlags { SchemaStored = 0, SchemaComputed = 1 };
+
+template<typename M> struct SchemaMember;
+template<typename C, typename M> struct SchemaMember<M C::*> {
+    typedef C Class;
+    typedef M Type;
+};
+
+template<auto Ptr, int Flags = SchemaStored>
+struct SchemaField {
+    typedef typename SchemaMember<decltype(Ptr)>::Class Class;
+    typedef typename SchemaMember<decltype(Ptr)>::Type Type;
+    static constexpr bool computed = (Flags & SchemaComputed) != 0;
+
+    const char* name;
+
+    static Type& get(Class& obj) { return obj.*Ptr; }
+    static const Type& get(const Class& obj) { return obj.*Ptr; }
+};
+
+template<> struct Schema<Pipe> {
+    static constexpr auto fields = std::make_tuple(
+        SchemaField<&Pipe::id>{ "id" },
+        SchemaField<&Pipe::name>{ "name" },
+        SchemaField<&Pipe::length>{ "length" },
+        SchemaField<&Pipe::diameter>{ "diameter" },
+        SchemaField<&Pipe::inRepair>{ "inRepair" });
+    static void finish(Pipe&) {}
+};
+
+template<> struct Schema<CS> {
+    static constexpr auto fields = std::make_tuple(
+        SchemaField<&CS::id>{ "id" },
+        SchemaField<&CS::name>{ "name" },
+        SchemaField<&CS::workshopsTotal>{ "workshopsTotal" },
+        SchemaField<&CS::workshopsWorking>{ "workshopsWorking" },
+        SchemaField<&CS::stationClass>{ "stationClass" },
+        SchemaField<&CS::efficiency, SchemaComputed>{ "efficiency" });
+    static void finish(CS& s) { s.updateEfficiency(); }
+};
+
+template<> struct Schema<Connection> {
+    static constexpr auto fields = std::make_tuple(
+        SchemaField<&Connection::id>{ "id" },
+        SchemaField<&Connection::pipeId>{ "pipeId" },
+        SchemaField<&Connection::csInId>{ "csInId" },
+        SchemaField<&Connection::csOutId>{ "csOutId" },
+        SchemaField<&Connection::isActive>{ "isActive" });
+    static void finish(Connection&) {}
+};
+
+// fn(field) для каждого поля по порядку
+template<typename T, typename F>
+inline void forEachField(F&& fn) {
+    std::apply([&](const auto&... f) { (fn(f), ...); }, Schema<T>::fields);
+}
+
+// То же, но с остановкой на первом поле, для которого fn вернула false
+template<typename T, typename F>
+inline bool allFields(F&& fn) {
+    return std::apply([&](const auto&... f) { return (fn(f) && ...); }, Schema<T>::fields);
+}
+
+template<typename T>
+constexpr size_t schemaFieldCount() { return std::tuple_size<decltype(Schema<T>::fields)>::value; }
+
+// Текстовые значения полей: целые, double (как ostream по умолчанию, %g с 6 знаками),
+// логические как 0/1, строки без изменений
+namespace schema_text {
+
+    inline void append(std::string& out, int v) {
+        char buf[16];
+        out.append(buf, std::to_chars(buf, buf + sizeof(buf), v).ptr);
+    }
+    inline void append(std::string& out, double v) {
+        char buf[32];
+        out.append(buf, std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::general, 6).ptr);
+    }
+    inline void append(std::string& out, bool v) { out += v ? '1' : '0'; }
+    inline void append(std::string& out, const std::string& v) { out += v; }
+
+    inline bool parse(const char* b, const char* e, int& out) {
+        auto r = std::from_chars(b, e, out);
+        return b != e && r.ec == std::errc() && r.ptr == e;
+    }
+    inline bool parse(const char* b, const char* e, double& out) {
+        auto r = std::from_chars(b, e, out);
+        return b != e && r.ec == std::errc() && r.ptr == e;
+    }
+    inline bool parse(const char* b, const char* e, bool& out) {
+        if (e - b != 1 || (*b != '0' && *b != '1')) return false;
+        out = (*b == '1');
+        return true;
+    }
+    inline bool parse(const char* b, const char* e, std::string& out) {
+        out.assign(b, e - b);
+        return true;
+    }
+}
+
+// Строка вида "поле|поле|..." (формат файлов сохранения)
+template<typename T>
+struct TextCodec {
+    static void encode(const T& obj, std::string& out) {
+        bool first = true;
+        forEachField<T>([&](const auto& f) {
+            if (!first) out += '|';
+            first = false;
+            schema_text::append(out, f.get(obj));
+        });
+    }
+
+    static std::string encode(const T& obj) {
+        std::string out;
+        encode(obj, out);
+        return out;
+    }
+
+    // Число полей должно совпадать со схемой
+    static bool decode(const char* begin, const char* end, T& obj) {
+        const char* p = begin;
+        bool ok = allFields<T>([&](const auto& f) {
+            if (!p) return false;
+            const char* sep = static_cast<const char*>(memchr(p, '|', end - p));
+            const char* fieldEnd = sep ? sep : end;
+            bool parsed = schema_text::parse(p, fieldEnd, f.get(obj));
+            p = sep ? sep + 1 : nullptr;
+            return parsed;
+        });
+        return ok && !p;
+    }
+};
+
+// Секция "HEADER ... ENDHEADER" текстового формата; each(fn) перечисляет записи.
+// Строки копятся в буфере и пишутся в поток крупными блоками.
+template<typename T, typename Each>
+void writeTextSection(std::ostream& os, const std::string& header, Each each) {
+    const size_t flushSize = 64 * 1024;
+    std::string buf;
+    buf.reserve(flushSize + 256);
+    buf += header;
+    buf += '\n';
+    each([&](const T& item) {
+        TextCodec<T>::encode(item, buf);
+        buf += '\n';
+        if (buf.size() >= flushSize) {
+            os.write(buf.data(), buf.size());
+            buf.clear();
+        }
+    });
+    buf += "END";
+    buf += header;
+    buf += '\n';
+    os.write(buf.data(), buf.size());
+}
+
+// Бинарные значения: числа в порядке байт машины (little-endian на поддерживаемых
+// платформах), строки - длина uint32 и байты
+namespace schema_binary {
+
+    template<typename V>
+    inline void appendRaw(std::string& out, V v) {
+        out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+    inline void append(std::string& out, int v) { appendRaw<int32_t>(out, v); }
+    inline void append(std::string& out, double v) { appendRaw(out, v); }
+    inline void append(std::string& out, bool v) { out += v ? '\1' : '\0'; }
+    inline void append(std::string& out, const std::string& v) {
+        appendRaw<uint32_t>(out, (uint32_t)v.size());
+        out += v;
+    }
+
+    template<typename V>
+    inline bool readRaw(const char*& p, const char* end, V& v) {
+        if ((size_t)(end - p) < sizeof(V)) return false;
+        memcpy(&v, p, sizeof(V));
+        p += sizeof(V);
+        return true;
+    }
+    inline bool read(const char*& p, const char* end, int& out) {
+        int32_t v;
+        if (!readRaw(p, end, v)) return false;
+        out = v;
+        return true;
+    }
+    inline bool read(const char*& p, const char* end, double& out) { return readRaw(p, end, out); }
+    inline bool read(const char*& p, const char* end, bool& out) {
+        if (p == end) return false;
+        out = (*p++ != 0);
+        return true;
+    }
+    inline bool read(const char*& p, const char* end, std::string& out) {
+        uint32_t n;
+        if (!readRaw(p, end, n) || (size_t)(end - p) < n) return false;
+        out.assign(p, n);
+        p += n;
+        return true;
+    }
+}
+
+template<typename T>
+struct BinaryCodec {
+    static void encode(const T& obj, std::string& out) {
+        forEachField<T>([&](const auto& f) {
+            if (!f.computed) schema_binary::append(out, f.get(obj));
+        });
+    }
+
+    // Читает одну запись с позиции p и сдвигает p за неё
+    static bool decode(const char*& p, const char* end, T& obj) {
+        bool ok = allFields<T>([&](const auto& f) {
+            return f.computed || schema_binary::read(p, end, f.get(obj));
+        });
+        if (ok) Schema<T>::finish(obj);
+        return ok;
+    }
+};
+
+#endif // SCHEMA_H
@@ -0,0 +1,295 @@
+﻿#include "segfile.h"
+#include "schema.h"
+#include "utils.h"
+#include <fstream>
+#include <cstring>
+
+using namespace std;
+
+static const size_t SEGMENT_HEADER_SIZE = 1 + 4 + 4 + 4;
+static const size_t DIRECTORY_ENTRY_SIZE = 1 + 4 + 8 + 4 + 4;
+static const size_t FOOTER_SIZE = 8 + 4 + 4 + 8 + 8;
+
+static int segmentKey(int id) { return (int)((unsigned)id >> SEGMENT_BITS); }
+// Первый и последний ID сегмента; у последнего сегмента конец - INT_MAX, поэтому в int64_t
+static int segmentFirst(int key) { return (int)((int64_t)key << SEGMENT_BITS); }
+static int segmentLast(int key) { return (int)((((int64_t)key + 1) << SEGMENT_BITS) - 1); }
+
+static uint32_t checksum(const char* p, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i) h = (h ^ (uint8_t)p[i]) * 16777619u;
+    return h;
+}
+
+// Сегмент: заголовок {таблица, номер, число записей, длина данных} и записи
+static void appendSegment(string& out, SegmentTable table, int key, const string& payload, uint32_t records) {
+    schema_binary::appendRaw<uint8_t>(out, (uint8_t)table);
+    schema_binary::appendRaw<int32_t>(out, key);
+    schema_binary::appendRaw<uint32_t>(out, records);
+    schema_binary::appendRaw<uint32_t>(out, (uint32_t)payload.size());
+    out += payload;
+}
+
+static void appendDirectory(string& out, const SegmentDirectory& dir, unsigned long long version) {
+    size_t start = out.size();
+    for (const auto& pair : dir) {
+        schema_binary::appendRaw<uint8_t>(out, pair.first.first);
+        schema_binary::appendRaw<int32_t>(out, pair.first.second);
+        schema_binary::appendRaw<uint64_t>(out, pair.second.offset);
+        schema_binary::appendRaw<uint32_t>(out, pair.second.length);
+        schema_binary::appendRaw<uint32_t>(out, pair.second.records);
+    }
+    uint32_t sum = checksum(out.data() + start, out.size() - start);
+    // Смещение каталога заполняет вызывающий: оно зависит от места записи
+    schema_binary::appendRaw<uint64_t>(out, 0);
+    schema_binary::appendRaw<uint32_t>(out, (uint32_t)dir.size());
+    schema_binary::appendRaw<uint32_t>(out, sum);
+    schema_binary::appendRaw<uint64_t>(out, version);
+    out.append(SEGMENTED_FILE_MAGIC, 8);
+}
+
+static void patchDirectoryOffset(string& tail, size_t footerAt, uint64_t dirOffset) {
+    memcpy(&tail[footerAt], &dirOffset, 8);
+}
+
+// Все записи таблицы: сегменты формируются по мере прохода
+template<typename T>
+static void appendAllSegments(string& out, uint64_t base, SegmentTable table,
+    const typename TableVersion<T>::Ptr& t, SegmentDirectory& dir) {
+    if (!t) return;
+    string payload;
+    uint32_t records = 0;
+    int key = -1;
+    auto flush = [&]() {
+        if (records == 0) return;
+        SegmentEntry e;
+        e.offset = base + out.size();
+        e.records = records;
+        appendSegment(out, table, key, payload, records);
+        e.length = (uint32_t)(base + out.size() - e.offset);
+        dir[make_pair((uint8_t)table, key)] = e;
+        payload.clear();
+        records = 0;
+    };
+    t->forEach([&](const T& item) {
+        int k = segmentKey(item.getId());
+        if (k != key) {
+            flush();
+            key = k;
+        }
+        BinaryCodec<T>::encode(item, payload);
+        ++records;
+    });
+    flush();
+}
+
+// Сегменты с изменёнными ID; сегмент без записей удаляется из каталога
+template<typename T>
+static size_t appendDirtySegments(string& out, uint64_t base, SegmentTable table,
+    const typename TableVersion<T>::Ptr& t, const vector<int>& ids, SegmentDirectory& dir) {
+    size_t written = 0;
+    int last = -1;
+    string payload;
+    for (int id : ids) {
+        int key = segmentKey(id);
+        if (key == last) continue;
+        last = key;
+        payload.clear();
+        uint32_t records = 0;
+        if (t) {
+            t->forEachInRange(segmentFirst(key), segmentLast(key), [&](const T& item) {
+                BinaryCodec<T>::encode(item, payload);
+                ++records;
+            });
+        }
+        auto slot = make_pair((uint8_t)table, key);
+        if (records == 0) {
+            dir.erase(slot);
+            continue;
+        }
+        SegmentEntry e;
+        e.offset = base + out.size();
+        e.records = records;
+        appendSegment(out, table, key, payload, records);
+        e.length = (uint32_t)(base + out.size() - e.offset);
+        dir[slot] = e;
+        ++written;
+    }
+    return written;
+}
+
+bool isSegmentedFile(const string& filename) {
+    ifstream f(filename, ios::binary);
+    char magic[8];
+    return f.read(magic, 8) && memcmp(magic, SEGMENTED_FILE_MAGIC, 8) == 0;
+}
+
+static bool readBytes(istream& f, uint64_t at, size_t n, string& out) {
+    out.resize(n);
+    f.clear();
+    f.seekg((streamoff)at);
+    return (bool)f.read(&out[0], n);
+}
+
+// Разбор каталога по оглавлению, которое заканчивается в позиции footerEnd
+static bool parseDirectory(istream& f, uint64_t footerEnd, SegmentDirectory& dir) {
+    string buf;
+    if (footerEnd < 8 + FOOTER_SIZE || !readBytes(f, footerEnd - FOOTER_SIZE, FOOTER_SIZE, buf)) return false;
+    if (memcmp(buf.data() + FOOTER_SIZE - 8, SEGMENTED_FILE_MAGIC, 8) != 0) return false;
+    const char* p = buf.data();
+    const char* end = p + buf.size();
+    uint64_t dirOffset = 0;
+    uint32_t count = 0, sum = 0;
+    if (!schema_binary::readRaw(p, end, dirOffset) || !schema_binary::readRaw(p, end, count) ||
+        !schema_binary::readRaw(p, end, sum)) return false;
+    uint64_t dirBytes = (uint64_t)count * DIRECTORY_ENTRY_SIZE;
+    if (dirOffset < 8 || dirOffset + dirBytes != footerEnd - FOOTER_SIZE) return false;
+    if (!readBytes(f, dirOffset, (size_t)dirBytes, buf) || checksum(buf.data(), buf.size()) != sum) return false;
+
+    dir.clear();
+    p = buf.data();
+    end = p + buf.size();
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t table = 0;
+        int32_t key = 0;
+        SegmentEntry e;
+        if (!schema_binary::readRaw(p, end, table) || !schema_binary::readRaw(p, end, key) ||
+            !schema_binary::readRaw(p, end, e.offset) || !schema_binary::readRaw(p, end, e.length) ||
+            !schema_binary::readRaw(p, end, e.records)) return false;
+        if (e.offset < 8 || e.offset + e.length > dirOffset) return false;
+        dir[make_pair(table, (int)key)] = e;
+    }
+    return true;
+}
+
+// Последнее целое оглавление. Обычно оно в самом конце файла; после сбоя посреди
+// дописывания там остаётся недописанный хвост, и оглавление ищется перед ним
+static bool findDirectory(istream& f, SegmentDirectory& dir, uint64_t& validEnd) {
+    string head;
+    if (!readBytes(f, 0, 8, head) || memcmp(head.data(), SEGMENTED_FILE_MAGIC, 8) != 0) return false;
+    f.seekg(0, ios::end);
+    uint64_t size = (uint64_t)f.tellg();
+    if (parseDirectory(f, size, dir)) {
+        validEnd = size;
+        return true;
+    }
+    string data;
+    if (!readBytes(f, 0, (size_t)size, data)) return false;
+    for (uint64_t end = size; end >= 8 + FOOTER_SIZE; --end) {
+        if (memcmp(data.data() + end - 8, SEGMENTED_FILE_MAGIC, 8) == 0 && parseDirectory(f, end, dir)) {
+            validEnd = end;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Полная запись: новый файл через временный
+static SegmentSaveResult writeFull(const StorageSnapshot& snap, const string& filename) {
+    SegmentSaveResult result;
+    result.full = true;
+    string out(SEGMENTED_FILE_MAGIC, 8);
+    SegmentDirectory dir;
+    appendAllSegments<Pipe>(out, 0, SegmentTable::Pipes, snap.pipes, dir);
+    appendAllSegments<CS>(out, 0, SegmentTable::Stations, snap.stations, dir);
+    appendAllSegments<Connection>(out, 0, SegmentTable::Connections, snap.connections, dir);
+    uint64_t dirOffset = out.size();
+    appendDirectory(out, dir, snap.version);
+    patchDirectoryOffset(out, out.size() - FOOTER_SIZE, dirOffset);
+
+    result.ok = writeFileAtomically(filename, [&](ostream& os) {
+        os.write(out.data(), out.size());
+        return (bool)os;
+    }, true);
+    result.segments = dir.size();
+    result.bytes = out.size();
+    return result;
+}
+
+SegmentSaveResult writeSegmentedFile(const StorageSnapshot& snap, const string& filename,
+    const SegmentChanges& changes, bool incremental) {
+    vector<int> pipeIds, csIds, connIds;
+    bool partial = incremental && changes.pipes && changes.stations && changes.connections &&
+        changes.pipes->collect(pipeIds) && changes.stations->collect(csIds) && changes.connections->collect(connIds);
+
+    ifstream in(filename, ios::binary);
+    SegmentDirectory dir;
+    uint64_t validEnd = 0;
+    if (!partial || !in || !findDirectory(in, dir, validEnd)) {
+        return writeFull(snap, filename);
+    }
+    in.close();
+
+    // Новые сегменты, каталог и оглавление дописываются после последнего целого оглавления
+    string tail;
+    size_t written = appendDirtySegments<Pipe>(tail, validEnd, SegmentTable::Pipes, snap.pipes, pipeIds, dir);
+    written += appendDirtySegments<CS>(tail, validEnd, SegmentTable::Stations, snap.stations, csIds, dir);
+    written += appendDirtySegments<Connection>(tail, validEnd, SegmentTable::Connections, snap.connections,
+        connIds, dir);
+    uint64_t dirOffset = validEnd + tail.size();
+    appendDirectory(tail, dir, snap.version);
+    patchDirectoryOffset(tail, tail.size() - FOOTER_SIZE, dirOffset);
+
+    // Мусор от прежних версий сегментов: когда файл вдвое больше живых данных - полная перезапись
+    uint64_t live = 8 + dir.size() * DIRECTORY_ENTRY_SIZE + FOOTER_SIZE;
+    for (const auto& pair : dir) live += pair.second.length;
+    if (validEnd + tail.size() > 2 * live + (1 << 20)) return writeFull(snap, filename);
+
+    SegmentSaveResult result;
+    {
+        fstream f(filename, ios::in | ios::out | ios::binary);
+        if (!f) return result;
+        f.seekp((streamoff)validEnd);
+        f.write(tail.data(), tail.size());
+        f.flush();
+        if (!f) return result;
+    }
+    result.ok = true;
+    result.segments = written;
+    result.bytes = tail.size();
+    return result;
+}
+
+template<typename T>
+static bool decodeSegment(const string& data, const SegmentEntry& e, vector<T>& out) {
+    const char* p = data.data() + e.offset + SEGMENT_HEADER_SIZE;
+    const char* end = data.data() + e.offset + e.length;
+    if (e.length < SEGMENT_HEADER_SIZE) return false;
+    for (uint32_t i = 0; i < e.records; ++i) {
+        T item;
+        if (!BinaryCodec<T>::decode(p, end, item)) return false;
+        out.push_back(std::move(item));
+    }
+    return p == end;
+}
+
+bool readSegmentedFile(const string& filename, vector<Pipe>& pipes, vector<CS>& stations,
+    vector<Connection>& connections, string& error) {
+    ifstream in(filename, ios::binary);
+    SegmentDirectory dir;
+    uint64_t validEnd = 0;
+    string data;
+    if (!in) {
+        error = "не удалось открыть файл " + filename;
+        return false;
+    }
+    if (!findDirectory(in, dir, validEnd) || !readBytes(in, 0, (size_t)validEnd, data)) {
+        error = "файл " + filename + " не является сегментированным сохранением";
+        return false;
+    }
+    // Каталог упорядочен по (таблица, номер сегмента), значит и записи идут по возрастанию ID
+    for (const auto& pair : dir) {
+        bool ok;
+        switch ((SegmentTable)pair.first.first) {
+        case SegmentTable::Pipes: ok = decodeSegment(data, pair.second, pipes); break;
+        case SegmentTable::Stations: ok = decodeSegment(data, pair.second, stations); break;
+        case SegmentTable::Connections: ok = decodeSegment(data, pair.second, connections); break;
+        default: ok = false;
+        }
+        if (!ok) {
+            error = "повреждён сегмент " + to_string(pair.first.second) + " в файле " + filename;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#ifndef SEGFILE_H
+#define SEGFILE_H
+
+#include "snapshot.h"
+#include "dirty.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <cstddef>
+
+// Сегментированный файл сохранения. Записи каждой таблицы разбиты на сегменты по
+// 2^SEGMENT_BITS подряд идущих ID (BinaryCodec); в конце файла - каталог сегментов
+// и оглавление с контрольной суммой каталога.
+//
+// Повторное сохранение в тот же файл дописывает в конец только сегменты, где есть
+// изменённые записи, и новый каталог; прежние версии сегментов становятся мусором.
+// Пока новое оглавление не записано, действует старое, поэтому сбой посреди записи
+// не портит сохранённые данные. Когда мусора больше, чем живых данных, файл
+// переписывается целиком.
+const int SEGMENT_BITS = 10;
+const char SEGMENTED_FILE_MAGIC[9] = "GTSEG001";
+
+enum class SegmentTable : uint8_t { Pipes = 0, Stations = 1, Connections = 2 };
+
+struct SegmentEntry {
+    uint64_t offset = 0;    // заголовок сегмента
+    uint32_t length = 0;    // вместе с заголовком
+    uint32_t records = 0;
+};
+
+// Каталог: (таблица, номер сегмента) -> положение в файле
+typedef std::map<std::pair<uint8_t, int>, SegmentEntry> SegmentDirectory;
+
+struct SegmentSaveResult {
+    bool ok = false;
+    bool full = false;          // файл записан заново
+    size_t segments = 0;        // записано сегментов
+    size_t bytes = 0;           // записано байт
+};
+
+// Изменения по таблицам; nullptr или "изменено всё" - полная запись
+struct SegmentChanges {
+    const DirtyTracker* pipes = nullptr;
+    const DirtyTracker* stations = nullptr;
+    const DirtyTracker* connections = nullptr;
+};
+
+bool isSegmentedFile(const std::string& filename);
+// incremental = false или недоступный каталог - полная запись через временный файл
+SegmentSaveResult writeSegmentedFile(const StorageSnapshot& snap, const std::string& filename,
+    const SegmentChanges& changes, bool incremental);
+bool readSegmentedFile(const std::string& filename, std::vector<Pipe>& pipes, std::vector<CS>& stations,
+    std::vector<Connection>& connections, std::string& error);
+
+#endif // SEGFILE_H
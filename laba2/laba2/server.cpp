@@ -0,0 +1,443 @@
+﻿#include "server.h"
+#include "utils.h"
+#include "filter.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+using namespace std;
+
+// Ограничение на длину одной строки запроса
+static const size_t MAX_REQUEST_LINE = 1 << 20;
+
+QueryServer::QueryServer(Storage& st, const string& path, size_t workers)
+    : storage(st), socketPath(path), workerCount(workers) {
+    if (workerCount == 0) workerCount = max(2u, thread::hardware_concurrency());
+}
+
+static void replyError(string& out, const string& message) {
+    out += "ERR ";
+    out += message;
+    out += '\n';
+}
+
+// Ответ из заранее собранных строк
+static void replyLines(string& out, const vector<string>& lines) {
+    out += "OK ";
+    out += to_string(lines.size());
+    out += '\n';
+    for (const string& line : lines) {
+        out += line;
+        out += '\n';
+    }
+}
+
+template<typename T>
+static void replyFiltered(string& out, const typename TableVersion<T>::Ptr& table, const string& expression) {
+    CompiledFilter<T> filter;
+    string error;
+    if (!expression.empty() && !filter.compile(expression, error)) {
+        replyError(out, error);
+        return;
+    }
+
+    // Условие проверяется пачками по столбцам (selectMatching), как в Storage::filterPipes
+    vector<const T*> items;
+    if (table) {
+        items.reserve(table->size());
+        table->forEach([&](const T& item) { items.push_back(&item); });
+    }
+    if (!expression.empty()) items = selectMatching(filter, items);
+
+    string body;
+    for (const T* item : items) {
+        body += item->toSingleLine();
+        body += '\n';
+    }
+    out += "OK ";
+    out += to_string(items.size());
+    out += '\n';
+    out += body;
+}
+
+void QueryServer::handleRequest(const string& rawLine, string& out) {
+    string line = trim(rawLine);
+    size_t space = line.find(' ');
+    string cmd = line.substr(0, space);
+    string rest = (space == string::npos) ? "" : trim(line.substr(space + 1));
+
+    istringstream iss(rest);
+    vector<int> nums;
+    string tok;
+    bool numeric = true;
+    while (iss >> tok) {
+        int v;
+        if (parseInt(tok, v)) nums.push_back(v);
+        else numeric = false;
+    }
+
+    if (cmd == "ping") {
+        replyLines(out, { "pong" });
+        return;
+    }
+    if (cmd == "stats") {
+        StorageSnapshot snap = storage.snapshot();
+        replyLines(out, {
+            "pipes " + to_string(snap.pipes ? snap.pipes->size() : 0),
+            "cs " + to_string(snap.stations ? snap.stations->size() : 0),
+            "connections " + to_string(snap.connections ? snap.connections->size() : 0),
+            "version " + to_string(snap.version) });
+        return;
+    }
+    if (cmd == "get-pipe" || cmd == "get-cs" || cmd == "get-connection") {
+        if (nums.size() != 1 || !numeric) {
+            replyError(out, "формат: " + cmd + " <id>");
+            return;
+        }
+        StorageSnapshot snap = storage.snapshot();
+        string found;
+        if (cmd == "get-pipe") {
+            if (const Pipe* p = snap.findPipe(nums[0])) found = p->toSingleLine();
+        }
+        else if (cmd == "get-cs") {
+            if (const CS* s = snap.findCS(nums[0])) found = s->toSingleLine();
+        }
+        else if (const Connection* c = snap.findConnection(nums[0])) {
+            found = c->toSingleLine();
+        }
+        if (found.empty()) replyError(out, "объект с ID " + to_string(nums[0]) + " не найден");
+        else replyLines(out, { found });
+        return;
+    }
+    if (cmd == "filter-pipes") {
+        StorageSnapshot snap = storage.snapshot();
+        replyFiltered<Pipe>(out, snap.pipes, rest);
+        return;
+    }
+    if (cmd == "filter-cs") {
+        StorageSnapshot snap = storage.snapshot();
+        replyFiltered<CS>(out, snap.stations, rest);
+        return;
+    }
+    if (cmd == "topo") {
+        StorageSnapshot snap = storage.snapshot();
+        vector<int> order = snap.topologicalOrder();
+        string ids;
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (i > 0) ids += ' ';
+            ids += to_string(order[i]);
+        }
+        replyLines(out, { ids });
+        return;
+    }
+    if (cmd == "connect") {
+        if (nums.size() != 3 || !numeric) {
+            replyError(out, "формат: connect <ID КС входа> <ID КС выхода> <диаметр>");
+            return;
+        }
+        string error;
+        int id;
+        {
+            lock_guard<mutex> lock(writeMutex);
+            id = storage.connectStations(nums[0], nums[1], nums[2], error);
+        }
+        if (id == 0) replyError(out, error);
+        else replyLines(out, { to_string(id) });
+        return;
+    }
+    if (cmd == "disconnect") {
+        if (nums.size() != 1 || !numeric) {
+            replyError(out, "формат: disconnect <id>");
+            return;
+        }
+        bool removed;
+        {
+            lock_guard<mutex> lock(writeMutex);
+            removed = storage.deleteConnection(nums[0]);
+        }
+        if (!removed) replyError(out, "соединение с ID " + to_string(nums[0]) + " не найдено");
+        else replyLines(out, {});
+        return;
+    }
+    replyError(out, "неизвестная команда: " + cmd);
+}
+
+#if defined(__linux__)
+
+static atomic<int> stopEventFd(-1);
+
+static void onStopSignal(int) {
+    int fd = stopEventFd.load();
+    if (fd >= 0) {
+        uint64_t one = 1;
+        ssize_t r = write(fd, &one, sizeof(one));
+        (void)r;
+    }
+}
+
+// Отправляет весь буфер; при заполненном буфере сокета ждёт готовности
+static bool sendAll(int fd, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pollfd p = { fd, POLLOUT, 0 };
+            if (poll(&p, 1, 5000) <= 0) return false;
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+struct ClientState {
+    mutex busy;     // передача клиента между потоками пула
+    string input;   // непрочитанный остаток (неполная строка)
+    string output;
+};
+
+// Очередь готовых к чтению клиентов для пула потоков
+class ReadyQueue {
+    deque<int> fds;
+    mutex mtx;
+    condition_variable cv;
+    bool closed = false;
+
+public:
+    void push(int fd) {
+        {
+            lock_guard<mutex> lock(mtx);
+            fds.push_back(fd);
+        }
+        cv.notify_one();
+    }
+    bool pop(int& fd) {
+        unique_lock<mutex> lock(mtx);
+        cv.wait(lock, [this] { return closed || !fds.empty(); });
+        if (fds.empty()) return false;
+        fd = fds.front();
+        fds.pop_front();
+        return true;
+    }
+    void close() {
+        {
+            lock_guard<mutex> lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+};
+
+}
+
+bool QueryServer::run() {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof(addr.sun_path)) {
+        cout << "Некорректный путь к сокету: " << socketPath << "\n";
+        return false;
+    }
+    memcpy(addr.sun_path, socketPath.c_str(), socketPath.size());
+
+    // Удаляется только оставшийся от прошлого запуска сокет, не файл пользователя
+    struct stat st;
+    if (lstat(socketPath.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            cout << "Путь " << socketPath << " занят файлом, который не является сокетом\n";
+            return false;
+        }
+        unlink(socketPath.c_str());
+    }
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        cout << "Не удалось создать сокет: " << strerror(errno) << "\n";
+        return false;
+    }
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, SOMAXCONN) < 0) {
+        cout << "Не удалось открыть сокет " << socketPath << ": " << strerror(errno) << "\n";
+        close(listenFd);
+        return false;
+    }
+
+    int stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    stopEventFd = stopFd;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onStopSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+    ev.data.fd = stopFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &ev);
+
+    mutex clientsMutex;
+    unordered_map<int, shared_ptr<ClientState>> clients;
+    ReadyQueue ready;
+
+    auto dropClient = [&](int fd) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        {
+            lock_guard<mutex> lock(clientsMutex);
+            clients.erase(fd);
+        }
+        close(fd);
+    };
+
+    // Клиент обслуживается одним потоком за раз (EPOLLONESHOT), после чего
+    // снова ставится на ожидание
+    auto serveClient = [&](int fd) {
+        shared_ptr<ClientState> client;
+        {
+            lock_guard<mutex> lock(clientsMutex);
+            auto it = clients.find(fd);
+            if (it == clients.end()) return;
+            client = it->second;
+        }
+        unique_lock<mutex> clientLock(client->busy);
+
+        // Полные строки обрабатываются сразу после каждого чтения, поэтому в буфере остаётся
+        // только незаконченная строка: её длина проверяется до следующего recv
+        bool open = true;
+        char buf[65536];
+        while (open) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) open = false;
+                break;
+            }
+            client->input.append(buf, (size_t)n);
+
+            size_t start = 0, nl;
+            while ((nl = client->input.find('\n', start)) != string::npos) {
+                string line(client->input, start, nl - start);
+                start = nl + 1;
+                if (!trim(line).empty()) handleRequest(line, client->output);
+            }
+            client->input.erase(0, start);
+            if (client->input.size() > MAX_REQUEST_LINE) {
+                replyError(client->output, "слишком длинный запрос");
+                client->input.clear();
+                open = false;
+            }
+
+            if (!client->output.empty()) {
+                if (!sendAll(fd, client->output)) open = false;
+                client->output.clear();
+            }
+        }
+
+        clientLock.unlock();
+        if (!open) {
+            dropClient(fd);
+            return;
+        }
+        epoll_event rearm;
+        memset(&rearm, 0, sizeof(rearm));
+        rearm.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        rearm.data.fd = fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &rearm) < 0) dropClient(fd);
+    };
+
+    vector<thread> workers;
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back([&] {
+            int fd;
+            while (ready.pop(fd)) serveClient(fd);
+        });
+    }
+
+    cout << "Сервер слушает " << socketPath << " (потоков: " << workerCount << ")\n" << flush;
+    LOG.log("Server started on \"" + socketPath + "\"");
+
+    vector<epoll_event> events(256);
+    bool running = true;
+    while (running) {
+        int n = epoll_wait(epollFd, events.data(), (int)events.size(), -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == stopFd) {
+                running = false;
+            }
+            else if (fd == listenFd) {
+                int clientFd;
+                while ((clientFd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    {
+                        lock_guard<mutex> lock(clientsMutex);
+                        clients[clientFd] = make_shared<ClientState>();
+                    }
+                    epoll_event cev;
+                    memset(&cev, 0, sizeof(cev));
+                    cev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+                    cev.data.fd = clientFd;
+                    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &cev) < 0) dropClient(clientFd);
+                }
+            }
+            else {
+                ready.push(fd);
+            }
+        }
+    }
+
+    ready.close();
+    for (thread& w : workers) w.join();
+    for (auto& pair : clients) close(pair.first);
+    clients.clear();
+
+    stopEventFd = -1;
+    close(epollFd);
+    close(stopFd);
+    close(listenFd);
+    unlink(socketPath.c_str());
+    cout << "Сервер остановлен.\n";
+    LOG.log("Server stopped.");
+    return true;
+}
+
+#else
+
+bool QueryServer::run() {
+    cout << "Режим сервера поддерживается только в Linux.\n";
+    return false;
+}
+
+#endif
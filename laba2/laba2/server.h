@@ -0,0 +1,36 @@
+#pragma once
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "storage.h"
+#include <string>
+#include <mutex>
+
+// Сервер запросов на локальном сокете (Unix domain socket, только Linux).
+// Протокол строковый: одна команда на строку, ответ -
+//   "OK <n>\n" и n строк данных (формат toSingleLine), либо "ERR <текст>\n".
+// Команды:
+//   ping | stats
+//   get-pipe <id> | get-cs <id> | get-connection <id>
+//   filter-pipes [выражение] | filter-cs [выражение]   (синтаксис filter.h)
+//   topo
+//   connect <ID КС входа> <ID КС выхода> <диаметр> | disconnect <id>
+// Чтение идёт по снимкам Storage и выполняется параллельно в пуле потоков,
+// изменения выполняются по одному под writeMutex.
+class QueryServer {
+    Storage& storage;
+    std::string socketPath;
+    size_t workerCount;
+    std::mutex writeMutex;
+
+public:
+    QueryServer(Storage& st, const std::string& path, size_t workers = 0);
+
+    // Работает до SIGINT/SIGTERM; false, если сокет не удалось открыть
+    bool run();
+
+    // Выполняет одну команду и дописывает ответ в out
+    void handleRequest(const std::string& line, std::string& out);
+};
+
+#endif // SERVER_H
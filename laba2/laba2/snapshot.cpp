@@ -0,0 +1,72 @@
+﻿#include "snapshot.h"
+#include "utils.h"
+#include "schema.h"
+#include <fstream>
+#include <map>
+#include <queue>
+
+using namespace std;
+
+template<typename T>
+static void writeSection(ostream& os, const string& header, const typename TableVersion<T>::Ptr& table) {
+    writeTextSection<T>(os, header, [&](auto&& write) {
+        if (table) table->forEach(write);
+    });
+}
+
+void StorageSnapshot::saveToStream(ostream& os) const {
+    writeSection<Pipe>(os, "PIPES", pipes);
+    writeSection<CS>(os, "CS", stations);
+    writeSection<Connection>(os, "CONNECTIONS", connections);
+}
+
+template<typename T>
+static void writePart(ostream& os, const string& header, const typename TableVersion<T>::Ptr& table,
+    size_t part, size_t parts) {
+    writeTextSection<T>(os, header, [&](auto&& write) {
+        if (table) table->forEachPart(part, parts, write);
+    });
+}
+
+void StorageSnapshot::savePartToStream(ostream& os, size_t part, size_t parts) const {
+    writePart<Pipe>(os, "PIPES", pipes, part, parts);
+    writePart<CS>(os, "CS", stations, part, parts);
+    writePart<Connection>(os, "CONNECTIONS", connections, part, parts);
+}
+
+bool StorageSnapshot::saveToFile(const string& filename) const {
+    return writeFileAtomically(filename, [this](ostream& os) {
+        saveToStream(os);
+        return (bool)os;
+    });
+}
+
+vector<int> StorageSnapshot::topologicalOrder() const {
+    vector<int> result;
+    if (!connections) return result;
+
+    map<int, int> inDegree;
+    map<int, vector<int>> adjList;
+    connections->forEach([&](const Connection& conn) {
+        if (!conn.isActive || !findCS(conn.csInId) || !findCS(conn.csOutId)) return;
+        adjList[conn.csInId].push_back(conn.csOutId);
+        inDegree[conn.csOutId]++;
+        inDegree.emplace(conn.csInId, 0);
+    });
+
+    queue<int> zeroInDegree;
+    for (const auto& pair : inDegree) {
+        if (pair.second == 0) zeroInDegree.push(pair.first);
+    }
+    while (!zeroInDegree.empty()) {
+        int csId = zeroInDegree.front();
+        zeroInDegree.pop();
+        result.push_back(csId);
+        auto it = adjList.find(csId);
+        if (it == adjList.end()) continue;
+        for (int neighbor : it->second) {
+            if (--inDegree[neighbor] == 0) zeroInDegree.push(neighbor);
+        }
+    }
+    return result;
+}
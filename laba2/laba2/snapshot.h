@@ -0,0 +1,178 @@
+#pragma once
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "entities.h"
+#include "network.h"
+#include "memstats.h"
+#include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iostream>
+
+// Неизменяемая версия таблицы сущностей. Записи отсортированы по ID и лежат
+// блоками до TABLE_CHUNK_SIZE штук; новая версия копирует только изменённый
+// блок и массив указателей на блоки, остальные блоки разделяются с предыдущей.
+const size_t TABLE_CHUNK_SIZE = 256;
+
+template<typename T>
+class TableVersion {
+public:
+    typedef std::vector<T, TrackedAllocator<T, MemSubsystem::Snapshots>> Chunk;
+    typedef std::shared_ptr<const Chunk> ChunkPtr;
+    typedef std::shared_ptr<const TableVersion> Ptr;
+
+private:
+    std::vector<ChunkPtr, TrackedAllocator<ChunkPtr, MemSubsystem::Snapshots>> chunks;
+    size_t count;
+
+    // Индекс блока, в котором должна лежать запись с данным ID
+    size_t chunkFor(int id) const {
+        size_t lo = 0, hi = chunks.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (chunks[mid]->back().getId() < id) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo < chunks.size() ? lo : chunks.size() - 1;
+    }
+
+    static typename Chunk::const_iterator lowerBound(const Chunk& c, int id) {
+        return std::lower_bound(c.begin(), c.end(), id,
+            [](const T& item, int key) { return item.getId() < key; });
+    }
+
+public:
+    TableVersion() : count(0) {}
+
+    size_t size() const { return count; }
+
+    const T* find(int id) const {
+        if (chunks.empty()) return nullptr;
+        const Chunk& c = *chunks[chunkFor(id)];
+        auto it = lowerBound(c, id);
+        return (it != c.end() && it->getId() == id) ? &*it : nullptr;
+    }
+
+    template<typename F>
+    void forEach(F fn) const {
+        for (const ChunkPtr& c : chunks) {
+            for (const T& item : *c) fn(item);
+        }
+    }
+
+    // Записи с ID в [lo, hi] по возрастанию; hi включается, чтобы диапазон,
+    // кончающийся на INT_MAX, задавался без переполнения
+    template<typename F>
+    void forEachInRange(int lo, int hi, F fn) const {
+        if (chunks.empty()) return;
+        for (size_t i = chunkFor(lo); i < chunks.size(); ++i) {
+            const Chunk& c = *chunks[i];
+            for (auto it = lowerBound(c, lo); it != c.end(); ++it) {
+                if (it->getId() > hi) return;
+                fn(*it);
+            }
+        }
+    }
+
+    // Часть part из parts: записи блоков [chunks*part/parts, chunks*(part+1)/parts),
+    // то есть непрерывный диапазон ID; части вместе перечисляют всю таблицу по порядку
+    template<typename F>
+    void forEachPart(size_t part, size_t parts, F fn) const {
+        size_t begin = chunks.size() * part / parts, end = chunks.size() * (part + 1) / parts;
+        for (size_t i = begin; i < end; ++i) {
+            for (const T& item : *chunks[i]) fn(item);
+        }
+    }
+
+    // Новая версия с добавленной или заменённой записью
+    Ptr withUpsert(const T& item) const {
+        std::shared_ptr<TableVersion> next = std::make_shared<TableVersion>(*this);
+        if (chunks.empty()) {
+            next->chunks.push_back(std::make_shared<const Chunk>(1, item));
+            next->count = 1;
+            return next;
+        }
+
+        size_t idx = chunkFor(item.getId());
+        std::shared_ptr<Chunk> copy = std::make_shared<Chunk>(*chunks[idx]);
+        auto it = std::lower_bound(copy->begin(), copy->end(), item.getId(),
+            [](const T& x, int key) { return x.getId() < key; });
+        if (it != copy->end() && it->getId() == item.getId()) {
+            *it = item;
+        }
+        else {
+            copy->insert(it, item);
+            ++next->count;
+        }
+
+        if (copy->size() > 2 * TABLE_CHUNK_SIZE) {
+            std::shared_ptr<Chunk> tail = std::make_shared<Chunk>(copy->begin() + TABLE_CHUNK_SIZE, copy->end());
+            copy->erase(copy->begin() + TABLE_CHUNK_SIZE, copy->end());
+            next->chunks.insert(next->chunks.begin() + idx + 1, tail);
+        }
+        next->chunks[idx] = copy;
+        return next;
+    }
+
+    // Новая версия без записи с данным ID (или та же, если записи нет)
+    Ptr withErase(int id, const Ptr& self) const {
+        if (!find(id)) return self;
+        std::shared_ptr<TableVersion> next = std::make_shared<TableVersion>(*this);
+        size_t idx = chunkFor(id);
+        std::shared_ptr<Chunk> copy = std::make_shared<Chunk>(*chunks[idx]);
+        copy->erase(lowerBound(*copy, id));
+        --next->count;
+        if (copy->empty()) next->chunks.erase(next->chunks.begin() + idx);
+        else next->chunks[idx] = copy;
+        return next;
+    }
+
+    // Полная сборка версии; fill(add) должен перечислять записи по возрастанию ID
+    template<typename Fill>
+    static Ptr build(Fill fill) {
+        std::shared_ptr<TableVersion> v = std::make_shared<TableVersion>();
+        std::shared_ptr<Chunk> cur;
+        fill([&](const T& item) {
+            if (!cur) {
+                cur = std::make_shared<Chunk>();
+                cur->reserve(TABLE_CHUNK_SIZE);
+            }
+            cur->push_back(item);
+            if (cur->size() == TABLE_CHUNK_SIZE) {
+                v->chunks.push_back(cur);
+                cur.reset();
+            }
+        });
+        if (cur) v->chunks.push_back(cur);
+        v->count = 0;
+        for (const ChunkPtr& c : v->chunks) v->count += c->size();
+        return v;
+    }
+};
+
+// Согласованный снимок всех данных на момент публикации. Копирование снимка
+// дешёвое (три указателя); содержимое не меняется, пока снимок удерживается.
+struct StorageSnapshot {
+    TableVersion<Pipe>::Ptr pipes;
+    TableVersion<CS>::Ptr stations;
+    TableVersion<Connection>::Ptr connections;
+    unsigned long long version = 0;
+
+    const Pipe* findPipe(int id) const { return pipes ? pipes->find(id) : nullptr; }
+    const CS* findCS(int id) const { return stations ? stations->find(id) : nullptr; }
+    const Connection* findConnection(int id) const { return connections ? connections->find(id) : nullptr; }
+
+    // Топологический порядок КС по активным соединениям (как GasNetwork::topologicalSort);
+    // при наличии цикла часть КС в результат не попадает
+    std::vector<int> topologicalOrder() const;
+
+    // Тот же формат, что у Storage::saveToFile
+    void saveToStream(std::ostream& os) const;
+    bool saveToFile(const std::string& filename) const;
+    // Часть part из parts в том же формате (см. TableVersion::forEachPart)
+    void savePartToStream(std::ostream& os, size_t part, size_t parts) const;
+};
+
+#endif // SNAPSHOT_H
@@ -1,131 +1,329 @@
 ﻿#include "storage.h"
 #include "utils.h"
+#include "report.h"
+#include "schema.h"
+#include "lazysnapshot.h"
 #include <algorithm>
+#include <set>
 #include <fstream>
+#include <atomic>
+#include <thread>
+#include <chrono>
 
 using namespace std;
 
-IdGenerator::IdGenerator() : nextId(1) {}
-int IdGenerator::next() { return nextId++; }
-void IdGenerator::setNext(int v) { if (v > nextId) nextId = v; }
+size_t defaultShardCount() {
+    return min<size_t>(64, max(1u, thread::hardware_concurrency()));
+}
+
+// EntityManager с ячейками по ID
+template<typename T>
+EntityManager<T>::EntityManager(size_t shardCount) : shards(max<size_t>(1, shardCount)), count(0) {}
+
+template<typename T>
+bool EntityManager<T>::place(Shard& shard, int id, T&& item, bool replace) {
+    size_t b = blockIndex(id);
+    if (b >= shard.blocks.size()) shard.blocks.resize(b + 1);
+    if (!shard.blocks[b]) shard.blocks[b].reset(new Block());
+    Block& block = *shard.blocks[b];
+    size_t slot = (size_t)id & (SHARD_BLOCK_SIZE - 1);
+    if (block.present[slot]) {
+        if (replace) block.slots[slot] = std::move(item);
+        return false;
+    }
+    block.slots[slot] = std::move(item);
+    block.present[slot] = true;
+    ++block.used;
+    return true;
+}
+
+template<typename T>
+T* EntityManager<T>::slotOf(const Shard& shard, int id) const {
+    size_t b = blockIndex(id);
+    if (id < 0 || b >= shard.blocks.size() || !shard.blocks[b]) return nullptr;
+    Block& block = *shard.blocks[b];
+    size_t slot = (size_t)id & (SHARD_BLOCK_SIZE - 1);
+    return block.present[slot] ? &block.slots[slot] : nullptr;
+}
 
-// EntityManager с map
 template<typename T>
 int EntityManager<T>::add(const T& entity) {
-    entities[entity.getId()] = entity;
-    return entity.getId();
+    return add(T(entity));
 }
 
 template<typename T>
-T* EntityManager<T>::findById(int id) {
-    auto it = entities.find(id);
-    if (it != entities.end()) {
-        return &(it->second);
+int EntityManager<T>::add(T&& entity) {
+    int id = entity.getId();
+    if (id < 0) return id;
+    ids.claim(id);
+    if (place(shardFor(id), id, std::move(entity), true)) ++count;
+    return id;
+}
+
+template<typename T>
+size_t EntityManager<T>::distribute(vector<T>& items, bool replace, vector<size_t>& rejected) {
+    // Номера записей по шардам в исходном порядке: повторный ID обрабатывается так же,
+    // как при последовательной вставке
+    vector<vector<size_t>> byShard(shards.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (items[i].getId() <= 0) rejected.push_back(i);
+        else byShard[shardIndex(items[i].getId())].push_back(i);
     }
-    return nullptr;
+
+    vector<vector<size_t>> shardRejected(shards.size());
+    atomic<size_t> added(0);
+    parallelFor(shards.size(), [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s) {
+            size_t placed = 0;
+            for (size_t i : byShard[s]) {
+                int id = items[i].getId();
+                if (place(shards[s], id, std::move(items[i]), replace)) ++placed;
+                else if (!replace) shardRejected[s].push_back(i);
+            }
+            added += placed;
+        }
+    }, 1);
+
+    for (const vector<size_t>& r : shardRejected) rejected.insert(rejected.end(), r.begin(), r.end());
+    sort(rejected.begin(), rejected.end());
+    count += added;
+    return added;
+}
+
+template<typename T>
+size_t EntityManager<T>::addBulk(vector<T>& items, vector<size_t>& rejected) {
+    // Сначала занимаются явно заданные ID, затем за один проход назначаются новые
+    for (const T& item : items) ids.claim(item.getId());
+    for (T& item : items) {
+        if (item.getId() == 0) item.setId(ids.allocate());
+    }
+    return distribute(items, false, rejected);
+}
+
+template<typename T>
+bool EntityManager<T>::replaceAll(vector<T>& items) {
+    if (items.empty()) return false;
+    for (Shard& shard : shards) shard.blocks.clear();
+    count = 0;
+    vector<size_t> rejected;
+    distribute(items, true, rejected);
+    rebuildIdAllocator();
+    return true;
+}
+
+template<typename T>
+T* EntityManager<T>::findById(int id) {
+    if (id < 0) return nullptr;
+    return slotOf(shardFor(id), id);
 }
 
 template<typename T>
 bool EntityManager<T>::removeById(int id) {
-    return entities.erase(id) > 0;
+    if (id < 0) return false;
+    Shard& shard = shardFor(id);
+    if (!slotOf(shard, id)) return false;
+    size_t b = blockIndex(id);
+    Block& block = *shard.blocks[b];
+    size_t slot = (size_t)id & (SHARD_BLOCK_SIZE - 1);
+    block.slots[slot] = T();
+    block.present[slot] = false;
+    // Пустой блок освобождается целиком: указателей на его записи больше нет
+    if (--block.used == 0) shard.blocks[b].reset();
+    --count;
+    return true;
 }
 
 template<typename T>
 map<int, T> EntityManager<T>::getAll() const {
-    return entities;
+    map<int, T> result;
+    forEach([&result](const T& item) { result.emplace_hint(result.end(), item.getId(), item); });
+    return result;
 }
 
 template<typename T>
-map<int, T*> EntityManager<T>::findByName(const std::string& nameSubstr) {
+map<int, T*> EntityManager<T>::getAllPointers() {
     map<int, T*> result;
-    string lowerSubstr = nameSubstr;
-    transform(lowerSubstr.begin(), lowerSubstr.end(), lowerSubstr.begin(), ::tolower);
+    walkOrdered(*this, [&result](T& item) { result.emplace_hint(result.end(), item.getId(), &item); });
+    return result;
+}
 
-    for (auto& pair : entities) {
-        T& entity = pair.second;
-        string lowerName = entity.getName();
-        transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+template<typename T>
+void EntityManager<T>::collectPointers(vector<T*>& out) {
+    out.reserve(out.size() + size());
+    walkOrdered(*this, [&out](T& item) { out.push_back(&item); });
+}
 
-        if (lowerName.find(lowerSubstr) != string::npos) {
-            result[pair.first] = &entity;
-        }
-    }
+template<typename T>
+map<int, T*> EntityManager<T>::findByName(const std::string& nameSubstr) {
+    map<int, T*> result;
+    string lowerSubstr = toLowerCopy(nameSubstr);
+    walkOrdered(*this, [&](T& item) {
+        if (containsFolded(item.getName(), lowerSubstr)) result.emplace_hint(result.end(), item.getId(), &item);
+    });
     return result;
 }
 
 template<typename T>
 int EntityManager<T>::getNextId() {
-    return idGen.next();
+    return ids.allocate();
 }
 
 template<typename T>
-void EntityManager<T>::updateIdGeneratorFromData() {
-    int maxId = 0;
-    if (!entities.empty()) {
-        maxId = entities.rbegin()->first;
-    }
-    idGen.setNext(maxId + 1);
+void EntityManager<T>::rebuildIdAllocator() {
+    ids.rebuild([this](const function<void(int)>& use) {
+        forEach([&use](const T& item) { use(item.getId()); });
+    });
 }
 
 template<typename T>
 void EntityManager<T>::saveToStream(ostream& os, const string& header) const {
-    os << header << "\n";
-    for (const auto& pair : entities) {
-        os << pair.second.toSingleLine() << "\n";
-    }
-    os << "END" << header << "\n";
+    writeTextSection<T>(os, header, [this](auto&& write) { forEach(write); });
 }
 
 template<typename T>
 bool EntityManager<T>::loadFromStream(istream& is, const string& header) {
-    map<int, T> newEntities;
+    vector<T> items;
+    const string endHeader = "END" + header;
     string line;
     bool inSection = false;
 
     while (getline(is, line)) {
-        line = trim(line);
+        trimInPlace(line);
         if (line.empty()) continue;
 
         if (line == header) {
             inSection = true;
             continue;
         }
-        if (line == "END" + header) {
+        if (line == endHeader) {
             inSection = false;
             continue;
         }
 
         if (inSection) {
             T entity;
-            if (T::fromSingleLine(line, entity)) {
-                newEntities[entity.getId()] = entity;
+            if (TextCodec<T>::decode(line.data(), line.data() + line.size(), entity)) {
+                items.push_back(std::move(entity));
             }
         }
     }
+    return replaceAll(items);
+}
 
-    if (!newEntities.empty()) {
-        entities = newEntities;
-        updateIdGeneratorFromData();
-        return true;
+template<typename T>
+MemoryUsage EntityManager<T>::memoryUsage() const {
+    long long stringBytes = 0;
+    forEach([&stringBytes](const T& item) { stringBytes += (long long)item.heapBytes(); });
+    size_t blocks = 0;
+    for (const Shard& shard : shards) {
+        for (const auto& block : shard.blocks) blocks += block ? 1 : 0;
     }
-    return false;
+    return makeMemoryUsage(MemTag<T>::value, size(), blocks * SHARD_BLOCK_SIZE,
+        (long long)(size() * sizeof(T)), stringBytes);
 }
 
 // Storage методы
-int Storage::addPipe(const Pipe& p) { return pipeManager.add(p); }
+Storage::Storage() : version(0) {
+    current.pipes = std::make_shared<const TableVersion<Pipe>>();
+    current.stations = std::make_shared<const TableVersion<CS>>();
+    current.connections = std::make_shared<const TableVersion<Connection>>();
+    published = current;
+}
+
+int Storage::addPipe(const Pipe& p) {
+    int id = pipeManager.add(p);
+    publishPipe(id);
+    return id;
+}
+int Storage::addPipe(Pipe&& p) {
+    int id = pipeManager.add(std::move(p));
+    publishPipe(id);
+    return id;
+}
 Pipe* Storage::findPipeById(int id) { return pipeManager.findById(id); }
-bool Storage::removePipeById(int id) { return pipeManager.removeById(id); }
+bool Storage::removePipeById(int id) {
+    if (!pipeManager.removeById(id)) return false;
+    if (!pipeRefs.count(id)) pipeManager.releaseId(id);
+    publishPipe(id);
+    return true;
+}
 map<int, Pipe> Storage::getAllPipes() const { return pipeManager.getAll(); }
-map<int, Pipe*> Storage::findPipesByName(const string& name) { return pipeManager.findByName(name); }
+// Поиск по индексу имён: ID из индекса превращаются в указатели на живые записи
+template<typename T>
+static map<int, T*> lookupByName(EntityManager<T>& manager, const NameIndex& index, const string& name) {
+    vector<int> ids;
+    index.find(name, ids);
+    sort(ids.begin(), ids.end());
+    map<int, T*> result;
+    for (int id : ids) {
+        if (T* item = manager.findById(id)) result.emplace_hint(result.end(), id, item);
+    }
+    return result;
+}
+
+template<typename T>
+static void rebuildNames(NameIndex& index, const EntityManager<T>& manager) {
+    size_t bytes = 0;
+    manager.forEach([&](const T& item) { bytes += item.getName().size(); });
+    index.clear();
+    index.reserve(manager.size(), bytes);
+    manager.forEach([&](const T& item) { index.set(item.getId(), item.getName()); });
+}
+
+map<int, Pipe*> Storage::findPipesByName(const string& name) { return lookupByName(pipeManager, pipeNames, name); }
 int Storage::getNextPipeId() { return pipeManager.getNextId(); }
 
-int Storage::addCS(const CS& s) { return csManager.add(s); }
+int Storage::addCS(const CS& s) {
+    int id = csManager.add(s);
+    publishCS(id);
+    return id;
+}
+int Storage::addCS(CS&& s) {
+    int id = csManager.add(std::move(s));
+    publishCS(id);
+    return id;
+}
 CS* Storage::findCSById(int id) { return csManager.findById(id); }
-bool Storage::removeCSById(int id) { return csManager.removeById(id); }
+bool Storage::removeCSById(int id) {
+    if (!csManager.removeById(id)) return false;
+    if (!stationRefs.count(id)) csManager.releaseId(id);
+    publishCS(id);
+    return true;
+}
 map<int, CS> Storage::getAllCS() const { return csManager.getAll(); }
-map<int, CS*> Storage::findCSByName(const string& name) { return csManager.findByName(name); }
+map<int, CS*> Storage::findCSByName(const string& name) { return lookupByName(csManager, csNames, name); }
 int Storage::getNextCSId() { return csManager.getNextId(); }
 
+size_t Storage::addPipesBulk(vector<Pipe>& items, vector<size_t>& rejected) {
+    size_t added = pipeManager.addBulk(items, rejected);
+    pipeManager.markAllDirty();
+    republishPipes();
+    return added;
+}
+
+size_t Storage::addCSBulk(vector<CS>& items, vector<size_t>& rejected) {
+    size_t added = csManager.addBulk(items, rejected);
+    csManager.markAllDirty();
+    republishCS();
+    return added;
+}
+
+bool Storage::modifyPipe(int id, const function<void(Pipe&)>& fn) {
+    Pipe* p = pipeManager.findById(id);
+    if (!p) return false;
+    fn(*p);
+    publishPipe(id);
+    return true;
+}
+
+bool Storage::modifyCS(int id, const function<void(CS&)>& fn) {
+    CS* s = csManager.findById(id);
+    if (!s) return false;
+    fn(*s);
+    publishCS(id);
+    return true;
+}
+
 // Добавляем недостающие методы
 map<int, Pipe> Storage::getAllPipe3() {
     return pipeManager.getAll();
@@ -144,70 +342,415 @@ map<int, CS*> Storage::searchC5(const string& nameSubstr, double minPercentIdle)
 }
 
 // Остальные методы с map
-map<int, Pipe*> Storage::searchPipes(const string& nameSubstr, int inRepairFlag) {
-    map<int, Pipe*> result;
-    map<int, Pipe*> byName;
+// Множество из битового индекса превращается в указатели на живые записи
+template<typename T>
+static map<int, T*> resolveBitmap(EntityManager<T>& manager, const RoaringBitmap& ids) {
+    map<int, T*> result;
+    ids.forEach([&](int id) {
+        if (T* item = manager.findById(id)) result.emplace_hint(result.end(), id, item);
+    });
+    return result;
+}
 
-    if (nameSubstr.empty()) {
-        map<int, Pipe> allPipes = getAllPipes();
-        for (auto& pair : allPipes) {
-            byName[pair.first] = &pair.second;
-        }
+static RoaringBitmap bitmapFromIds(vector<int>& ids) {
+    sort(ids.begin(), ids.end());
+    return RoaringBitmap::fromSorted(ids);
+}
+
+template<typename K>
+static const RoaringBitmap* findBitmap(const unordered_map<K, RoaringBitmap>& index, const K& key) {
+    auto it = index.find(key);
+    return it != index.end() ? &it->second : nullptr;
+}
+
+map<int, Pipe*> Storage::searchPipes(const string& nameSubstr, int inRepairFlag, int diameter) {
+    RoaringBitmap hits;
+    if (diameter > 0) {
+        const RoaringBitmap* byDiameter = findBitmap(pipesByDiameter, diameter);
+        if (!byDiameter) return {};
+        hits = *byDiameter;
     }
     else {
-        byName = findPipesByName(nameSubstr);
+        hits = pipesAll;
     }
+    if (inRepairFlag == 1) hits &= pipesInRepair;
+    else if (inRepairFlag == 0) hits -= pipesInRepair;
+    if (!nameSubstr.empty()) {
+        vector<int> ids;
+        pipeNames.find(nameSubstr, ids);
+        hits &= bitmapFromIds(ids);
+    }
+    return resolveBitmap(pipeManager, hits);
+}
 
-    for (const auto& pair : byName) {
-        Pipe* pipe = pair.second;
-        if (inRepairFlag == -1 || (pipe->isInRepair() ? 1 : 0) == inRepairFlag) {
-            result[pair.first] = pipe;
-        }
+map<int, CS*> Storage::searchCS(const string& nameSubstr, double minPercentIdle, const string& stationClass) {
+    RoaringBitmap hits;
+    if (!stationClass.empty()) {
+        const RoaringBitmap* byClass = findBitmap(stationsByClass, stationClass);
+        if (!byClass) return {};
+        hits = *byClass;
     }
-    return result;
+    else {
+        hits = stationsAll;
+    }
+    vector<int> ids;
+    if (minPercentIdle >= 0.0) {
+        // Порог по упорядоченному индексу: просматриваются только подходящие КС
+        csByIdle.atLeast(minPercentIdle, ids);
+        hits &= bitmapFromIds(ids);
+    }
+    if (!nameSubstr.empty()) {
+        csNames.find(nameSubstr, ids);
+        hits &= bitmapFromIds(ids);
+    }
+    return resolveBitmap(csManager, hits);
 }
 
-map<int, CS*> Storage::searchCS(const string& nameSubstr, double minPercentIdle) {
-    map<int, CS*> result;
-    map<int, CS*> byName;
+map<int, Pipe*> Storage::findFreePipes(int diameter) {
+    const RoaringBitmap* byDiameter = findBitmap(pipesByDiameter, diameter);
+    if (!byDiameter) return {};
+    RoaringBitmap hits = *byDiameter;
+    hits -= pipesInRepair;
+    hits -= pipesInUse;
+    return resolveBitmap(pipeManager, hits);
+}
 
-    if (nameSubstr.empty()) {
-        map<int, CS> allCS = getAllCS();
-        for (auto& pair : allCS) {
-            byName[pair.first] = &pair.second;
-        }
+map<int, Pipe*> Storage::searchPipesByLength(double minLength, double maxLength, int diameter,
+    int inRepairFlag, const string& nameSubstr) {
+    vector<int> ids;
+    pipeLengths.range(minLength, maxLength, diameter, ids);
+    sort(ids.begin(), ids.end());
+
+    string needle = toLowerCopy(nameSubstr);
+    map<int, Pipe*> result;
+    for (int id : ids) {
+        Pipe* pipe = pipeManager.findById(id);
+        if (!pipe) continue;
+        if (inRepairFlag != -1 && (pipe->isInRepair() ? 1 : 0) != inRepairFlag) continue;
+        if (!needle.empty() && !containsFolded(pipe->getName(), needle)) continue;
+        result.emplace_hint(result.end(), id, pipe);
     }
-    else {
-        byName = findCSByName(nameSubstr);
+    return result;
+}
+
+static vector<CS*> resolveRanked(EntityManager<CS>& manager, const vector<int>& ids) {
+    vector<CS*> result;
+    result.reserve(ids.size());
+    for (int id : ids) {
+        if (CS* cs = manager.findById(id)) result.push_back(cs);
     }
+    return result;
+}
+
+vector<CS*> Storage::topCSByIdle(size_t k, bool highest) {
+    vector<int> ids;
+    csByIdle.top(k, highest, ids);
+    return resolveRanked(csManager, ids);
+}
+
+vector<CS*> Storage::topCSByEfficiency(size_t k, bool highest) {
+    vector<int> ids;
+    csByEfficiency.top(k, highest, ids);
+    return resolveRanked(csManager, ids);
+}
 
-    for (const auto& pair : byName) {
-        CS* cs = pair.second;
-        if (minPercentIdle < 0.0 || cs->getIdlePercent() >= minPercentIdle) {
-            result[pair.first] = cs;
+// Массовое изменение; ID изменённых записей каждый поток копит у себя и сливает в changed один раз
+template<typename T, typename A>
+static BulkUpdateResult applyBulk(vector<T*>& items, const function<bool(const T&)>& filter, const A& assignment,
+    vector<int>& changed) {
+    atomic<size_t> matched(0);
+    mutex merge;
+    parallelFor(items.size(), [&](size_t begin, size_t end) {
+        size_t m = 0;
+        vector<int> local;
+        for (size_t i = begin; i < end; ++i) {
+            T& item = *items[i];
+            if (filter && !filter(item)) continue;
+            ++m;
+            if (assignment.apply(item)) local.push_back(item.getId());
         }
-    }
+        matched += m;
+        lock_guard<mutex> lock(merge);
+        changed.insert(changed.end(), local.begin(), local.end());
+    });
+    BulkUpdateResult result;
+    result.matched = matched;
+    result.updated = changed.size();
+    return result;
+}
+
+BulkUpdateResult Storage::updatePipes(const PipePredicate& filter, const PipeAssignment& assignment) {
+    vector<Pipe*> items;
+    pipeManager.collectPointers(items);
+    vector<int> changed;
+    BulkUpdateResult result = applyBulk(items, filter, assignment, changed);
+    publishPipesChanged(changed);
+    LOG.log("Bulk update pipes [" + assignment.describe() + "]: matched " + to_string(result.matched) +
+        ", updated " + to_string(result.updated));
+    return result;
+}
+
+BulkUpdateResult Storage::updateCS(const CSPredicate& filter, const CSAssignment& assignment) {
+    vector<CS*> items;
+    csManager.collectPointers(items);
+    vector<int> changed;
+    BulkUpdateResult result = applyBulk(items, filter, assignment, changed);
+    publishCSChanged(changed);
+    LOG.log("Bulk update CS [" + assignment.describe() + "]: matched " + to_string(result.matched) +
+        ", updated " + to_string(result.updated));
+    return result;
+}
+
+PipePredicate Storage::pipeFilter(const string& nameSubstr, int inRepairFlag) {
+    string lower = toLowerCopy(nameSubstr);
+    return [lower, inRepairFlag](const Pipe& p) {
+        if (inRepairFlag != -1 && (p.isInRepair() ? 1 : 0) != inRepairFlag) return false;
+        return containsFolded(p.getName(), lower);
+    };
+}
+
+CSPredicate Storage::csFilter(const string& nameSubstr, double minPercentIdle) {
+    string lower = toLowerCopy(nameSubstr);
+    return [lower, minPercentIdle](const CS& s) {
+        if (minPercentIdle >= 0.0 && s.getIdlePercent() < minPercentIdle) return false;
+        return containsFolded(s.getName(), lower);
+    };
+}
+
+template<typename T>
+static map<int, T*> toIdMap(const vector<T*>& items) {
+    map<int, T*> result;
+    for (T* item : items) result.emplace_hint(result.end(), item->getId(), item);
+    return result;
+}
+
+map<int, Pipe*> Storage::filterPipes(const CompiledFilter<Pipe>& filter) {
+    vector<Pipe*> items;
+    pipeManager.collectPointers(items);
+    return toIdMap(selectMatching(filter, items));
+}
+
+map<int, CS*> Storage::filterCS(const CompiledFilter<CS>& filter) {
+    vector<CS*> items;
+    csManager.collectPointers(items);
+    return toIdMap(selectMatching(filter, items));
+}
+
+BulkUpdateResult Storage::updatePipes(const CompiledFilter<Pipe>& filter, const PipeAssignment& assignment) {
+    vector<Pipe*> items;
+    pipeManager.collectPointers(items);
+    vector<Pipe*> matched = selectMatching(filter, items);
+    vector<int> changed;
+    BulkUpdateResult result = applyBulk(matched, PipePredicate(), assignment, changed);
+    publishPipesChanged(changed);
+    LOG.log("Bulk update pipes where " + filter.source() + " [" + assignment.describe() + "]: matched " +
+        to_string(result.matched) + ", updated " + to_string(result.updated));
+    return result;
+}
+
+BulkUpdateResult Storage::updateCS(const CompiledFilter<CS>& filter, const CSAssignment& assignment) {
+    vector<CS*> items;
+    csManager.collectPointers(items);
+    vector<CS*> matched = selectMatching(filter, items);
+    vector<int> changed;
+    BulkUpdateResult result = applyBulk(matched, CSPredicate(), assignment, changed);
+    publishCSChanged(changed);
+    LOG.log("Bulk update CS where " + filter.source() + " [" + assignment.describe() + "]: matched " +
+        to_string(result.matched) + ", updated " + to_string(result.updated));
     return result;
 }
 
 bool Storage::saveToFile(const string& filename) {
-    ofstream f(filename);
-    if (!f) return false;
+    // Сохраняется опубликованный снимок: его можно писать и из другого потока
+    return snapshot().saveToFile(filename);
+}
 
-    pipeManager.saveToStream(f, "PIPES");
-    csManager.saveToStream(f, "CS");
-    network.saveToStream(f);  // ← ДОБАВЛЕНА СЕТЬ
-    return true;
+bool Storage::saveSharded(const string& filename, size_t shardCount) {
+    size_t parts = shardCount > 0 ? shardCount : defaultShardCount();
+    StorageSnapshot snap = snapshot();
+    vector<char> written(parts, 0);
+    parallelFor(parts, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            written[k] = writeFileAtomically(filename + "." + to_string(k), [&](ostream& os) {
+                snap.savePartToStream(os, k, parts);
+                return (bool)os;
+            });
+        }
+    }, 1);
+    if (find(written.begin(), written.end(), 0) != written.end()) return false;
+
+    // Оглавление пишется последним: пока части не готовы, прежнее сохранение остаётся целым
+    return writeFileAtomically(filename, [&](ostream& os) {
+        os << "SHARDED " << parts << "\n";
+        return (bool)os;
+    });
+}
+
+bool Storage::saveIndexed(const string& filename) {
+    return writeIndexedSnapshot(snapshot(), filename);
+}
+
+SegmentSaveResult Storage::saveSegmented(const string& filename) {
+    SegmentChanges changes;
+    changes.pipes = &pipeManager.dirtyRecords();
+    changes.stations = &csManager.dirtyRecords();
+    changes.connections = &network.dirtyRecords();
+    SegmentSaveResult result = writeSegmentedFile(snapshot(), filename, changes, filename == segmentBaseline);
+    if (result.ok) {
+        clearDirty();
+        segmentBaseline = filename;
+    }
+    return result;
 }
 
 bool Storage::loadFromFile(const string& filename) {
+    if (isIndexedSnapshot(filename)) return loadIndexed(filename);
+    if (isSegmentedFile(filename)) return loadSegmented(filename);
     ifstream f(filename);
     if (!f) return false;
 
+    string first;
+    if (getline(f, first)) {
+        trimInPlace(first);
+        if (first.compare(0, 8, "SHARDED ") == 0) {
+            int parts;
+            return parseInt(first.substr(8), parts) && parts > 0 && loadSharded(filename, (size_t)parts);
+        }
+    }
+    f.clear();
+    f.seekg(0);
+
+    // Каждый раздел читается с начала файла: загрузчик секции дочитывает поток до конца
     bool pipesLoaded = pipeManager.loadFromStream(f, "PIPES");
+    f.clear();
+    f.seekg(0);
     bool csLoaded = csManager.loadFromStream(f, "CS");
+    f.clear();
+    f.seekg(0);
     bool networkLoaded = network.loadFromStream(f);  // ← ДОБАВЛЕНА СЕТЬ
 
+    markAllDirty();
+    republishPipes();
+    republishCS();
+    republishConnections();
+    return pipesLoaded || csLoaded || networkLoaded;
+}
+
+// Содержимое одной части сохранения по частям
+struct StoragePart {
+    vector<Pipe> pipes;
+    vector<CS> stations;
+    vector<Connection> connections;
+};
+
+template<typename T>
+static void decodeInto(const string& line, vector<T>& out) {
+    T item;
+    if (TextCodec<T>::decode(line.data(), line.data() + line.size(), item)) out.push_back(std::move(item));
+}
+
+static bool readPart(const string& filename, StoragePart& part) {
+    ifstream f(filename);
+    if (!f) return false;
+    enum { None, Pipes, Stations, Connections } section = None;
+    string line;
+    while (getline(f, line)) {
+        trimInPlace(line);
+        if (line.empty()) continue;
+        if (line == "PIPES") section = Pipes;
+        else if (line == "CS") section = Stations;
+        else if (line == "CONNECTIONS") section = Connections;
+        else if (line == "ENDPIPES" || line == "ENDCS" || line == "ENDCONNECTIONS") section = None;
+        else if (section == Pipes) decodeInto(line, part.pipes);
+        else if (section == Stations) decodeInto(line, part.stations);
+        else if (section == Connections) decodeInto(line, part.connections);
+    }
+    return true;
+}
+
+template<typename T>
+static vector<T> concatParts(vector<StoragePart>& parts, vector<T> StoragePart::* member) {
+    size_t total = 0;
+    for (StoragePart& p : parts) total += (p.*member).size();
+    vector<T> all;
+    all.reserve(total);
+    for (StoragePart& p : parts) {
+        move((p.*member).begin(), (p.*member).end(), back_inserter(all));
+        vector<T>().swap(p.*member);
+    }
+    return all;
+}
+
+bool Storage::loadSharded(const string& filename, size_t shardCount) {
+    // Части разбираются параллельно; они идут по возрастанию ID, поэтому склеиваются по порядку
+    vector<StoragePart> parts(shardCount);
+    vector<char> read(shardCount, 0);
+    parallelFor(shardCount, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) read[k] = readPart(filename + "." + to_string(k), parts[k]);
+    }, 1);
+    if (find(read.begin(), read.end(), 0) != read.end()) return false;
+
+    vector<Pipe> pipes = concatParts(parts, &StoragePart::pipes);
+    vector<CS> stations = concatParts(parts, &StoragePart::stations);
+    vector<Connection> connections = concatParts(parts, &StoragePart::connections);
+    return replaceAllAndRepublish(pipes, stations, connections);
+}
+
+bool Storage::loadIndexed(const string& filename) {
+    LazySnapshot source;
+    string error;
+    if (!source.open(filename, error)) return false;
+    vector<Pipe> pipes;
+    vector<CS> stations;
+    vector<Connection> connections;
+    pipes.reserve(source.pipeCount());
+    stations.reserve(source.csCount());
+    connections.reserve(source.connectionCount());
+    source.forEachPipe([&pipes](Pipe& p) { pipes.push_back(std::move(p)); });
+    source.forEachCS([&stations](CS& s) { stations.push_back(std::move(s)); });
+    source.forEachConnection([&connections](Connection& c) { connections.push_back(std::move(c)); });
+    return replaceAllAndRepublish(pipes, stations, connections);
+}
+
+bool Storage::loadSegmented(const string& filename) {
+    vector<Pipe> pipes;
+    vector<CS> stations;
+    vector<Connection> connections;
+    string error;
+    if (!readSegmentedFile(filename, pipes, stations, connections, error)) return false;
+    // Пустая таблица из файла не заменяет текущую: тогда данные совпадают с файлом, только если и она пуста
+    bool complete = (!pipes.empty() || pipeManager.size() == 0) && (!stations.empty() || csManager.size() == 0) &&
+        (!connections.empty() || network.getConnectionCount() == 0);
+    bool loaded = replaceAllAndRepublish(pipes, stations, connections);
+    if (complete) {
+        clearDirty();
+        segmentBaseline = filename;
+    }
+    return loaded;
+}
+
+void Storage::markAllDirty() {
+    pipeManager.markAllDirty();
+    csManager.markAllDirty();
+    network.markAllDirty();
+}
+
+void Storage::clearDirty() {
+    pipeManager.clearDirty();
+    csManager.clearDirty();
+    network.clearDirty();
+}
+
+// Пустая таблица оставляет прежнее содержимое, как и при загрузке текстового файла
+bool Storage::replaceAllAndRepublish(vector<Pipe>& pipes, vector<CS>& stations, vector<Connection>& connections) {
+    bool pipesLoaded = pipeManager.replaceAll(pipes);
+    bool csLoaded = csManager.replaceAll(stations);
+    bool networkLoaded = network.replaceAll(connections);
+
+    markAllDirty();
+    republishPipes();
+    republishCS();
+    republishConnections();
     return pipesLoaded || csLoaded || networkLoaded;
 }
 
@@ -242,34 +785,84 @@ CS Storage::createCSInteractive(int id) {
 
 // Вспомогательный метод для GasNetwork
 map<int, Pipe*> Storage::getAllPipesMap() {
-    map<int, Pipe*> result;
-    auto allPipes = pipeManager.getAll();
-    for (auto& pair : allPipes) {
-        result[pair.first] = const_cast<Pipe*>(&pair.second);
-    }
-    return result;
+    return pipeManager.getAllPointers();
+}
+
+map<int, CS*> Storage::getAllCSMap() {
+    return csManager.getAllPointers();
+}
+
+// Учёт памяти
+vector<MemoryUsage> Storage::memoryReport() const {
+    vector<MemoryUsage> report;
+    report.push_back(pipeManager.memoryUsage());
+    report.push_back(csManager.memoryUsage());
+    report.push_back(network.memoryUsage());
+
+    StorageSnapshot snap = snapshot();
+    size_t records = snap.pipes->size() + snap.stations->size() + snap.connections->size();
+    long long recordBytes = (long long)(snap.pipes->size() * sizeof(Pipe) + snap.stations->size() * sizeof(CS) +
+        snap.connections->size() * sizeof(Connection));
+    report.push_back(makeMemoryUsage(MemSubsystem::Snapshots, records, records, recordBytes, 0));
+    return report;
+}
+
+bool Storage::dumpMemoryReport(const string& filename) const {
+    ofstream f(filename);
+    if (!f) return false;
+    f << "Отчёт от " << currentTimestamp() << "\n";
+    printMemoryReport(f, memoryReport());
+    return true;
 }
 
 // Методы для работы с сетью
 bool Storage::createConnection() {
-    return network.createConnectionInteractive(*this);
+    bool created = network.createConnectionInteractive(*this);
+    if (created) {
+        network.markAllDirty();
+        republishConnections();
+    }
+    return created;
+}
+
+int Storage::connectStations(int csInId, int csOutId, int diameter, string& error) {
+    int connId = network.createConnection(*this, csInId, csOutId, diameter, error);
+    if (connId != 0) publishConnection(connId);
+    return connId;
+}
+
+bool Storage::deleteConnection(int id) {
+    if (!network.removeConnection(id)) return false;
+    publishConnection(id);
+    return true;
+}
+
+size_t Storage::addConnectionsBulk(vector<Connection>& items, vector<size_t>& rejected) {
+    size_t added = network.addConnectionsBulk(items, rejected);
+    network.markAllDirty();
+    republishConnections();
+    return added;
 }
 
 void Storage::listAllConnections() {
-    map<int, Connection> connections = network.getAllConnections();
-    if (connections.empty()) {
-        cout << "Нет соединений в сети.\n";
+    ReportWriter out(cout);
+    writeConnections(out);
+}
+
+void Storage::writeConnections(ReportWriter& out) const {
+    if (network.getConnectionCount() == 0) {
+        out << "Нет соединений в сети.\n";
         return;
     }
 
-    cout << "\n=== ВСЕ СОЕДИНЕНИЯ (" << connections.size() << ") ===\n";
-    for (const auto& pair : connections) {
-        pair.second.printDetails();
-    }
+    out << "\n=== ВСЕ СОЕДИНЕНИЯ (" << network.getConnectionCount() << ") ===\n";
+    network.forEachConnection([&](const Connection& conn) {
+        conn.writeDetails(out);
+    });
 }
 
 bool Storage::removeConnection(int id) {
-    if (network.removeConnection(id)) {
+    if (deleteConnection(id)) {
         cout << "Соединение ID=" << id << " удалено.\n";
         LOG.log("Removed connection ID=" + to_string(id));
         return true;
@@ -280,8 +873,82 @@ bool Storage::removeConnection(int id) {
     }
 }
 
+ConnectionPlan Storage::planConnections(const vector<ConnectionRequest>& requests, bool createMissing) {
+    ConnectionPlan plan;
+    set<int> diameters;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const ConnectionRequest& r = requests[i];
+        string prefix = "запрос " + to_string(i + 1) + ": ";
+        if (!GasNetwork::isValidDiameter(r.diameter))
+            plan.errors.push_back(prefix + "недопустимый диаметр " + to_string(r.diameter) + " (500, 700, 1000, 1400)");
+        else if (!csManager.findById(r.csInId))
+            plan.errors.push_back(prefix + "КС входа с ID=" + to_string(r.csInId) + " не найдена");
+        else if (!csManager.findById(r.csOutId))
+            plan.errors.push_back(prefix + "КС выхода с ID=" + to_string(r.csOutId) + " не найдена");
+        else if (r.csInId == r.csOutId)
+            plan.errors.push_back(prefix + "КС входа и выхода не могут быть одинаковыми");
+        else
+            diameters.insert(r.diameter);
+    }
+    if (!plan.ok()) return plan;
+
+    // Свободные трубы каждого нужного диаметра - один запрос к битовым индексам
+    map<int, vector<FreePipe>> freeByDiameter;
+    for (int diameter : diameters) {
+        vector<FreePipe>& pool = freeByDiameter[diameter];
+        for (const auto& pair : findFreePipes(diameter)) pool.push_back(FreePipe{ pair.first, pair.second->getLength() });
+    }
+    assignPipes(requests, freeByDiameter, createMissing, plan);
+    return plan;
+}
+
+bool Storage::commitConnectionPlan(const vector<ConnectionRequest>& requests, ConnectionPlan& plan, string& error) {
+    if (!plan.ok() || plan.items.size() != requests.size()) {
+        error = "план не прошёл проверку";
+        return false;
+    }
+    // План мог устареть: все проверки до первого изменения
+    set<int> taken;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const ConnectionRequest& r = requests[i];
+        int pipeId = plan.items[i].pipeId;
+        string prefix = "запрос " + to_string(i + 1) + ": ";
+        if (!csManager.findById(r.csInId) || !csManager.findById(r.csOutId)) {
+            error = prefix + "КС удалена";
+            return false;
+        }
+        if (plan.items[i].newPipe) continue;
+        const Pipe* p = pipeManager.findById(pipeId);
+        if (!p || p->isInRepair() || p->getDiameter() != r.diameter || pipesInUse.contains(pipeId) ||
+            !taken.insert(pipeId).second) {
+            error = prefix + "труба ID=" + to_string(pipeId) + " больше не свободна";
+            return false;
+        }
+    }
+    if (pipeIds().available() < plan.newPipes || connectionIds().available() < requests.size()) {
+        error = "закончились свободные ID труб или соединений";
+        return false;
+    }
+
+    PublishGroup group(*this);
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const ConnectionRequest& r = requests[i];
+        PlannedConnection& item = plan.items[i];
+        if (item.newPipe) {
+            item.pipeId = emplacePipe("pipe " + to_string(r.csInId) + "-" + to_string(r.csOutId),
+                item.pipeLength, r.diameter, false);
+        }
+        item.connectionId = network.connect(item.pipeId, r.csInId, r.csOutId);
+        publishConnection(item.connectionId);
+    }
+    LOG.log("Committed connection plan: " + to_string(requests.size()) + " connections, " +
+        to_string(plan.newPipes) + " new pipes");
+    return true;
+}
+
 void Storage::performTopologicalSort() {
-    vector<int> sorted = network.topologicalSort(*this);
+    bool cycles = false;
+    vector<int> sorted = network.topologicalSort(*this, cycles);
 
     if (sorted.empty()) {
         cout << "Нет соединений для сортировки.\n";
@@ -299,16 +966,308 @@ void Storage::performTopologicalSort() {
         }
     }
 
-    if (network.hasCycles(*this)) {
+    if (cycles) {
         cout << "\n Предупреждение: В сети обнаружены циклы!\n";
         cout << "   Не все КС могут быть обработаны в линейном порядке.\n";
     }
 }
 
+// Добавленное ребро from -> to не меняет достижимость, если from уже доходил до to
+void Storage::graphChanged(int addedFrom, int addedTo) {
+    bool fresh = reachIndex && reachIndexVersion == graphVersion;
+    ++graphVersion;
+    if (fresh && addedFrom >= 0 && reachIndex->reaches(addedFrom, addedTo)) reachIndexVersion = graphVersion;
+}
+
+shared_ptr<const ReachabilityIndex> Storage::reachability(bool wait) {
+    if (reachBuild.valid() && (wait || reachBuild.wait_for(chrono::seconds(0)) == future_status::ready)) {
+        reachIndex = reachBuild.get();
+        reachIndexVersion = reachBuildVersion;
+    }
+    if (reachIndex && reachIndexVersion == graphVersion) return reachIndex;
+    if (!reachBuild.valid()) {
+        // Снимок текущего состояния: фоновый поток не обращается к изменяемым данным
+        StorageSnapshot snap = current;
+        reachBuildVersion = graphVersion;
+        reachBuild = async(launch::async, [snap]() {
+            auto index = make_shared<ReachabilityIndex>();
+            index->build(snap);
+            return shared_ptr<const ReachabilityIndex>(index);
+        });
+    }
+    if (!wait) return nullptr;
+    reachIndex = reachBuild.get();
+    reachIndexVersion = reachBuildVersion;
+    return reachIndex;
+}
+
+bool Storage::refreshReachability() {
+    return reachability(false) != nullptr;
+}
+
+bool Storage::canReach(int fromCS, int toCS) {
+    if (!csManager.findById(fromCS) || !csManager.findById(toCS)) return false;
+    return reachability(true)->reaches(fromCS, toCS);
+}
+
+shared_ptr<const FlowResult> Storage::flowState(const FlowOptions& options) {
+    if (flowResult && flowVersion == current.version && flowOptions == options) return flowResult;
+    auto start = chrono::steady_clock::now();
+    flowResult = make_shared<const FlowResult>(solveFlow(current, options));
+    flowVersion = current.version;
+    flowOptions = options;
+    long long ms = (long long)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+    LOG.log("Flow solved: " + to_string(flowResult->stations.size()) + " stations, " +
+        to_string(flowResult->iterations) + " iterations, " + (flowResult->converged ? "converged" : "not converged") +
+        ", " + to_string(ms) + " ms");
+    return flowResult;
+}
+
 void Storage::printNetwork() {
     network.printNetworkGraph(*this);
 }
 
+// Снимки (MVCC)
+NetworkStats Storage::statistics() const {
+    lock_guard<mutex> lock(statsMutex);
+    return stats;
+}
+
+StorageSnapshot Storage::snapshot() const {
+    lock_guard<mutex> lock(snapshotMutex);
+    return published;
+}
+
+void Storage::publish(const TableVersion<Pipe>::Ptr& pipes, const TableVersion<CS>::Ptr& stations,
+    const TableVersion<Connection>::Ptr& connections) {
+    if (pipes) current.pipes = pipes;
+    if (stations) current.stations = stations;
+    if (connections) current.connections = connections;
+    current.version = ++version;
+    if (publishHold > 0) return;
+    lock_guard<mutex> lock(snapshotMutex);
+    published = current;
+}
+
+// Изменения внутри группы читатели увидят одной версией
+Storage::PublishGroup::PublishGroup(Storage& s) : storage(s) { ++storage.publishHold; }
+
+Storage::PublishGroup::~PublishGroup() {
+    if (--storage.publishHold > 0) return;
+    lock_guard<mutex> lock(storage.snapshotMutex);
+    storage.published = storage.current;
+}
+
+// Новая версия строится без блокировки: current меняет только этот (пишущий) поток
+void Storage::publishPipe(int id) {
+    const Pipe* p = pipeManager.findById(id);
+    pipeManager.markDirty(id);
+    {
+        // В текущей версии ещё лежит прежнее состояние записи
+        lock_guard<mutex> lock(statsMutex);
+        const Pipe* before = current.pipes->find(id);
+        if (before) stats.removePipe(*before);
+        if (p) stats.addPipe(*p);
+        if (!p) pipeNames.remove(id);
+        else if (!before || before->getName() != p->getName()) pipeNames.set(id, p->getName());
+        if (before) pipeLengths.erase(before->getDiameter(), before->getLength(), id);
+        if (p) pipeLengths.insert(p->getDiameter(), p->getLength(), id);
+        if (before) indexPipeAttributes(*before, false);
+        if (p) indexPipeAttributes(*p, true);
+    }
+    publish(p ? current.pipes->withUpsert(*p) : current.pipes->withErase(id, current.pipes), nullptr, nullptr);
+}
+
+void Storage::publishCS(int id) {
+    const CS* s = csManager.findById(id);
+    csManager.markDirty(id);
+    {
+        lock_guard<mutex> lock(statsMutex);
+        const CS* before = current.stations->find(id);
+        if (before) stats.removeCS(*before);
+        if (s) stats.addCS(*s);
+        if (!s) csNames.remove(id);
+        else if (!before || before->getName() != s->getName()) csNames.set(id, s->getName());
+        if (before) {
+            csByIdle.erase(id, before->getIdlePercent());
+            csByEfficiency.erase(id, before->getEfficiency());
+        }
+        if (s) {
+            csByIdle.insert(id, s->getIdlePercent());
+            csByEfficiency.insert(id, s->getEfficiency());
+        }
+        if (before) indexCSAttributes(*before, false);
+        if (s) indexCSAttributes(*s, true);
+        if (!before != !s) graphChanged();
+    }
+    publish(nullptr, s ? current.stations->withUpsert(*s) : current.stations->withErase(id, current.stations), nullptr);
+}
+
+void Storage::publishConnection(int id) {
+    const Connection* c = network.findConnectionById(id);
+    network.markDirty(id);
+    const Connection* before = current.connections->find(id);
+    if (before) {
+        indexConnectionUse(*before, false);
+        indexConnectionRefs(*before, false);
+    }
+    if (before && before->isActive) graphChanged();
+    else if (c && c->isActive) graphChanged(c->csInId, c->csOutId);
+    if (c) {
+        indexConnectionUse(*c, true);
+        indexConnectionRefs(*c, true);
+    }
+    publish(nullptr, nullptr, c ? current.connections->withUpsert(*c)
+        : current.connections->withErase(id, current.connections));
+}
+
+void Storage::republishPipes() {
+    {
+        lock_guard<mutex> lock(statsMutex);
+        stats.clearPipes();
+        pipeManager.forEach([this](const Pipe& p) { stats.addPipe(p); });
+    }
+    rebuildNames(pipeNames, pipeManager);
+    vector<pair<int, LengthIndex::Entry>> lengths;
+    lengths.reserve(pipeManager.size());
+    pipeManager.forEach([&lengths](const Pipe& p) {
+        lengths.push_back({ p.getDiameter(), LengthIndex::Entry{ p.getLength(), p.getId() } });
+    });
+    pipeLengths.build(lengths);
+    pipesAll.clear();
+    pipesInRepair.clear();
+    pipesByDiameter.clear();
+    pipeManager.forEach([this](const Pipe& p) { indexPipeAttributes(p, true); });
+    publish(TableVersion<Pipe>::build([&](const function<void(const Pipe&)>& add) { pipeManager.forEach(add); }),
+        nullptr, nullptr);
+}
+
+void Storage::republishCS() {
+    graphChanged();
+    {
+        lock_guard<mutex> lock(statsMutex);
+        stats.clearCS();
+        csManager.forEach([this](const CS& s) { stats.addCS(s); });
+    }
+    rebuildNames(csNames, csManager);
+    csByIdle.clear();
+    csByEfficiency.clear();
+    csManager.forEach([this](const CS& s) {
+        csByIdle.insert(s.getId(), s.getIdlePercent());
+        csByEfficiency.insert(s.getId(), s.getEfficiency());
+    });
+    stationsAll.clear();
+    stationsByClass.clear();
+    csManager.forEach([this](const CS& s) { indexCSAttributes(s, true); });
+    publish(nullptr, TableVersion<CS>::build([&](const function<void(const CS&)>& add) { csManager.forEach(add); }),
+        nullptr);
+}
+
+void Storage::publishPipesChanged(const vector<int>& ids) {
+    if (ids.empty()) return;
+    if (ids.size() > DirtyTracker::limit(pipeManager.size())) {
+        pipeManager.markAllDirty();
+        republishPipes();
+        return;
+    }
+    PublishGroup group(*this);
+    for (int id : ids) publishPipe(id);
+}
+
+void Storage::publishCSChanged(const vector<int>& ids) {
+    if (ids.empty()) return;
+    if (ids.size() > DirtyTracker::limit(csManager.size())) {
+        csManager.markAllDirty();
+        republishCS();
+        return;
+    }
+    PublishGroup group(*this);
+    for (int id : ids) publishCS(id);
+}
+
+void Storage::republishConnections() {
+    graphChanged();
+    pipesInUse.clear();
+    pipeUseCount.clear();
+    pipeRefs.clear();
+    stationRefs.clear();
+    network.forEachConnection([this](const Connection& c) {
+        indexConnectionUse(c, true);
+        indexConnectionRefs(c, true);
+    });
+    // После загрузки распределитель считает свободными все отсутствующие ID, в том числе
+    // ID удалённых объектов, на которые ещё ссылаются соединения
+    for (const auto& pair : pipeRefs) pipeManager.claimId(pair.first);
+    for (const auto& pair : stationRefs) csManager.claimId(pair.first);
+    publish(nullptr, nullptr, TableVersion<Connection>::build(
+        [&](const function<void(const Connection&)>& add) { network.forEachConnection(add); }));
+}
+
+void Storage::indexPipeAttributes(const Pipe& p, bool add) {
+    int id = p.getId();
+    RoaringBitmap& byDiameter = pipesByDiameter[p.getDiameter()];
+    if (add) {
+        pipesAll.add(id);
+        byDiameter.add(id);
+        if (p.isInRepair()) pipesInRepair.add(id);
+        return;
+    }
+    pipesAll.remove(id);
+    pipesInRepair.remove(id);
+    byDiameter.remove(id);
+    if (byDiameter.empty()) pipesByDiameter.erase(p.getDiameter());
+}
+
+void Storage::indexCSAttributes(const CS& s, bool add) {
+    RoaringBitmap& byClass = stationsByClass[s.getStationClass()];
+    if (add) {
+        stationsAll.add(s.getId());
+        byClass.add(s.getId());
+        return;
+    }
+    stationsAll.remove(s.getId());
+    byClass.remove(s.getId());
+    if (byClass.empty()) stationsByClass.erase(s.getStationClass());
+}
+
+// Труба может быть в нескольких активных соединениях (импорт), поэтому ведётся счётчик
+void Storage::indexConnectionUse(const Connection& c, bool add) {
+    if (!c.getIsActive()) return;
+    int& uses = pipeUseCount[c.getPipeId()];
+    if (add) {
+        if (uses++ == 0) pipesInUse.add(c.getPipeId());
+        return;
+    }
+    if (--uses <= 0) {
+        pipesInUse.remove(c.getPipeId());
+        pipeUseCount.erase(c.getPipeId());
+    }
+}
+
+void Storage::indexConnectionRefs(const Connection& c, bool add) {
+    auto update = [add](unordered_map<int, int>& refs, int id, auto& manager) {
+        if (add) {
+            ++refs[id];
+            return;
+        }
+        auto it = refs.find(id);
+        if (it == refs.end() || --it->second > 0) return;
+        refs.erase(it);
+        // Объект удалён раньше соединения: теперь его ID можно выдать снова
+        if (!manager.findById(id)) manager.releaseId(id);
+    };
+    update(pipeRefs, c.getPipeId(), pipeManager);
+    update(stationRefs, c.getCsInId(), csManager);
+    update(stationRefs, c.getCsOutId(), csManager);
+}
+
+void Storage::setIdPolicy(IdPolicy policy) {
+    pipeManager.idAllocator().setPolicy(policy);
+    csManager.idAllocator().setPolicy(policy);
+    network.idAllocator().setPolicy(policy);
+    LOG.log(string("ID policy set to ") + idPolicyName(policy));
+}
+
 // Явная инстанциация шаблонов
 template class EntityManager<Pipe>;
 template class EntityManager<CS>;
\ No newline at end of file
@@ -4,34 +4,145 @@
 
 #include "entities.h"
 #include "network.h"        
+#include "memstats.h"
+#include "bulkedit.h"
+#include "filter.h"
+#include "snapshot.h"
+#include "aggregates.h"
+#include "nameindex.h"
+#include "rankindex.h"
+#include "lengthindex.h"
+#include "bitmap.h"
+#include "dirty.h"
+#include "segfile.h"
+#include "idalloc.h"
+#include "planner.h"
+#include "reach.h"
+#include "flow.h"
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <future>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include <string>
 #include <fstream>
 #include <algorithm>
 
-class IdGenerator {
-    int nextId;
-public:
-    IdGenerator();
-    int next();
-    void setNext(int v);
-};
+//       
+template<typename T> struct MemTag;
+template<> struct MemTag<Pipe> { static const MemSubsystem value = MemSubsystem::Pipes; };
+template<> struct MemTag<CS> { static const MemSubsystem value = MemSubsystem::Stations; };
+
+//    ,    ID:   2^SHARD_BLOCK_BITS 
+//  ID -  ,  b    b % N   b / N.
+//   ID -    .      
+// :     ,   -   .
+//  : ,    Storage,    ( 
+//  ,   -  writeMutex),       .  ID
+//  IdAllocator (idalloc.h):   Reuse  ID
+//  ,     .
+const int SHARD_BLOCK_BITS = 12;
+const int SHARD_BLOCK_SIZE = 1 << SHARD_BLOCK_BITS;
+//   ,  1  64
+size_t defaultShardCount();
 
 template<typename T>
 class EntityManager {
-    std::map<int, T> entities;
-    IdGenerator idGen;
+    struct Block {
+        std::vector<T, TrackedAllocator<T, MemTag<T>::value>> slots;
+        std::vector<bool, TrackedAllocator<bool, MemTag<T>::value>> present;
+        size_t used = 0;
+        Block() : slots(SHARD_BLOCK_SIZE), present(SHARD_BLOCK_SIZE, false) {}
+    };
+
+    struct Shard {
+        std::vector<std::unique_ptr<Block>> blocks;
+    };
+
+    std::vector<Shard> shards;
+    size_t count;
+    IdAllocator ids;
+    DirtyTracker dirty;
+
+    size_t shardIndex(int id) const { return ((unsigned)id >> SHARD_BLOCK_BITS) % shards.size(); }
+    Shard& shardFor(int id) { return shards[shardIndex(id)]; }
+    size_t blockIndex(int id) const { return ((unsigned)id >> SHARD_BLOCK_BITS) / shards.size(); }
+
+    //  ID ( ); true,    
+    bool place(Shard& shard, int id, T&& item, bool replace);
+    T* slotOf(const Shard& shard, int id) const;
+
+    //        (  -  ).
+    // replace:    ID  ;     rejected
+    size_t distribute(std::vector<T>& items, bool replace, std::vector<size_t>& rejected);
+
+    // fn(item)   ID:    ,     
+    template<typename Self, typename F>
+    static void walkOrdered(Self& self, F&& fn) {
+        size_t n = self.shards.size();
+        size_t blocks = 0;
+        for (size_t s = 0; s < n; ++s) blocks = std::max(blocks, self.shards[s].blocks.size() * n);
+        for (size_t b = 0; b < blocks; ++b) {
+            auto& shardBlocks = self.shards[b % n].blocks;
+            if (b / n >= shardBlocks.size() || !shardBlocks[b / n]) continue;
+            auto& block = *shardBlocks[b / n];
+            for (size_t i = 0; i < (size_t)SHARD_BLOCK_SIZE; ++i) {
+                if (block.present[i]) fn(block.slots[i]);
+            }
+        }
+    }
 
 public:
+    explicit EntityManager(size_t shardCount = defaultShardCount());
+
     int add(const T& entity);
+    int add(T&& entity);
+    //        ID: T(id, args...); 0,  ID 
+    template<typename... Args>
+    int emplace(Args&&... args) {
+        int id = ids.allocate();
+        if (id == 0) return 0;
+        place(shardFor(id), id, T(id, std::forward<Args>(args)...), true);
+        ++count;
+        return id;
+    }
+    //    ; ID=0  ,
+    //    (,  ID,  ID)   rejected
+    size_t addBulk(std::vector<T>& items, std::vector<size_t>& rejected);
+    //    ();   items   
+    bool replaceAll(std::vector<T>& items);
     T* findById(int id);
+    // ID    :   Storage (releaseId),
+    //     ,    
     bool removeById(int id);
     std::map<int, T> getAll() const;
+    std::map<int, T*> getAllPointers();
+    void collectPointers(std::vector<T*>& out);
     std::map<int, T*> findByName(const std::string& nameSubstr);
     int getNextId();
-    void updateIdGeneratorFromData();
+    void claimId(int id) { ids.claim(id); }
+    void releaseId(int id) { ids.release(id); }
+    IdAllocator& idAllocator() { return ids; }
+    const IdAllocator& idAllocator() const { return ids; }
+    void rebuildIdAllocator();
     void saveToStream(std::ostream& os, const std::string& header) const;
     bool loadFromStream(std::istream& is, const std::string& header);
+    MemoryUsage memoryUsage() const;
+
+    size_t size() const { return count; }
+    size_t shardCount() const { return shards.size(); }
+
+    //      (segfile.h).  Storage:
+    // publish* -  ,   -     
+    void markDirty(int id) { dirty.mark(id, size()); }
+    void markAllDirty() { dirty.markAll(); }
+    const DirtyTracker& dirtyRecords() const { return dirty; }
+    void clearDirty() { dirty.clear(); }
+    template<typename F>
+    void forEach(F fn) const { walkOrdered(*this, fn); }
 };
 
 class Storage {
@@ -39,8 +150,18 @@ class Storage {
     EntityManager<CS> csManager;
 
 public:
+    Storage();
+
     //     
     int addPipe(const Pipe& p);
+    int addPipe(Pipe&& p);
+    // Pipe(id, name, length, diameter, inRepair)   ID;  ID
+    template<typename... Args>
+    int emplacePipe(Args&&... args) {
+        int id = pipeManager.emplace(std::forward<Args>(args)...);
+        if (id) publishPipe(id);
+        return id;
+    }
     Pipe* findPipeById(int id);
     bool removePipeById(int id);
     std::map<int, Pipe> getAllPipes() const;
@@ -49,15 +170,71 @@ public:
 
     //     
     int addCS(const CS& s);
+    int addCS(CS&& s);
+    // CS(id, name, workshopsTotal, workshopsWorking, stationClass)   ID
+    template<typename... Args>
+    int emplaceCS(Args&&... args) {
+        int id = csManager.emplace(std::forward<Args>(args)...);
+        if (id) publishCS(id);
+        return id;
+    }
     CS* findCSById(int id);
     bool removeCSById(int id);
     std::map<int, CS> getAllCS() const;
     std::map<int, CS*> findCSByName(const std::string& name);
     int getNextCSId();
+    std::map<int, CS*> getAllCSMap();
+
+    //  ID (idalloc.h)  ,    .  Reuse ID 
+    //     ,         
+    void setIdPolicy(IdPolicy policy);
+    IdPolicy getIdPolicy() const { return pipeManager.idAllocator().getPolicy(); }
+    const IdAllocator& pipeIds() const { return pipeManager.idAllocator(); }
+    const IdAllocator& csIds() const { return csManager.idAllocator(); }
+    const IdAllocator& connectionIds() const { return network.idAllocator(); }
+
+    //   .      
+    // (     find*),      .
+    bool modifyPipe(int id, const std::function<void(Pipe&)>& fn);
+    bool modifyCS(int id, const std::function<void(CS&)>& fn);
+
+    //   (. EntityManager::addBulk)
+    size_t addPipesBulk(std::vector<Pipe>& items, std::vector<size_t>& rejected);
+    size_t addCSBulk(std::vector<CS>& items, std::vector<size_t>& rejected);
+    size_t getPipeCount() const { return pipeManager.size(); }
+    size_t getCSCount() const { return csManager.size(); }
+    template<typename F> void forEachPipe(F fn) const { pipeManager.forEach(fn); }
+    template<typename F> void forEachCS(F fn) const { csManager.forEach(fn); }
 
     //   
-    std::map<int, Pipe*> searchPipes(const std::string& nameSubstr, int inRepairFlag);
-    std::map<int, CS*> searchCS(const std::string& nameSubstr, double minPercentIdle);
+    //   ,       (bitmap.h);
+    // diameter <= 0   stationClass -  
+    std::map<int, Pipe*> searchPipes(const std::string& nameSubstr, int inRepairFlag, int diameter = 0);
+    std::map<int, CS*> searchCS(const std::string& nameSubstr, double minPercentIdle,
+        const std::string& stationClass = "");
+    //   diameter        
+    std::map<int, Pipe*> findFreePipes(int diameter);
+    // k    (highest)     
+    //  ;   ,    
+    std::vector<CS*> topCSByIdle(size_t k, bool highest = true);
+    std::vector<CS*> topCSByEfficiency(size_t k, bool highest = true);
+    //     [minLength, maxLength]   ; diameter <= 0 - 
+    // ,     searchPipes   
+    std::map<int, Pipe*> searchPipesByLength(double minLength, double maxLength, int diameter = 0,
+        int inRepairFlag = -1, const std::string& nameSubstr = "");
+
+    //  :        
+    //  ;    " "
+    BulkUpdateResult updatePipes(const PipePredicate& filter, const PipeAssignment& assignment);
+    BulkUpdateResult updateCS(const CSPredicate& filter, const CSAssignment& assignment);
+    static PipePredicate pipeFilter(const std::string& nameSubstr, int inRepairFlag);
+    static CSPredicate csFilter(const std::string& nameSubstr, double minPercentIdle);
+
+    //        (filter.h)
+    std::map<int, Pipe*> filterPipes(const CompiledFilter<Pipe>& filter);
+    std::map<int, CS*> filterCS(const CompiledFilter<CS>& filter);
+    BulkUpdateResult updatePipes(const CompiledFilter<Pipe>& filter, const PipeAssignment& assignment);
+    BulkUpdateResult updateCS(const CompiledFilter<CS>& filter, const CSAssignment& assignment);
 
     //  
     std::map<int, Pipe> getAllPipe3();
@@ -67,6 +244,15 @@ public:
 
     //   
     bool saveToFile(const std::string& filename);
+    //   : filename - , filename.0 ... filename.(N-1) -  ID
+    //     ,   (  EntityManager
+    //  ). loadFromFile   
+    bool saveSharded(const std::string& filename, size_t shardCount = 0);
+    //    (lazysnapshot.h):     
+    bool saveIndexed(const std::string& filename);
+    //   (segfile.h):       
+    //    ,      
+    SegmentSaveResult saveSegmented(const std::string& filename);
     bool loadFromFile(const std::string& filename);
 
     //     
@@ -80,13 +266,123 @@ public:
     //     
     bool createConnection();
     void listAllConnections();
+    void writeConnections(ReportWriter& out) const;
     bool removeConnection(int id);
+    //      
+    int connectStations(int csInId, int csOutId, int diameter, std::string& error);
+    bool deleteConnection(int id);
+    size_t addConnectionsBulk(std::vector<Connection>& items, std::vector<size_t>& rejected);
+    //   (planner.h):      
+    //   . createMissing -     
+    ConnectionPlan planConnections(const std::vector<ConnectionRequest>& requests, bool createMissing);
+    //     :   ,    
+    // ,     ;      
+    bool commitConnectionPlan(const std::vector<ConnectionRequest>& requests, ConnectionPlan& plan,
+        std::string& error);
     void performTopologicalSort();
+    //      (reach.h).     
+    //    ,     (   ); 
+    // ,   ,   .   ,
+    //   
+    bool canReach(int fromCS, int toCS);
+    //    ,   ; true -  
+    bool refreshReachability();
+    std::shared_ptr<const ReachabilityIndex> reachability(bool wait);
+    //     (flow.h);  ,   
+    //    
+    std::shared_ptr<const FlowResult> flowState(const FlowOptions& options = FlowOptions());
     void printNetwork();
+    //     ;   -   Storage
     GasNetwork& getNetwork() { return network; }
+    const GasNetwork& getNetwork() const { return network; }
 
     //    network.cpp
     std::map<int, Pipe*> getAllPipesMap();
+
+    //  
+    std::vector<MemoryUsage> memoryReport() const;
+    bool dumpMemoryReport(const std::string& filename) const;
+
+    //       (MVCC):    O(1),
+    //       .    .
+    StorageSnapshot snapshot() const;
+    unsigned long long getVersion() const { return version.load(); }
+
+    //   (aggregates.h); ,    
+    NetworkStats statistics() const;
+
+private:
+    mutable std::mutex snapshotMutex;
+    StorageSnapshot published;      //  
+    StorageSnapshot current;        //    
+    int publishHold = 0;
+    //   ,   ;    
+    struct PublishGroup {
+        Storage& storage;
+        explicit PublishGroup(Storage& s);
+        ~PublishGroup();
+    };
+    std::atomic<unsigned long long> version;
+    mutable std::mutex statsMutex;
+    NetworkStats stats;
+    //    (nameindex.h);      
+    NameIndex pipeNames;
+    NameIndex csNames;
+    //    (rankindex.h),      
+    RankIndex csByIdle;
+    RankIndex csByEfficiency;
+    //     (lengthindex.h),    
+    LengthIndex pipeLengths;
+    //    ,    
+    RoaringBitmap pipesAll;
+    RoaringBitmap pipesInRepair;
+    std::unordered_map<int, RoaringBitmap> pipesByDiameter;
+    RoaringBitmap pipesInUse;                       //   
+    std::unordered_map<int, int> pipeUseCount;      //    
+    RoaringBitmap stationsAll;
+    std::unordered_map<std::string, RoaringBitmap> stationsByClass;
+    //   (   )    :  ID  
+    std::unordered_map<int, int> pipeRefs;
+    std::unordered_map<int, int> stationRefs;
+
+    //     ;    
+    unsigned long long graphVersion = 1;
+    std::shared_ptr<const ReachabilityIndex> reachIndex;
+    unsigned long long reachIndexVersion = 0;
+    std::future<std::shared_ptr<const ReachabilityIndex>> reachBuild;
+    unsigned long long reachBuildVersion = 0;
+    void graphChanged(int addedFrom = -1, int addedTo = -1);
+
+    std::shared_ptr<const FlowResult> flowResult;
+    unsigned long long flowVersion = 0;
+    FlowOptions flowOptions;
+
+    bool loadSharded(const std::string& filename, size_t shardCount);
+    bool loadIndexed(const std::string& filename);
+    bool loadSegmented(const std::string& filename);
+    // ,         ;  -  
+    std::string segmentBaseline;
+    void markAllDirty();
+    void clearDirty();
+    bool replaceAllAndRepublish(std::vector<Pipe>& pipes, std::vector<CS>& stations,
+        std::vector<Connection>& connections);
+    void indexPipeAttributes(const Pipe& p, bool add);
+    void indexCSAttributes(const CS& s, bool add);
+    void indexConnectionUse(const Connection& c, bool add);
+    void indexConnectionRefs(const Connection& c, bool add);
+
+    void publish(const TableVersion<Pipe>::Ptr& pipes, const TableVersion<CS>::Ptr& stations,
+        const TableVersion<Connection>::Ptr& connections);
+    void publishPipe(int id);
+    void publishCS(int id);
+    void publishConnection(int id);
+    void republishPipes();
+    void republishCS();
+    void republishConnections();
+    //   :      ( ),
+    //    DirtyTracker::limit   
+    void publishPipesChanged(const std::vector<int>& ids);
+    void publishCSChanged(const std::vector<int>& ids);
 };
 
 #endif
\ No newline at end of file
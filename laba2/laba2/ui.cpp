@@ -2,11 +2,15 @@
 #include <iostream>
 #include <exception>
 #include <iomanip>
+#include <fstream>
+#include <limits>
 #include "network.h"
+#include "batch.h"
+#include "csv.h"
 
 using namespace std;
 
-UserInterface::UserInterface(Storage& st) : storage(st) {}
+UserInterface::UserInterface(Storage& st) : storage(st), autosave(st) {}
 
 void UserInterface::printMenu() {
     cout << "\n=== МЕНЮ УПРАВЛЕНИЯ ===\n"
@@ -31,39 +35,124 @@ void UserInterface::printMenu() {
         << "18. Удалить соединение\n"
         << "19. Топологическая сортировка\n"
         << "20. Просмотреть граф сети\n"
+        << "\n--- СЕРВИС ---\n"
+        << "21. Отчёт об использовании памяти\n"
+        << "22. Выполнить командный файл\n"
+        << "23. Импорт из CSV\n"
+        << "24. Экспорт в CSV\n"
+        << "25. Массовое изменение по фильтру\n"
+        << "26. Поиск по выражению\n"
+        << "27. Автосохранение\n"
+        << "28. Сводка по сети\n"
+        << "29. Рейтинг КС (простой / эффективность)\n"
+        << "30. Просмотр больших файлов (компактный реестр / индексированный снимок)\n"
+        << "31. Выдача ID (повторно после удаления / только новые)\n"
+        << "32. Пакетное создание соединений\n"
+        << "33. Достижимость КС\n"
+        << "34. Расчёт потоков газа\n"
+        << "35. Просмотр всех объектов (таблица / постранично / в файл)\n"
         << "0. Выход\n"
         << "Ваш выбор: ";
 }
 
 void UserInterface::listAllObjects() {
-    cout << "\n-- Трубы: --\n";
-    map<int, Pipe> pipes = storage.getAllPipes();
-    if (pipes.empty()) cout << "<нет труб>\n";
-    for (const auto& pair : pipes) {
-        const Pipe& pipe = pair.second;
-        cout << "ID=" << pipe.getId() << " | " << pipe.getName() << " | "
-            << pipe.getLength() << " км | " << pipe.getDiameter() << " мм | "
-            << (pipe.isInRepair() ? "В ремонте" : "Работает") << "\n";
-    }
+    ReportWriter out(cout);
+    writeAllObjects(out, false);
+    LOG.log("Listed all objects.");
+}
 
-    cout << "\n-- КС: --\n";
-    map<int, CS> css = storage.getAllCS();
-    if (css.empty()) cout << "<нет КС>\n";
-    for (const auto& pair : css) {
-        const CS& cs = pair.second;
-        cout << "ID=" << cs.getId() << " | " << cs.getName() << " | класс "
-            << cs.getStationClass() << " | " << cs.getWorkshopsWorking() << "/"
-            << cs.getWorkshopsTotal() << " | эффективность " << fixed << setprecision(2)
-            << cs.getEfficiency() << "% | незадействовано " << fixed << setprecision(2)
-            << cs.getIdlePercent() << "%\n";
+void UserInterface::viewAllObjects() {
+    const size_t pageLines = 40;
+    cout << "Формат (1 - список, 2 - таблица, 3 - постранично, 4 - в файл; пустая строка - таблица): ";
+    string mode;
+    getline(cin, mode);
+    mode = trim(mode);
+    if (mode.empty()) mode = "2";
+
+    if (mode == "4") {
+        string filename = InputHelper::inputLineNonEmpty("Введите имя файла: ");
+        ofstream f(filename, ios::binary);
+        if (!f) {
+            cout << "Ошибка записи в файл " << filename << "\n";
+            return;
+        }
+        {
+            ReportWriter out(f);
+            writeAllObjects(out, false);
+        }
+        cout << "Список записан в " << filename << "\n";
+        LOG.log(string("Listed all objects to file \"") + filename + "\"");
+        return;
     }
+
+    // При перенаправлении вывода постраничный режим не нужен
+    bool paged = (mode == "3") && !ReportWriter::outputIsRedirected();
+    ReportWriter out(cout, paged ? pageLines : 0);
+    writeAllObjects(out, mode == "2");
+    LOG.log("Listed all objects.");
+}
+
+void UserInterface::writeAllObjects(ReportWriter& out, bool table) {
+    out << "\n-- Трубы: --";
+    out.endLine();
+    if (table && storage.getPipeCount() > 0) {
+        out.cell("ID", 8).cell("Название", 30).cell("Длина, км", 12).cell("Диаметр, мм", 12) << "Состояние";
+        out.endLine();
+    }
+    if (storage.getPipeCount() == 0) {
+        out << "<нет труб>";
+        out.endLine();
+    }
+    storage.forEachPipe([&](const Pipe& pipe) {
+        if (out.isStopped()) return;
+        if (table) {
+            out.cell(pipe.getId(), 8).cell(pipe.getName(), 30).cell(pipe.getLength(), 12, 3)
+                .cell(pipe.getDiameter(), 12) << (pipe.isInRepair() ? "В ремонте" : "Работает");
+        }
+        else {
+            out << "ID=" << pipe.getId() << " | " << pipe.getName() << " | "
+                << pipe.getLength() << " км | " << pipe.getDiameter() << " мм | "
+                << (pipe.isInRepair() ? "В ремонте" : "Работает");
+        }
+        out.endLine();
+    });
+    if (out.isStopped()) return;
+
+    out << "\n-- КС: --";
+    out.endLine();
+    if (table && storage.getCSCount() > 0) {
+        out.cell("ID", 8).cell("Название", 30).cell("Класс", 8).cell("Цехи", 10)
+            .cell("Эфф., %", 10) << "Незадейств., %";
+        out.endLine();
+    }
+    if (storage.getCSCount() == 0) {
+        out << "<нет КС>";
+        out.endLine();
+    }
+    storage.forEachCS([&](const CS& cs) {
+        if (out.isStopped()) return;
+        if (table) {
+            string workshops = to_string(cs.getWorkshopsWorking()) + "/" + to_string(cs.getWorkshopsTotal());
+            out.cell(cs.getId(), 8).cell(cs.getName(), 30).cell(cs.getStationClass(), 8).cell(workshops, 10)
+                .cell(cs.getEfficiency(), 10);
+            out.fixed(cs.getIdlePercent());
+        }
+        else {
+            out << "ID=" << cs.getId() << " | " << cs.getName() << " | класс "
+                << cs.getStationClass() << " | " << cs.getWorkshopsWorking() << "/"
+                << cs.getWorkshopsTotal() << " | эффективность ";
+            out.fixed(cs.getEfficiency()) << "% | незадействовано ";
+            out.fixed(cs.getIdlePercent()) << "%";
+        }
+        out.endLine();
+    });
 }
 
 void UserInterface::run() {
     string choice;
     while (true) {
         printMenu();
-        getline(cin, choice);
+        if (!getline(cin, choice)) break;
         choice = trim(choice);
 
         try {
@@ -87,6 +176,21 @@ void UserInterface::run() {
             else if (choice == "18") removeConnection(storage);
             else if (choice == "19") topologicalSort(storage);
             else if (choice == "20") printNetwork(storage);
+            else if (choice == "21") showMemoryReport(storage);
+            else if (choice == "22") runCommandFile(storage);
+            else if (choice == "23") importCsv(storage);
+            else if (choice == "24") exportCsv(storage);
+            else if (choice == "25") bulkUpdate(storage);
+            else if (choice == "26") searchByExpression(storage);
+            else if (choice == "27") configureAutosave();
+            else if (choice == "28") showDashboard(storage);
+            else if (choice == "29") showTopCS(storage);
+            else if (choice == "30") browseCompactRegister(storage);
+            else if (choice == "31") configureIdPolicy(storage);
+            else if (choice == "32") planConnections(storage);
+            else if (choice == "33") checkReachability(storage);
+            else if (choice == "34") showFlowState(storage);
+            else if (choice == "35") viewAllObjects();
             else if (choice == "0") break;
             else cout << "Неверный выбор.\n";
         }
@@ -144,8 +248,31 @@ void UserInterface::searchAndBatchEditPipes() {
     processBatchOperation(chosenIds);
 }
 
+void UserInterface::configureAutosave() {
+    cout << "Автосохранение: " << autosave.status() << "\n";
+    cout << "1. Включить / изменить настройки\n"
+        << "2. Выключить\n"
+        << "0. Назад\n";
+    int option = InputHelper::inputIntInRange("Ваш выбор: ", 0, 2);
+    if (option == 1) {
+        string filename = InputHelper::inputLineNonEmpty("Введите имя файла (например autosave.txt): ");
+        int seconds = InputHelper::inputIntegerPositive("Интервал в секундах: ");
+        if (autosave.start(filename, seconds)) {
+            cout << "Автосохранение включено: " << filename << " каждые " << seconds << " с\n";
+        }
+        else {
+            cout << "Не удалось включить автосохранение.\n";
+        }
+    }
+    else if (option == 2) {
+        autosave.stop();
+        cout << "Автосохранение выключено.\n";
+    }
+}
+
 void UserInterface::processBatchOperation(const map<int, int>& chosenIds) {
-    cout << "Доступные операции:\n1) Редактировать выбранные\n2) Удалить выбранные\n0) Отмена\nВаш выбор: ";
+    cout << "Доступные операции:\n1) Редактировать выбранные\n2) Удалить выбранные\n"
+        << "3) Присвоить значения полей всем выбранным\n0) Отмена\nВаш выбор: ";
     string op;
     getline(cin, op);
     op = trim(op);
@@ -153,10 +280,9 @@ void UserInterface::processBatchOperation(const map<int, int>& chosenIds) {
     if (op == "1") {
         for (const auto& pair : chosenIds) {
             int id = pair.first;
-            Pipe* pipe = storage.findPipeById(id);
-            if (pipe) {
+            if (storage.findPipeById(id)) {
                 cout << "\nРедактирование трубы ID=" << id << ":\n";
-                pipe->editInteractive();
+                storage.modifyPipe(id, [](Pipe& pipe) { pipe.editInteractive(); });
                 LOG.log(string("Batch edited pipe ID=") + to_string(id));
             }
         }
@@ -173,6 +299,13 @@ void UserInterface::processBatchOperation(const map<int, int>& chosenIds) {
         cout << "Удаление выбранных труб выполнено.\n";
         LOG.log(string("Batch edit pipes: removed ") + to_string(chosenIds.size()) + " items.");
     }
+    else if (op == "3") {
+        PipeAssignment assignment;
+        if (!askPipeAssignment(assignment)) return;
+        BulkUpdateResult result = storage.updatePipes(
+            [&chosenIds](const Pipe& p) { return chosenIds.count(p.getId()) > 0; }, assignment);
+        cout << "Изменено труб: " << result.updated << "\n";
+    }
     else {
         cout << "Отмена операции.\n";
         LOG.log("Batch edit pipes: user cancelled operation choice.");
@@ -181,20 +314,54 @@ void UserInterface::processBatchOperation(const map<int, int>& chosenIds) {
 
 // Реализации свободных функций
 
+template<typename A>
+static bool askAssignment(A& assignment, const char* fields) {
+    cout << "Новые значения через пробел (" << fields << "): ";
+    string line;
+    getline(cin, line);
+    istringstream iss(line);
+    string token, error;
+    while (iss >> token) {
+        if (!assignment.parse(token, error)) {
+            cout << "Ошибка: " << error << "\n";
+            return false;
+        }
+    }
+    if (assignment.empty()) {
+        cout << "Не задано ни одного поля.\n";
+        return false;
+    }
+    return true;
+}
+
+bool askPipeAssignment(PipeAssignment& assignment) {
+    return askAssignment(assignment, "repair=0|1 diameter=<мм> length=<км>");
+}
+
+bool askCSAssignment(CSAssignment& assignment) {
+    return askAssignment(assignment, "total=<n> working=<n> class=<класс>");
+}
+
 void addPipe(Storage& storage) {
     int id = storage.getNextPipeId();
-    Pipe p = storage.createPipeInteractive(id);
-    storage.addPipe(p);
-    cout << "Труба добавлена с ID=" << p.getId() << "\n";
-    LOG.log(string("Added pipe ID=") + to_string(p.getId()) + " name=\"" + p.getName() + "\"");
+    if (id == 0) {
+        cout << "Ошибка! Свободные ID труб закончились.\n";
+        return;
+    }
+    storage.addPipe(storage.createPipeInteractive(id));
+    cout << "Труба добавлена с ID=" << id << "\n";
+    LOG.log(string("Added pipe ID=") + to_string(id) + " name=\"" + storage.findPipeById(id)->getName() + "\"");
 }
 
 void addCS(Storage& storage) {
     int id = storage.getNextCSId();
-    CS s = storage.createCSInteractive(id);
-    storage.addCS(s);
-    cout << "КС добавлена с ID=" << s.getId() << "\n";
-    LOG.log(string("Added CS ID=") + to_string(s.getId()) + " name=\"" + s.getName() + "\"");
+    if (id == 0) {
+        cout << "Ошибка! Свободные ID КС закончились.\n";
+        return;
+    }
+    storage.addCS(storage.createCSInteractive(id));
+    cout << "КС добавлена с ID=" << id << "\n";
+    LOG.log(string("Added CS ID=") + to_string(id) + " name=\"" + storage.findCSById(id)->getName() + "\"");
 }
 
 void viewPipeById(Storage& storage) {
@@ -251,7 +418,7 @@ void editPipeById(Storage& storage) {
         LOG.log(string("Edit pipe failed - not found ID=") + to_string(id));
         return;
     }
-    pipe->editInteractive();
+    storage.modifyPipe(id, [](Pipe& p) { p.editInteractive(); });
     LOG.log(string("Edited pipe ID=") + to_string(id));
 }
 
@@ -263,7 +430,7 @@ void editCSById(Storage& storage) {
         LOG.log(string("Edit CS failed - not found ID=") + to_string(id));
         return;
     }
-    cs->editInteractive();
+    storage.modifyCS(id, [](CS& s) { s.editInteractive(); });
     LOG.log(string("Edited CS ID=") + to_string(id));
 }
 
@@ -307,12 +474,37 @@ void searchPipes(Storage& storage) {
         }
     }
 
-    map<int, Pipe*> result = storage.searchPipes(name, repairFilter);
-    cout << "Найдено труб: " << result.size() << "\n";
+    // Интервал длины ищется по индексу длин, остальные фильтры - битовыми индексами
+    double minLength = -numeric_limits<double>::infinity();
+    double maxLength = numeric_limits<double>::infinity();
+    bool byLength = false;
+    cout << "Длина, км, в виде min..max (например 10..25 или ..5; пустая строка - нет фильтра): ";
+    string lengthInput;
+    getline(cin, lengthInput);
+    lengthInput = trim(lengthInput);
+    if (!lengthInput.empty()) {
+        if (parseRange(lengthInput, minLength, maxLength)) byLength = true;
+        else cout << "Неверный интервал, фильтр по длине не применяется.\n";
+    }
+
+    int diameter = 0;
+    cout << "Диаметр, мм (пустая строка - нет фильтра): ";
+    string diameterInput;
+    getline(cin, diameterInput);
+    diameterInput = trim(diameterInput);
+    if (!diameterInput.empty()) {
+        if (!parseInt(diameterInput, diameter) || diameter <= 0) diameter = 0;
+    }
+
+    map<int, Pipe*> result = byLength
+        ? storage.searchPipesByLength(minLength, maxLength, diameter, repairFilter, name)
+        : storage.searchPipes(name, repairFilter, diameter);
+    ReportWriter out(cout);
+    out << "Найдено труб: " << result.size() << "\n";
     for (const auto& pair : result) {
-        Pipe* pipe = pair.second;
-        pipe->printDetails();
+        pair.second->writeDetails(out);
     }
+    out.flush();
     LOG.log(string("Searched pipes: found ") + to_string(result.size()));
 }
 
@@ -333,18 +525,40 @@ void searchCS(Storage& storage) {
         }
     }
 
-    map<int, CS*> result = storage.searchCS(name, minIdlePercent);
-    cout << "Найдено КС: " << result.size() << "\n";
+    cout << "Класс станции (пустая строка - нет фильтра): ";
+    string stationClass;
+    getline(cin, stationClass);
+    stationClass = trim(stationClass);
+
+    map<int, CS*> result = storage.searchCS(name, minIdlePercent, stationClass);
+    ReportWriter out(cout);
+    out << "Найдено КС: " << result.size() << "\n";
     for (const auto& pair : result) {
-        CS* cs = pair.second;
-        cs->printDetails();
+        pair.second->writeDetails(out);
     }
+    out.flush();
     LOG.log(string("Searched CS: found ") + to_string(result.size()));
 }
 
 void saveData(Storage& storage) {
     string filename = InputHelper::inputLineNonEmpty("Введите имя файла для сохранения (например data.txt): ");
-    if (storage.saveToFile(filename)) {
+    int format = InputHelper::inputIntInRange(
+        "Формат (1 - текстовый, 2 - по частям для параллельной загрузки, 3 - индексированный снимок,\n"
+        "        4 - сегментированный, повторно дописываются только изменения): ", 1, 4);
+    bool saved;
+    if (format == 4) {
+        SegmentSaveResult result = storage.saveSegmented(filename);
+        saved = result.ok;
+        if (saved) {
+            cout << (result.full ? "Файл записан целиком" : "Дописаны изменения") << ": сегментов "
+                << result.segments << ", байт " << result.bytes << "\n";
+        }
+    }
+    else {
+        saved = format == 1 ? storage.saveToFile(filename)
+            : format == 2 ? storage.saveSharded(filename) : storage.saveIndexed(filename);
+    }
+    if (saved) {
         cout << "Сохранено в файл " << filename << "\n";
         LOG.log(string("Saved data to file \"") + filename + "\"");
     }
@@ -383,6 +597,60 @@ void createConnection(Storage& storage) {
     }
 }
 
+void planConnections(Storage& storage) {
+    cout << "Запросы: <id_КС_входа> <id_КС_выхода> <диаметр_мм> [длина_км], по одному на строку.\n";
+    cout << "Имя файла с запросами (пустая строка - ввести вручную): ";
+    string filename;
+    getline(cin, filename);
+    filename = trim(filename);
+
+    stringstream text;
+    if (!filename.empty()) {
+        ifstream f(filename);
+        if (!f) {
+            cout << "Не удалось открыть файл " << filename << "\n";
+            return;
+        }
+        text << f.rdbuf();
+    }
+    else {
+        cout << "Вводите запросы, пустая строка - конец:\n";
+        string line;
+        while (getline(cin, line) && !trim(line).empty()) text << line << "\n";
+    }
+
+    vector<ConnectionRequest> requests;
+    vector<string> errors;
+    parseConnectionRequests(text, requests, errors);
+    bool create = InputHelper::inputZeroOne("Создавать недостающие трубы? (1 - да, 0 - нет): ") == 1;
+    ConnectionPlan plan = storage.planConnections(requests, create);
+    errors.insert(errors.end(), plan.errors.begin(), plan.errors.end());
+    if (requests.empty() || !errors.empty()) {
+        for (const string& e : errors) cout << "Ошибка: " << e << "\n";
+        cout << "Соединения не созданы\n";
+        return;
+    }
+
+    ReportWriter out(cout);
+    out.cell("КС входа", 10).cell("КС выхода", 10).cell("Диаметр", 9).cell("Труба", 10) << "Длина, км";
+    out.endLine();
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const PlannedConnection& item = plan.items[i];
+        out.cell(requests[i].csInId, 10).cell(requests[i].csOutId, 10).cell(requests[i].diameter, 9);
+        out.cell(item.newPipe ? string("новая") : to_string(item.pipeId), 10) << item.pipeLength;
+        out.endLine();
+    }
+    out.flush();
+    if (InputHelper::inputZeroOne("Создать соединения? (1 - да, 0 - нет): ") != 1) return;
+
+    string error;
+    if (!storage.commitConnectionPlan(requests, plan, error)) {
+        cout << "Ошибка: " << error << "\nСоединения не созданы\n";
+        return;
+    }
+    cout << "Создано соединений: " << requests.size() << ", новых труб: " << plan.newPipes << "\n";
+}
+
 void listConnections(Storage& storage) {
     storage.listAllConnections();
 }
@@ -398,4 +666,347 @@ void topologicalSort(Storage& storage) {
 
 void printNetwork(Storage& storage) {
     storage.printNetwork();
-}
\ No newline at end of file
+}
+
+// Сервисные функции
+void showMemoryReport(Storage& storage) {
+    vector<MemoryUsage> report = storage.memoryReport();
+    printMemoryReport(cout, report);
+
+    long long total = 0;
+    for (const MemoryUsage& u : report) total += u.totalBytes();
+    LOG.log(string("Memory report: ") + to_string(total) + " bytes tracked");
+
+    cout << "Файл для выгрузки отчёта (пустая строка - не сохранять): ";
+    string filename;
+    getline(cin, filename);
+    filename = trim(filename);
+    if (filename.empty()) return;
+
+    if (storage.dumpMemoryReport(filename)) {
+        cout << "Отчёт сохранён в " << filename << "\n";
+        LOG.log(string("Memory report dumped to \"") + filename + "\"");
+    }
+    else {
+        cout << "Ошибка записи в файл " << filename << "\n";
+    }
+}
+
+void runCommandFile(Storage& storage) {
+    CommandProcessor::printHelp(cout);
+    string filename = InputHelper::inputLineNonEmpty("Введите имя командного файла: ");
+    CommandProcessor processor(storage, cout);
+    processor.runFile(filename);
+    processor.flush();
+    cout << "Выполнено команд: " << processor.getExecutedCount()
+        << ", ошибок: " << processor.getErrorCount() << "\n";
+}
+
+static CsvKind askCsvKind() {
+    int v = InputHelper::inputIntInRange("Тип записей (1 - трубы, 2 - КС, 3 - соединения): ", 1, 3);
+    return v == 1 ? CsvKind::Pipes : (v == 2 ? CsvKind::Stations : CsvKind::Connections);
+}
+
+void importCsv(Storage& storage) {
+    CsvKind kind = askCsvKind();
+    string filename = InputHelper::inputLineNonEmpty("Введите имя CSV-файла: ");
+
+    CsvImportResult result;
+    if (!CsvIO::importFile(storage, kind, filename, result)) {
+        cout << "Ошибка чтения файла " << filename << "\n";
+        LOG.log(string("CSV import failed: \"") + filename + "\"");
+        return;
+    }
+
+    const size_t maxShown = 20;
+    for (size_t i = 0; i < result.errors.size() && i < maxShown; ++i) cout << result.errors[i] << "\n";
+    if (result.errors.size() > maxShown) cout << "... и ещё " << result.errors.size() - maxShown << " ошибок\n";
+    cout << "Импортировано записей: " << result.imported << " из " << result.rows << "\n";
+    LOG.log(string("CSV import from \"") + filename + "\": " + to_string(result.imported) +
+        " imported, " + to_string(result.errors.size()) + " rejected");
+}
+
+void exportCsv(Storage& storage) {
+    CsvKind kind = askCsvKind();
+    string filename = InputHelper::inputLineNonEmpty("Введите имя CSV-файла: ");
+
+    size_t written = 0;
+    if (CsvIO::exportFile(storage, kind, filename, written)) {
+        cout << "Выгружено записей: " << written << " в " << filename << "\n";
+        LOG.log(string("CSV export to \"") + filename + "\": " + to_string(written) + " records");
+    }
+    else {
+        cout << "Ошибка записи в файл " << filename << "\n";
+    }
+}
+
+void bulkUpdate(Storage& storage) {
+    int kind = InputHelper::inputIntInRange("Объекты (1 - трубы, 2 - КС): ", 1, 2);
+
+    cout << "Выражение фильтра (например: diameter in (700,1000) and not inRepair;\n"
+        << "пустая строка - фильтр по имени и состоянию): ";
+    string expression;
+    getline(cin, expression);
+    expression = trim(expression);
+    if (!expression.empty()) {
+        string error;
+        BulkUpdateResult result;
+        if (kind == 1) {
+            CompiledFilter<Pipe> filter;
+            PipeAssignment assignment;
+            if (!filter.compile(expression, error)) { cout << "Ошибка в выражении: " << error << "\n"; return; }
+            if (!askPipeAssignment(assignment)) return;
+            result = storage.updatePipes(filter, assignment);
+        }
+        else {
+            CompiledFilter<CS> filter;
+            CSAssignment assignment;
+            if (!filter.compile(expression, error)) { cout << "Ошибка в выражении: " << error << "\n"; return; }
+            if (!askCSAssignment(assignment)) return;
+            result = storage.updateCS(filter, assignment);
+        }
+        cout << "Подходящих объектов: " << result.matched << ", изменено: " << result.updated << "\n";
+        return;
+    }
+    cout << "Фильтр по имени (подстрока, пустая строка - нет фильтра): ";
+    string name;
+    getline(cin, name);
+    name = trim(name);
+
+    if (kind == 1) {
+        cout << "Фильтр по ремонту (1 - в ремонте, 0 - работает, пустая строка - нет фильтра): ";
+        string line;
+        getline(cin, line);
+        int repairFilter = -1;
+        if (!parseInt(line, repairFilter) || (repairFilter != 0 && repairFilter != 1)) repairFilter = -1;
+
+        PipeAssignment assignment;
+        if (!askPipeAssignment(assignment)) return;
+        BulkUpdateResult result = storage.updatePipes(Storage::pipeFilter(name, repairFilter), assignment);
+        cout << "Подходящих труб: " << result.matched << ", изменено: " << result.updated << "\n";
+    }
+    else {
+        cout << "Минимальный % незадействованных цехов (пустая строка - нет фильтра): ";
+        string line;
+        getline(cin, line);
+        double minIdle = -1.0;
+        if (!parseDouble(line, minIdle) || minIdle < 0) minIdle = -1.0;
+
+        CSAssignment assignment;
+        if (!askCSAssignment(assignment)) return;
+        BulkUpdateResult result = storage.updateCS(Storage::csFilter(name, minIdle), assignment);
+        cout << "Подходящих КС: " << result.matched << ", изменено: " << result.updated << "\n";
+    }
+}
+
+void searchByExpression(Storage& storage) {
+    int kind = InputHelper::inputIntInRange("Объекты (1 - трубы, 2 - КС): ", 1, 2);
+    if (kind == 1) cout << "Поля: id, name, length, diameter, inRepair. Пример: diameter in (700,1000) and length > 12.5 and not inRepair\n";
+    else cout << "Поля: id, name, class, total, working, idle, efficiency. Пример: idle >= 30 and class = \"A\"\n";
+    string expression = InputHelper::inputLineNonEmpty("Выражение: ");
+
+    string error;
+    size_t found = 0;
+    if (kind == 1) {
+        CompiledFilter<Pipe> filter;
+        if (!filter.compile(expression, error)) { cout << "Ошибка в выражении: " << error << "\n"; return; }
+        map<int, Pipe*> result = storage.filterPipes(filter);
+        ReportWriter out(cout);
+        for (const auto& pair : result) pair.second->writeDetails(out);
+        found = result.size();
+    }
+    else {
+        CompiledFilter<CS> filter;
+        if (!filter.compile(expression, error)) { cout << "Ошибка в выражении: " << error << "\n"; return; }
+        map<int, CS*> result = storage.filterCS(filter);
+        ReportWriter out(cout);
+        for (const auto& pair : result) pair.second->writeDetails(out);
+        found = result.size();
+    }
+    cout << "Найдено: " << found << "\n";
+    LOG.log("Expression search \"" + expression + "\": found " + to_string(found));
+}
+
+void showDashboard(Storage& storage) {
+    NetworkStats stats = storage.statistics();
+    {
+        ReportWriter out(cout);
+        stats.writeDashboard(out);
+    }
+    LOG.log("Viewed network dashboard.");
+}
+
+void showTopCS(Storage& storage) {
+    int criterion = InputHelper::inputIntInRange("Показатель (1 - % незадействованных цехов, 2 - эффективность): ", 1, 2);
+    int order = InputHelper::inputIntInRange("Порядок (1 - наибольшие, 2 - наименьшие): ", 1, 2);
+    int k = InputHelper::inputIntegerPositive("Сколько КС показать: ");
+
+    vector<CS*> found = criterion == 1 ? storage.topCSByIdle(k, order == 1) : storage.topCSByEfficiency(k, order == 1);
+    ReportWriter out(cout);
+    if (found.empty()) {
+        out << "<нет КС>";
+        out.endLine();
+    }
+    else {
+        out.cell("ID", 8).cell("Название", 30).cell("Цехи", 10).cell("Эфф., %", 10) << "Незадейств., %";
+        out.endLine();
+    }
+    for (CS* cs : found) {
+        string workshops = to_string(cs->getWorkshopsWorking()) + "/" + to_string(cs->getWorkshopsTotal());
+        out.cell(cs->getId(), 8).cell(cs->getName(), 30).cell(workshops, 10).cell(cs->getEfficiency(), 10);
+        out.fixed(cs->getIdlePercent());
+        out.endLine();
+    }
+    out.flush();
+    LOG.log(string("Viewed CS ranking: ") + to_string(found.size()) + " stations");
+}
+
+void configureIdPolicy(Storage& storage) {
+    cout << "Сейчас: " << (storage.getIdPolicy() == IdPolicy::Reuse ? "ID удалённых объектов выдаются повторно"
+        : "выдаются только новые ID") << "\n";
+    cout << "Свободных ID: трубы " << storage.pipeIds().freeIds() << ", КС " << storage.csIds().freeIds()
+        << ", соединения " << storage.connectionIds().freeIds() << "\n";
+    int choice = InputHelper::inputIntInRange(
+        "Политика (1 - повторно использовать освободившиеся ID, 2 - только новые ID для аудита): ", 1, 2);
+    storage.setIdPolicy(choice == 1 ? IdPolicy::Reuse : IdPolicy::Stable);
+    cout << "Политика выдачи ID изменена\n";
+}
+
+// Запросы вида p<ID>/c<ID> до пустой строки; show выводит запись или возвращает false
+static void browseById(const function<bool(char, int, ReportWriter&)>& show) {
+    while (true) {
+        cout << "Введите p<ID> для трубы, c<ID> для КС (пустая строка - выход): ";
+        string input;
+        if (!getline(cin, input)) break;
+        input = trim(input);
+        int id;
+        if (input.empty()) break;
+        if (input.size() < 2 || (input[0] != 'p' && input[0] != 'c') || !parseInt(input.substr(1), id)) {
+            cout << "Неверный ввод.\n";
+            continue;
+        }
+        ReportWriter out(cout);
+        if (!show(input[0], id, out)) out << "Не найдено.\n";
+        out.flush();
+    }
+}
+
+void browseIndexedSnapshot(const string& filename) {
+    LazySnapshot snap;
+    string error;
+    if (!snap.open(filename, error)) {
+        cout << "Ошибка: " << error << "\n";
+        LOG.log("Indexed snapshot open failed: " + filename);
+        return;
+    }
+    cout << "Труб: " << snap.pipeCount() << ", КС: " << snap.csCount() << ", соединений: "
+        << snap.connectionCount() << " (записи читаются по запросу)\n";
+    LOG.log("Opened indexed snapshot " + filename);
+
+    browseById([&snap](char kind, int id, ReportWriter& out) {
+        shared_ptr<const Pipe> pipe;
+        shared_ptr<const CS> cs;
+        if (kind == 'p' && (pipe = snap.findPipeById(id))) pipe->writeDetails(out);
+        else if (kind == 'c' && (cs = snap.findCSById(id))) cs->writeDetails(out);
+        else return false;
+        return true;
+    });
+}
+
+void browseCompactRegister(Storage& storage) {
+    cout << "Файл сохранения (пустая строка - текущие данные): ";
+    string filename;
+    getline(cin, filename);
+    filename = trim(filename);
+
+    // Индексированный снимок открывается без чтения записей
+    if (!filename.empty() && isIndexedSnapshot(filename)) {
+        browseIndexedSnapshot(filename);
+        return;
+    }
+
+    CompactRegister reg;
+    if (filename.empty()) {
+        reg.build(storage.snapshot());
+    }
+    else {
+        string error;
+        if (!reg.loadFromFile(filename, error)) {
+            cout << "Ошибка: " << error << "\n";
+            LOG.log("Compact register load failed: " + filename);
+            return;
+        }
+    }
+    cout << "Труб: " << reg.pipeCount() << ", КС: " << reg.csCount() << ", классов: " << reg.classCount() << "\n";
+    cout << "Память реестра: " << reg.memoryBytes() / 1024 << " КБ (в обычном виде около "
+        << reg.expandedMemoryBytes() / 1024 << " КБ)\n";
+    LOG.log("Compact register: " + to_string(reg.pipeCount()) + " pipes, " + to_string(reg.csCount()) + " CS");
+
+    browseById([&reg](char kind, int id, ReportWriter& out) {
+        Pipe pipe;
+        CS cs;
+        if (kind == 'p' && reg.findPipe(id, pipe)) pipe.writeDetails(out);
+        else if (kind == 'c' && reg.findCS(id, cs)) cs.writeDetails(out);
+        else return false;
+        return true;
+    });
+}
+
+void checkReachability(Storage& storage) {
+    int from = InputHelper::inputIntegerPositive("ID КС, откуда идёт газ: ");
+    int to = InputHelper::inputIntegerPositive("ID КС, куда должен дойти газ: ");
+    if (!storage.findCSById(from) || !storage.findCSById(to)) {
+        cout << "КС с таким ID не найдена\n";
+        return;
+    }
+    bool ready = storage.reachability(false) != nullptr;
+    if (!ready) cout << "Индекс достижимости перестраивается...\n";
+    if (storage.canReach(from, to)) cout << "Газ из КС " << from << " доходит до КС " << to << "\n";
+    else cout << "Пути от КС " << from << " до КС " << to << " по активным соединениям нет\n";
+}
+
+void showFlowState(Storage& storage) {
+    FlowOptions options;
+    string line;
+    double value;
+    cout << "Давление у потребителей, МПа (пустая строка - " << options.deliveryPressure << "): ";
+    getline(cin, line);
+    if (parseDouble(trim(line), value) && value > 0) options.deliveryPressure = value;
+    cout << "Производительность цеха, млн м3/сут (пустая строка - " << options.workshopCapacity << "): ";
+    getline(cin, line);
+    if (parseDouble(trim(line), value) && value > 0) options.workshopCapacity = value;
+
+    shared_ptr<const FlowResult> result = storage.flowState(options);
+    if (result->stations.empty()) {
+        cout << "Нет соединений с исправными трубами\n";
+        return;
+    }
+    cout << (result->converged ? "Расчёт сошёлся" : "Расчёт не сошёлся") << " за " << result->iterations
+        << " итераций, наибольший небаланс " << result->residual << " млн м3/сут\n";
+    cout << "Подсетей: " << result->components << ", КС: " << result->stations.size()
+        << ", соединений: " << result->connections.size() << "\n";
+    cout << "Подано: " << result->supplied << " млн м3/сут, доставлено: " << result->delivered << " млн м3/сут\n";
+
+    // Самые перегруженные КС: поток относительно мощности работающих цехов
+    vector<const StationFlow*> overloaded;
+    for (const StationFlow& s : result->stations) {
+        if (s.overloaded()) overloaded.push_back(&s);
+    }
+    cout << "Перегружено КС: " << overloaded.size() << "\n";
+    if (overloaded.empty()) return;
+    auto load = [](const StationFlow* s) { return s->capacity > 0 ? s->throughput / s->capacity : 1e300; };
+    size_t shown = min<size_t>(overloaded.size(), 20);
+    partial_sort(overloaded.begin(), overloaded.begin() + shown, overloaded.end(),
+        [&load](const StationFlow* a, const StationFlow* b) {
+            return make_pair(load(a), a->throughput) > make_pair(load(b), b->throughput);
+        });
+    ReportWriter out(cout);
+    out.cell("ID КС", 10).cell("Давление", 10).cell("Поток", 12) << "Мощность";
+    out.endLine();
+    for (size_t i = 0; i < shown; ++i) {
+        const StationFlow& s = *overloaded[i];
+        out.cell(s.csId, 10).cell(s.pressure, 10).cell(s.throughput, 12) << s.capacity;
+        out.endLine();
+    }
+    out.flush();
+}
@@ -2,18 +2,25 @@
 
 #include "storage.h"
 #include "utils.h"
+#include "report.h"
+#include "autosave.h"
 #include <map>
 
 class UserInterface {
     Storage& storage;
+    AutosaveService autosave;
 
 public:
     UserInterface(Storage& st);
     void printMenu();
     void listAllObjects();
+    // Просмотр всех объектов в выбранном формате: таблица, постранично, в файл
+    void viewAllObjects();
+    void writeAllObjects(ReportWriter& out, bool table);
     void searchAndBatchEditPipes();
     void run();
     void processBatchOperation(const std::map<int, int>& chosenIds);
+    void configureAutosave();
 };
 
 void addPipe(Storage& storage);
@@ -35,4 +42,21 @@ void createConnection(Storage& storage);
 void listConnections(Storage& storage);
 void removeConnection(Storage& storage);
 void topologicalSort(Storage& storage);
-void printNetwork(Storage& storage);
\ No newline at end of file
+void printNetwork(Storage& storage);
+
+void showMemoryReport(Storage& storage);
+void runCommandFile(Storage& storage);
+void importCsv(Storage& storage);
+void exportCsv(Storage& storage);
+void bulkUpdate(Storage& storage);
+bool askPipeAssignment(PipeAssignment& assignment);
+bool askCSAssignment(CSAssignment& assignment);
+void searchByExpression(Storage& storage);
+void showDashboard(Storage& storage);
+void showTopCS(Storage& storage);
+void browseIndexedSnapshot(const std::string& filename);
+void browseCompactRegister(Storage& storage);
+void configureIdPolicy(Storage& storage);
+void planConnections(Storage& storage);
+void checkReachability(Storage& storage);
+void showFlowState(Storage& storage);
\ No newline at end of file
@@ -6,6 +6,16 @@
 #include <chrono>
 #include <ctime>
 #include <iomanip>
+#include <cstdio>
+#include <limits>
+#include <atomic>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -17,6 +27,16 @@ string trim(const string& s) {
     return s.substr(a, b - a + 1);
 }
 
+void trimInPlace(string& s) {
+    size_t b = s.find_last_not_of(" \t\r\n");
+    if (b == string::npos) {
+        s.clear();
+        return;
+    }
+    s.erase(b + 1);
+    s.erase(0, s.find_first_not_of(" \t\r\n"));
+}
+
 bool parseInt(const string& s, int& out) {
     string t = trim(s);
     if (t.empty()) return false;
@@ -43,6 +63,21 @@ bool parseDouble(const string& s, double& out) {
     catch (...) { return false; }
 }
 
+bool parseRange(const string& s, double& minOut, double& maxOut) {
+    size_t sep = s.find("..");
+    if (sep == string::npos) return false;
+    string lo = trim(s.substr(0, sep));
+    string hi = trim(s.substr(sep + 2));
+    double a = -numeric_limits<double>::infinity();
+    double b = numeric_limits<double>::infinity();
+    if (!lo.empty() && !parseDouble(lo, a)) return false;
+    if (!hi.empty() && !parseDouble(hi, b)) return false;
+    if (a > b) return false;
+    minOut = a;
+    maxOut = b;
+    return true;
+}
+
 string currentTimestamp() {
     using namespace chrono;
     auto now = system_clock::now();
@@ -58,10 +93,47 @@ string currentTimestamp() {
     return oss.str();
 }
 
+string toLowerCopy(const string& s) {
+    string r = s;
+    if (!r.empty()) foldCaseInPlace(&r[0], r.size());
+    return r;
+}
+
+void foldCaseInPlace(char* s, size_t n) {
+    unsigned char* p = reinterpret_cast<unsigned char*>(s);
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = p[i];
+        if (c >= 'A' && c <= 'Z') {
+            p[i] = (unsigned char)(c + 32);
+        }
+        else if (c == 0xD0 && i + 1 < n) {
+            // U+0400..U+042F: Ѐ..Я -> ѐ..я
+            unsigned char c2 = p[i + 1];
+            if (c2 >= 0x90 && c2 <= 0x9F) p[i + 1] = (unsigned char)(c2 + 0x20);
+            else if (c2 >= 0xA0 && c2 <= 0xAF) { p[i] = 0xD1; p[i + 1] = (unsigned char)(c2 - 0x20); }
+            else if (c2 >= 0x80 && c2 <= 0x8F) { p[i] = 0xD1; p[i + 1] = (unsigned char)(c2 + 0x10); }
+            ++i;
+        }
+    }
+}
+
+bool containsFolded(const string& hay, const string& foldedNeedle) {
+    if (foldedNeedle.empty()) return true;
+    // Буфер свой у каждого потока и переиспользуется между вызовами
+    static thread_local string folded;
+    folded.assign(hay);
+    if (!folded.empty()) foldCaseInPlace(&folded[0], folded.size());
+    return folded.find(foldedNeedle) != string::npos;
+}
+
 // Logger implementation
 Logger::Logger() : filename("log.txt") {}
-void Logger::setFile(const string& fname) { filename = fname; }
+void Logger::setFile(const string& fname) {
+    lock_guard<mutex> lock(mtx);
+    filename = fname;
+}
 void Logger::log(const string& entry) {
+    lock_guard<mutex> lock(mtx);
     ofstream f(filename.c_str(), ios::app);
     if (!f) return;
     f << "[" << currentTimestamp() << "] " << entry << "\n";
@@ -173,4 +245,71 @@ map<int, int> BatchProcessor::askIdsFromUserSelection(const map<int, int>& candi
         }
         return filtered;
     }
-}
\ No newline at end of file
+}
+
+// Сброс содержимого файла на диск: без него после сбоя переименованный файл может оказаться пустым
+static bool syncFile(const string& path) {
+#if defined(_WIN32)
+    HANDLE h = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    bool ok = FlushFileBuffers(h) != 0;
+    CloseHandle(h);
+    return ok;
+#else
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+bool writeFileAtomically(const string& filename, const function<bool(ostream&)>& writer, bool binary) {
+    // Своё имя временного файла для каждой записи: ручное сохранение и автосохранение
+    // в один файл не пишут в общий временный файл
+    static atomic<unsigned long long> counter(0);
+#if defined(_WIN32)
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = (unsigned long)getpid();
+#endif
+    string tmp = filename + ".tmp." + to_string(pid) + "." + to_string(++counter);
+    {
+        ofstream f(tmp, binary ? ios::trunc | ios::binary : ios::trunc);
+        if (!f) return false;
+        if (!writer(f)) {
+            f.close();
+            remove(tmp.c_str());
+            return false;
+        }
+        f.close();
+        if (!f) {
+            remove(tmp.c_str());
+            return false;
+        }
+    }
+    if (!syncFile(tmp)) {
+        remove(tmp.c_str());
+        return false;
+    }
+#if defined(_WIN32)
+    if (!MoveFileExA(tmp.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        remove(tmp.c_str());
+        return false;
+    }
+#else
+    if (rename(tmp.c_str(), filename.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    // Запись о переименовании тоже должна попасть на диск
+    size_t slash = filename.find_last_of('/');
+    string dir = slash == string::npos ? "." : (slash == 0 ? "/" : filename.substr(0, slash));
+    int dirFd = open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+#endif
+    return true;
+}
@@ -2,16 +2,55 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <functional>
+#include <ostream>
 
 //  
 std::string trim(const std::string& s);
+//      
+void trimInPlace(std::string& s);
 bool parseInt(const std::string& s, int& out);
 bool parseDouble(const std::string& s, double& out);
+//  "min..max";     ("10..", "..25")
+bool parseRange(const std::string& s, double& minOut, double& maxOut);
 std::string currentTimestamp();
+std::string toLowerCopy(const std::string& s);
+//         UTF-8;    
+void foldCaseInPlace(char* s, size_t n);
+//   needle (   )  hay   
+bool containsFolded(const std::string& hay, const std::string& foldedNeedle);
+
+//         :
+//         ; binary -    
+bool writeFileAtomically(const std::string& filename, const std::function<bool(std::ostream&)>& writer,
+    bool binary = false);
+
+//   [0, n)        : fn(begin, end)
+template<typename F>
+void parallelFor(size_t n, F fn, size_t minPerThread = 4096) {
+    // hardware_concurrency()   ,    n  
+    size_t chunks = n / minPerThread;
+    size_t threads = chunks <= 1 ? chunks : std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), chunks);
+    if (threads <= 1) {
+        fn((size_t)0, n);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t) {
+        workers.emplace_back(fn, n * t / threads, n * (t + 1) / threads);
+    }
+    fn((size_t)0, n / threads);
+    for (std::thread& w : workers) w.join();
+}
 
 // 
 class Logger {
     std::string filename;
+    std::mutex mtx;     //     
 public:
     Logger();
     void setFile(const std::string& fname);